@@ -1,8 +1,14 @@
 #include <lc3/lc3.hpp>
 #include <lc3/lc3_assemble.hpp>
+#include <lc3/lc3_block.hpp>
+#include <lc3/lc3_checkpoint.hpp>
 #include <lc3/lc3_debug.hpp>
+#include <lc3/lc3_event.hpp>
 #include <lc3/lc3_execute.hpp>
 #include <lc3/lc3_expressions.hpp>
+#include <lc3/lc3_jit.hpp>
 #include <lc3/lc3_plugin.hpp>
+#include <lc3/lc3_profile.hpp>
 #include <lc3/lc3_runner.hpp>
 #include <lc3/lc3_symbol.hpp>
+#include <lc3/lc3_trace.hpp>
@@ -1,28 +1,18 @@
 #ifndef EXPRESSION_EVALUATOR_HPP
 #define EXPRESSION_EVALUATOR_HPP
 
+#include <functional>
 #include <stack>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
 namespace ExpressionEvaluator
 {
 
-    union eval_value
-    {
-        int (*func)(bool, int);
-        int value;
-    };
-
-    struct eval_type
-    {
-        int type;
-        eval_value eval;
-
-    };
-
-    extern std::unordered_map<std::string, eval_type> symbol_table;
-    extern int (*OnUndefinedSymbol)(const std::string& symbol, bool hasref, int ref, int& error);
+    // Resolves a symbol (or a reference to one i.e. A[5]) to its value.
+    // Sets error to eval_undefinedsymbol if the symbol is not defined.
+    // Passed to each call so evaluation has no global state and is thread safe.
+    using SymbolResolver = std::function<int(const std::string& symbol, bool hasref, int ref, int& error)>;
 
     enum
     {
@@ -35,13 +25,19 @@ namespace ExpressionEvaluator
         eval_evalerr
     };
 
-    enum
-    {
-        EVAL_VALUE = 0,
-        EVAL_FUNCTION = 1
-    };
-
-    int Calculate(std::string_view expr, int &r);
+    int Calculate(std::string_view expr, int &r, const SymbolResolver& resolver);
+
+    // Building blocks for evaluating an expression in pieces.
+    // Converts expr into a space separated reverse polish notation string.
+    int toRPN(std::string_view expr, std::string& rpn);
+    // Returns the index of the operator at the start of op or < 0 if it isn't one.
+    int isOperator(std::string_view op);
+    // Returns the length of the operand at the start of str.
+    int getToken(std::string_view str);
+    // Returns the number of characters of the operator at index op.
+    size_t OperatorLength(int op);
+    // Applies the operator at index op, returns an error code (i.e. on division by zero).
+    int ApplyOperator(int op, int op1, int op2, int& r);
 
 }
 
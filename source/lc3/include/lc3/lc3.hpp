@@ -3,6 +3,7 @@
 
 #include <lc3/lc3_api.h>
 
+#include <array>
 #include <cstdint>
 #include <cstdlib>
 #include <deque>
@@ -117,6 +118,20 @@ enum LC3_API WARNINGS
     LC3_WARNINGS               // Must be last.
 };
 
+#define LC3_WARNING_LOG_SIZE 256
+#define LC3_NO_WARNING_LIMIT 0xFFFFFFFFU
+
+/** A warning as it happened, only turned into text on demand @see lc3_format_warning. */
+struct LC3_API lc3_warning_record
+{
+    uint32_t id;            // @see WARNINGS
+    uint32_t executions;
+    uint16_t pc;            // PC after the instruction that caused the warning was fetched.
+    uint16_t instruction;
+    int16_t arg1;
+    int16_t arg2;
+};
+
 /** Cases for Smart Disassembling */
 enum DISASSEMBLE_CASES
 {
@@ -196,8 +211,22 @@ enum class lc3_event_id
     BREAKPOINT,
     WATCHPOINT,
 };
+#define LC3_EVENTS (static_cast<size_t>(lc3_event_id::WATCHPOINT) + 1)
 
 #define DEFAULT_KEYBOARD_INTERRUPT_DELAY 1000
+#define DEFAULT_UNDO_BUDGET (32 << 20)
+#define DEFAULT_OUTPUT_FLUSH_SIZE 4096
+
+/** When console output is flushed, @see lc3_set_output_flush.
+  * Except for LC3_FLUSH_ALWAYS output is also flushed before input is read and when the lc3 halts or lc3_run returns.
+  */
+enum LC3_API lc3_flush_policy
+{
+    LC3_FLUSH_ALWAYS = 0,       // After every character or string written.
+    LC3_FLUSH_NEWLINE = 1,      // After a newline is written.
+    LC3_FLUSH_SIZE = 2,         // After output_flush_size characters are written.
+    LC3_FLUSH_INPUT = 3,        // Only when needed.
+};
 
 class Plugin;
 class InstructionPlugin;
@@ -218,6 +247,15 @@ struct PluginInfo
     Plugin* plugin;
 };
 
+/** Entry in the plugin schedule, @see lc3_schedule_plugins. */
+struct lc3_plugin_deadline
+{
+    uint64_t executions;    // Execution count the plugin next runs at.
+    uint32_t generation;    // Entry is stale if the plugin was rescheduled since.
+    Plugin* plugin;
+    bool operator>(const lc3_plugin_deadline& other) const {return executions > other.executions;}
+};
+
 /** General instruction type for lc3 */
 class lc3_instruction
 {
@@ -254,6 +292,65 @@ class lc3_instruction
         uint16_t data;
 };
 
+/** Flags for a predecoded instruction */
+enum LC3_API lc3_decoded_flags
+{
+    LC3_DECODED_VALID = 1,      // Entry has been decoded.
+    LC3_DECODED_IMM = 2,        // ADD/AND immediate mode.
+    LC3_DECODED_JSR = 4,        // JSR (as opposed to JSRR).
+    LC3_DECODED_MALFORMED = 8,  // lc3_check_malformed_instruction returned true.
+};
+
+/** Predecoded instruction as stored in the instruction cache.
+  *
+  * An entry is only valid for the address it was decoded from while data still matches memory,
+  * so any write to memory (through lc3_mem_write or directly) invalidates the entry for that word.
+  */
+struct LC3_API lc3_decoded_instruction
+{
+    uint16_t data = 0;          // Raw instruction bits.
+    int16_t offset = 0;         // Sign extended imm5/offset6/PCoffset9/PCoffset11 or the trap vector.
+    uint8_t opcode = 0;
+    uint8_t dr = 0;             // Also the nzp bits for BR.
+    uint8_t sr1 = 0;            // Also BaseR.
+    uint8_t sr2 = 0;
+    uint8_t flags = 0;
+};
+
+/** Single operation of a translated basic block. */
+struct LC3_API lc3_block_op
+{
+    uint8_t handler = 0;        // @see lc3_block_handlers.
+    uint8_t dr = 0;             // Also the nzp bits for BR.
+    uint8_t sr1 = 0;            // Also BaseR.
+    uint8_t sr2 = 0;
+    int16_t value = 0;          // Immediate, offset or a precomputed absolute address.
+};
+
+/** A straight line run of instructions ending at a BR/JMP or right before an instruction that can't be translated.
+  *
+  * Translated blocks are only valid while words still matches memory starting at address.
+  */
+struct LC3_API lc3_block
+{
+    uint16_t address = 0;
+    uint32_t generation = 0;    // Changes every time the block is translated, @see lc3_state::block_generation.
+    std::vector<int16_t> words;
+    std::vector<lc3_block_op> ops;
+};
+
+class lc3_jit_cache;
+class lc3_trace_writer;
+
+/** Owns the native code compiled for a state, copies of a state start out with nothing compiled. */
+struct LC3_API lc3_jit_handle
+{
+    lc3_jit_handle() = default;
+    lc3_jit_handle(const lc3_jit_handle&) {}
+    lc3_jit_handle& operator=(const lc3_jit_handle&) { cache.reset(); return *this; }
+    std::shared_ptr<lc3_jit_cache> cache;
+};
+
 /** Enumeration of possible things that can change as part of instruction execution. */
 enum LC3_API lc3_change_t
 {
@@ -289,6 +386,40 @@ struct LC3_API lc3_watchpoint_target
     bool operator==(const lc3_watchpoint_target& other) const {return target == other.target && is_reg == other.is_reg;}
 };
 
+/** A single instruction of a compiled expression, @see lc3_compile_expression. */
+struct LC3_API lc3_expression_op
+{
+    uint8_t opcode;
+    int32_t value;
+};
+
+/** An expression compiled into a postfix program so it can be evaluated without reparsing it. */
+struct LC3_API lc3_expression
+{
+    std::string source;                     // Expression this was compiled from.
+    std::vector<lc3_expression_op> code;
+    int32_t error = -1;                     // -1 if not compiled yet, otherwise the result of lc3_compile_expression.
+    uint32_t symbol_generation = 0;         // lc3_state::symbol_generation when compiled, symbols are resolved then.
+};
+
+/** A piece of a breakpoint/watchpoint message, text followed by an optional {{expression}}. */
+struct LC3_API lc3_message_part
+{
+    uint32_t text_start;
+    uint32_t text_length;
+    bool has_expression;
+    lc3_expression expression;
+};
+
+/** A breakpoint/watchpoint message split into text and compiled expressions. */
+struct LC3_API lc3_message_template
+{
+    std::string source;
+    std::vector<lc3_message_part> parts;
+    int32_t error = -1;                     // Same as lc3_expression::error.
+    uint32_t symbol_generation = 0;         // Same as lc3_expression::symbol_generation.
+};
+
 /** Record of stats for a breakpoint/watchpoint. */
 struct LC3_API lc3_debug_info
 {
@@ -299,6 +430,9 @@ struct LC3_API lc3_debug_info
     std::string name;
     std::string condition;
     std::string message;
+    // Compiled forms of condition and message, rebuilt if either string or the symbol table changes.
+    lc3_expression condition_program;
+    lc3_message_template message_program;
     bool is_breakpoint() const {return std::holds_alternative<lc3_breakpoint_target>(target);}
     bool is_watchpoint() const {return std::holds_alternative<lc3_watchpoint_target>(target);}
     std::string target_string() const
@@ -393,11 +527,29 @@ struct LC3_API lc3_memory_stats
     uint64_t writes = 0;
 };
 
-/** Record of active interrupt requests */
-struct LC3_API lc3_interrupt_req
+/** Pending interrupt requests, one bit per vector for each priority.
+  * A request is either pending or not, signaling it again before it is acknowledged does nothing.
+  */
+struct LC3_API lc3_interrupt_set
 {
-    uint8_t priority:3;
-    uint8_t vector;
+    std::array<std::array<uint64_t, 4>, 8> pending{};
+    uint8_t priorities = 0;     // Bit p is set if anything is pending at priority p.
+
+    bool empty() const {return priorities == 0;}
+    void clear() {pending = {}; priorities = 0;}
+    bool test(uint8_t priority, uint8_t vector) const {return (pending[priority][vector >> 6] >> (vector & 63)) & 1;}
+    void set(uint8_t priority, uint8_t vector)
+    {
+        pending[priority][vector >> 6] |= 1ULL << (vector & 63);
+        priorities |= 1 << priority;
+    }
+    void reset(uint8_t priority, uint8_t vector)
+    {
+        auto& words = pending[priority];
+        words[vector >> 6] &= ~(1ULL << (vector & 63));
+        if ((words[0] | words[1] | words[2] | words[3]) == 0)
+            priorities &= ~(1 << priority);
+    }
 };
 
 /** Changed information with previous value for undo stack */
@@ -421,12 +573,83 @@ struct LC3_API lc3_state_change
     std::vector<lc3_change_info> info;  // Only used for changes = LC3_MULTI_CHANGE
 };
 
+/** Undo history, lc3_state_changes stored as variable length records in a ring buffer.
+  *
+  * The buffer grows as needed up to a memory budget, after that the oldest records are discarded.
+  */
+class LC3_API lc3_undo_journal
+{
+public:
+    /** Number of records. */
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    /** Bytes used by the records. */
+    size_t bytes() const { return used; }
+    /** Maximum bytes the records may use. */
+    size_t budget() const { return limit; }
+    /** Sets the memory budget, discarding the oldest records if needed. */
+    void set_budget(size_t bytes);
+    /** Removes all records and releases the buffer. */
+    void clear();
+    /** Decodes the newest record. */
+    lc3_state_change back() const;
+    /** Changes the type of the newest record, only between LC3_INTERRUPT_BEGIN and LC3_INTERRUPT. */
+    void set_back_changes(uint8_t changes);
+    /** Adds a record, discarding the oldest records if the budget is exceeded. */
+    void push_back(const lc3_state_change& change);
+    void pop_back();
+    void pop_front();
+
+private:
+    size_t record_size(size_t position) const;
+    void read(size_t position, void* data, size_t length) const;
+    void write(size_t position, const void* data, size_t length);
+    void reallocate(size_t capacity);
+
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> scratch;
+    size_t head = 0;            // Start of the oldest record.
+    size_t tail = 0;            // End of the newest record.
+    size_t used = 0;
+    size_t count = 0;
+    size_t limit = DEFAULT_UNDO_BUDGET;
+};
+
 // Stack of RTI-able items for lc-3 revision.
 typedef struct lc3_rti_stack_item
 {
     bool is_interrupt;
 } lc3_rti_stack_item;
 
+/** Snapshot of everything lc3_step reads or writes, @see lc3_seek. */
+struct LC3_API lc3_checkpoint
+{
+    uint32_t executions = 0;
+    int16_t regs[8];
+    uint16_t pc;
+    uint8_t privilege:1;
+    uint8_t priority:3;
+    uint8_t n:1;
+    uint8_t z:1;
+    uint8_t p:1;
+    uint8_t halted:1;
+    uint32_t warnings;
+    std::vector<int16_t> mem;
+    std::deque<lc3_subroutine_call> call_stack;
+    std::deque<lc3_rti_stack_item> rti_stack;
+    std::vector<lc3_subroutine_call_info> first_level_calls;
+    std::vector<lc3_trap_call_info> first_level_traps;
+    std::mt19937 rng;
+    std::array<uint32_t, LC3_WARNINGS> warn_stats;
+    lc3_interrupt_set interrupts;
+    int32_t interrupt_vector;
+    std::deque<int32_t> interrupt_vector_stack;
+    uint16_t savedusp;
+    uint16_t savedssp;
+    uint32_t keyboard_int_counter;
+    std::streampos input_position;  // -1 if the input stream can't be repositioned.
+};
+
 using lc3_output_event          = std::function<void(lc3_state&, char)>;
 using lc3_puts_event            = std::function<void(lc3_state&, const std::string&)>;
 using lc3_input_event           = std::function<void(lc3_state&, uint8_t)>;
@@ -434,15 +657,15 @@ using lc3_interrupt_event       = std::function<void(lc3_state&, uint8_t)>;
 using lc3_exit_interrupt_event  = std::function<void(lc3_state&, uint8_t)>;
 using lc3_trap_event            = std::function<void(lc3_state&, uint8_t)>;
 using lc3_exit_trap_event       = std::function<void(lc3_state&, uint8_t)>;
-using lc3_subroutine_event      = std::function<void(lc3_state&, uint8_t)>;
-using lc3_exit_subroutine_event = std::function<void(lc3_state&, uint8_t)>;
+using lc3_subroutine_event      = std::function<void(lc3_state&, uint16_t)>;
+using lc3_exit_subroutine_event = std::function<void(lc3_state&, uint16_t)>;
 using lc3_memory_read_event     = std::function<void(lc3_state&, uint16_t)>;
 using lc3_memory_write_event    = std::function<void(lc3_state&, uint16_t, int16_t)>;
 using lc3_warning_event         = std::function<void(lc3_state&, int32_t)>;
 using lc3_breakpoint_event      = std::function<void(lc3_state&, const lc3_debug_info&)>;
 using lc3_watchpoint_event      = std::function<void(lc3_state&, const lc3_debug_info&)>;
 
-//  LC3 event function type
+//  LC3 event function type, the alternative at index N is the function type for event id N.
 using lc3_event_function = std::variant<
     std::monostate,
     lc3_output_event,
@@ -461,6 +684,20 @@ using lc3_event_function = std::variant<
     lc3_watchpoint_event
 >;
 
+/** A function in the event table and the serial number that identifies its subscription. */
+struct LC3_API lc3_event_listener
+{
+    uint32_t serial;
+    lc3_event_function function;
+};
+
+/** Handle for a single subscription, @see lc3_subscribe. */
+struct LC3_API lc3_subscription
+{
+    lc3_event_id id = lc3_event_id::INVALID;
+    uint32_t serial = 0;
+};
+
 
 /** Main type for a running lc3 machine */
 struct LC3_API lc3_state
@@ -482,8 +719,17 @@ struct LC3_API lc3_state
 
     std::unordered_map<std::string, uint16_t> symbols;
     std::unordered_map<uint16_t, std::string> rev_symbols;
+    uint32_t symbol_generation = 0;     // Changes whenever the symbol table does, @see lc3_expression.
 
     int16_t mem[65536];
+    // Predecoded instruction cache indexed by address, sized on first use.
+    std::vector<lc3_decoded_instruction> decode_cache;
+    // Translated basic blocks keyed by starting address.
+    std::unordered_map<uint16_t, lc3_block> block_cache;
+    // Blocks translated so far, so compiled code can tell which translation of a block it was made from.
+    uint32_t block_generation = 0;
+    // Native code for translated blocks, @see lc3_run_jit.
+    lc3_jit_handle jit;
 
     // Stream for input
     std::istream* input;
@@ -496,18 +742,29 @@ struct LC3_API lc3_state
     std::ostream* output;
     // Function to write one character to stream
     std::function<int32_t(lc3_state&, std::ostream&, int32_t)> writer;
+    // When output is flushed, @see lc3_set_output_flush.
+    lc3_flush_policy output_flush = LC3_FLUSH_ALWAYS;
+    uint32_t output_flush_size = DEFAULT_OUTPUT_FLUSH_SIZE;
+    uint32_t output_pending = 0;    // Characters written since the last flush.
 
     // Stream for debug messages
     std::ostream* debug = nullptr;
 
-    // Stream for warnings
+    // Stream for warnings, nullptr to only keep warning records.
     std::ostream* warning;
 
     // Plugins loaded into the state
     InstructionPlugin* instructionPlugin;
     std::unordered_map<uint8_t, TrapFunctionPlugin*> trapPlugins;
     std::unordered_map<uint16_t, Plugin*> address_plugins;
+    // Flat view of address_plugins for memory accesses, @see lc3_index_address_plugins.
+    std::array<Plugin*, 512> device_plugins{};          // Plugins bound to 0xFE00-0xFFFF.
+    std::array<uint64_t, 4> address_plugin_pages{};     // One bit per 256 word page with a plugin bound to it.
     std::vector<Plugin*> plugins;
+    // Min heap of when plugins next want OnTick/OnTock called, @see lc3_schedule_plugins.
+    std::vector<lc3_plugin_deadline> plugin_schedule;
+    std::vector<Plugin*> plugins_due;       // Plugins running in the current instruction.
+    uint32_t plugin_schedule_executions = 0;
 
     // Plugin handle information
     std::unordered_map<std::string, PluginInfo> filePlugin;
@@ -516,8 +773,19 @@ struct LC3_API lc3_state
     std::unordered_map<uint8_t, Plugin*> interruptPlugin;
 
     // Maximum undo stack size just here for people who like to infinite loop/recurse and don't want their computers to explode.
+    // The undo stack is also limited by its memory budget @see lc3_undo_journal::set_budget.
     uint32_t max_stack_size;
-    std::deque<lc3_state_change> undo_stack;
+    lc3_undo_journal undo_stack;
+
+    // Periodic snapshots for lc3_seek, oldest first @see lc3_set_checkpoints.
+    std::vector<lc3_checkpoint> checkpoints;
+    uint32_t checkpoint_interval = 0;       // Executions between checkpoints, 0 if disabled.
+    uint32_t checkpoint_dirty_pages = 0;    // Also checkpoint after this many 256 word pages were written to, 0 to ignore.
+    uint32_t max_checkpoints = 0;
+    uint32_t next_checkpoint = 0;           // Execution count the next checkpoint is due at.
+    // Pages written to since the last checkpoint.
+    std::array<uint64_t, 4> dirty_pages{};
+    uint32_t dirty_page_count = 0;
 
     // Maximum call stack size just here for people who like to infinite loop/recurse and don't want their computers to explode.
     uint32_t max_call_stack_size;
@@ -529,20 +797,27 @@ struct LC3_API lc3_state
     std::vector<lc3_subroutine_call_info> first_level_calls;
     // First layer of trap calls (In case of multi recursion).
     std::vector<lc3_trap_call_info> first_level_traps;
-    // Event table
-    std::unordered_map<lc3_event_id, std::list<lc3_event_function>> event_table;
+    // Event table indexed by event id, @see lc3_subscribe.
+    std::array<std::vector<lc3_event_listener>, LC3_EVENTS> event_table;
+    // One bit per event id with functions in the event table, so emitting an event nobody listens to is a bit test.
+    uint32_t event_subscriptions = 0;
+    // Serial number for the next subscription, never reused so old handles can't remove a newer function.
+    uint32_t next_subscription = 1;
 
     // Random number generator
     std::mt19937 rng;
     std::uniform_int_distribution<uint16_t> dist;
     uint32_t default_seed = 0;
 
-    // Warn limit map
-    std::unordered_map<int32_t, uint32_t> warn_stats;
-    std::unordered_map<int32_t, uint32_t> warn_limits;
+    // Number of warnings of each type and how many of them are printed, LC3_NO_WARNING_LIMIT for all.
+    std::array<uint32_t, LC3_WARNINGS> warn_stats{};
+    std::array<uint32_t, LC3_WARNINGS> warn_limits{};
+    // The most recent warnings, record i is at warning_log[i % LC3_WARNING_LOG_SIZE] @see lc3_recent_warnings.
+    std::array<lc3_warning_record, LC3_WARNING_LOG_SIZE> warning_log{};
+    uint32_t warning_log_count = 0;
 
-    // Interrupt support push things here to cause interrupt
-    std::list<lc3_interrupt_req> interrupts;
+    // Pending interrupts @see lc3_signal_interrupt.
+    lc3_interrupt_set interrupts;
     std::list<std::function<void(lc3_state&)>> interrupt_test; // Functions to be called at the end of each step.
     int32_t interrupt_vector; // Current interrupt vector that is being handled
     std::deque<int32_t> interrupt_vector_stack; // Current stack of interrupts being handled.
@@ -555,16 +830,24 @@ struct LC3_API lc3_state
     std::unordered_map<uint16_t, lc3_debug_info> breakpoints;
     std::unordered_map<uint16_t, lc3_debug_info> mem_watchpoints;
     std::unordered_map<uint8_t , lc3_debug_info> reg_watchpoints;
+    // Membership bitmaps for the above so the per step check is a bit test.
+    // Only kept in sync by the functions in lc3_debug.hpp, @see lc3_add_breakpoint.
+    std::array<uint64_t, 1024> breakpoint_bits{};
+    std::array<uint64_t, 1024> mem_watchpoint_bits{};
+    uint8_t reg_watchpoint_bits = 0;
     std::unordered_map<uint16_t, std::string> comments;
     std::unordered_map<uint16_t, lc3_subroutine_info> subroutines;
 
-    // Statistics
-    std::unordered_map<uint16_t, lc3_memory_stats> memory_ops;
+    // Statistics, only collected if profiling is enabled @see lc3_set_memory_profiling.
+    bool memory_profiling = false;
+    std::vector<lc3_memory_stats> memory_ops;   // Indexed by address, empty until profiling is enabled.
     uint64_t total_reads;
     uint64_t total_writes;
 
     // Trace logging
     std::ostream* trace = nullptr;
+    // Binary trace logging, much cheaper than the above, @see lc3_trace_writer.
+    lc3_trace_writer* binary_trace = nullptr;
 
     // test_only mode
     // The only effect is that it records the first level subroutine/trap calls.
@@ -581,12 +864,31 @@ struct LC3_API lc3_state
   * @param memory_fill_value ignored if randomize_memory is true otherwise sets memory to this value (except for TVT, IVT and lc3 os code).
   */
 void LC3_API lc3_init(lc3_state& state, bool randomize_registers = true, bool randomize_memory = true, int16_t register_fill_value = 0, int16_t memory_fill_value = 0);
+/** lc3_clone
+  *
+  * Makes clone an independent copy of a loaded machine, i.e. to run many test cases against one assembled program.
+  * Copies registers, memory, symbols, comments, subroutine info, breakpoints, pending interrupts and settings.
+  * The clone starts with no event subscriptions, undo stack, checkpoints, traces or profiling, and no plugins unless keep_plugins is set.
+  * Cloning into the same clone again reuses its allocations and instruction caches, so keep one clone per worker.
+  * @param clone LC3State object to overwrite.
+  * @param state LC3State object to copy.
+  * @param keep_plugins If true the clone keeps the plugins it has installed instead of removing them, i.e. to reuse them for another program that loads the same ones.
+  */
+void LC3_API lc3_clone(lc3_state& clone, const lc3_state& state, bool keep_plugins = false);
 /** lc3_set_version
   * Sets the lc3's version should be done after lc3_init.
   * This function will overwrite the LC3OS code with the proper OS for that version.
   * @param version. LC-3 Version. Valid values are 0 for original LC-3 and 1 for 2019's revision.
   */
 void LC3_API lc3_set_version(lc3_state& state, int version);
+/** lc3_set_undo
+  *
+  * Turns recording undo history on or off, turning it off clears the history.
+  * lc3_init turns it on. Headless runners that never step back should turn it off since lc3_run only uses the fast run mode without it.
+  * @param state LC3State object.
+  * @param enabled If true every step is recorded so it can be undone.
+  */
+void LC3_API lc3_set_undo(lc3_state& state, bool enabled);
 /** lc3_remove_plugins
   *
   * Removes all installed lc3 plugins.
@@ -711,6 +1013,40 @@ int32_t lc3_do_write_char(lc3_state& state, std::ostream& file, int32_t chr);
   * @return Zero on success nonzero on failure.
   */
 int32_t lc3_write_str(lc3_state& state, const std::function<int32_t(lc3_state&, std::ostream&, int32_t)>& writer, std::ostream& file, const std::string& str);
+/** lc3_write_chars
+  *
+  * Prints characters like calling lc3_write_char on each, warnings about non printable characters come out just before them.
+  * If the writer is lc3_do_write_char the characters between warnings are written to the stream in one go.
+  * @param state LC3State object.
+  * @param file Stream to write to.
+  * @param chars Characters to write.
+  * @param count Number of characters.
+  * @return Zero on success nonzero on failure.
+  */
+int32_t lc3_write_chars(lc3_state& state, std::ostream& file, const int32_t* chars, size_t count);
+/** lc3_set_output_flush
+  *
+  * Sets when output written by the lc3 is flushed, pending output is flushed first.
+  * @param state LC3State object.
+  * @param policy When to flush.
+  * @param size Number of characters to buffer for LC3_FLUSH_SIZE.
+  */
+void LC3_API lc3_set_output_flush(lc3_state& state, lc3_flush_policy policy, uint32_t size = DEFAULT_OUTPUT_FLUSH_SIZE);
+/** lc3_output_written
+  *
+  * Flushes the output if needed after the lc3 wrote to it according to the flush policy.
+  * @param state LC3State object.
+  * @param count Number of characters written.
+  * @param newline True if a newline was among them.
+  */
+void lc3_output_written(lc3_state& state, uint32_t count, bool newline);
+/** lc3_flush_output
+  *
+  * Flushes any output not yet flushed due to the flush policy.
+  * Done automatically before input is read and when the lc3 halts or lc3_run returns.
+  * @param state LC3State object.
+  */
+void LC3_API lc3_flush_output(lc3_state& state);
 
 /** lc3_set_true_traps
   *
@@ -724,6 +1060,29 @@ inline void lc3_set_true_traps(lc3_state& state, bool value) {state.true_traps =
 inline uint16_t lc3_random(lc3_state& state) { return state.dist(state.rng); }
 /** Get the value of the PSR */
 inline uint16_t lc3_psr(lc3_state& state) { return (state.privilege << 15) | (state.priority << 8) | (state.n << 2) | (state.z << 1) | state.p; }
+/** Get the plugin bound to an address or nullptr */
+inline Plugin* lc3_address_plugin(const lc3_state& state, uint16_t addr)
+{
+    if (!((state.address_plugin_pages[addr >> 14] >> ((addr >> 8) & 63)) & 1))
+        return nullptr;
+    if (addr >= 0xFE00U)
+        return state.device_plugins[addr - 0xFE00U];
+    const auto it = state.address_plugins.find(addr);
+    return it != state.address_plugins.end() ? it->second : nullptr;
+}
+/** Test a bit of one of the 64K bit address bitmaps */
+inline bool lc3_test_address_bit(const std::array<uint64_t, 1024>& bits, uint16_t addr)
+{
+    return (bits[addr >> 6] >> (addr & 63)) & 1;
+}
+/** Set or clear a bit of one of the 64K bit address bitmaps */
+inline void lc3_set_address_bit(std::array<uint64_t, 1024>& bits, uint16_t addr, bool value)
+{
+    if (value)
+        bits[addr >> 6] |= uint64_t{1} << (addr & 63);
+    else
+        bits[addr >> 6] &= ~(uint64_t{1} << (addr & 63));
+}
 /** lc3_randomize
   *
   * Randomizes LC3 Memory
@@ -3,6 +3,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "lc3/lc3.hpp"
@@ -92,6 +93,8 @@ struct LC3_API LC3AssembleOptions
     bool enable_warnings = false;
     bool disable_plugins = false;
     bool process_debug_comments = true;
+    // Most threads the second pass may use, 0 for one per core.
+    unsigned int threads = 0;
     enum class OutputMode {
         // Non readable object file.
         OBJECT_FILE = 0,
@@ -110,7 +113,7 @@ struct LC3_API LC3AssembleOptions
 /** Contextual information pass among assemble/parser functions */
 struct LC3_API LC3AssembleContext
 {
-    std::vector<std::string> tokens;
+    std::vector<std::string_view> tokens;   // Views into line or the source being assembled, std::string before LC3_MAJOR_VERSION 2.
     mutable std::list<LC3AssembleException> exceptions;
     std::string line;
     lc3_state* state = nullptr;
@@ -161,6 +164,16 @@ void LC3_API lc3_assemble(lc3_state& state, const std::string& filename, const L
   * @throw LC3AssembleException on error
   */
 bool LC3_API lc3_assemble(const std::string& filename, const std::string& output_prefix = "", const LC3AssembleOptions& options = LC3AssembleOptions());
+/** lc3_assemble_write
+  *
+  * Writes the sym file and the output file for options.output_mode of a program assembled into state.
+  * @param output_prefix Filename without extension to save the files as.
+  * @param state LC3State object the program was assembled into.
+  * @param ranges List of .orig/.end pairs from assembling.
+  * @param options Assembler options.
+  * @return True on success.
+  */
+bool LC3_API lc3_assemble_write(const std::string& output_prefix, lc3_state& state, const std::vector<code_range>& ranges, const LC3AssembleOptions& options = LC3AssembleOptions());
 
 /** lc3_assemble
   *
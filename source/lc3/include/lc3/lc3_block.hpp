@@ -0,0 +1,60 @@
+#ifndef LC3_BLOCK_HPP
+#define LC3_BLOCK_HPP
+
+#include "lc3/lc3.hpp"
+
+/** Maximum number of instructions in a translated block. */
+#define LC3_MAX_BLOCK_SIZE 64
+
+/** Micro operations a block is translated into. */
+enum lc3_block_handlers
+{
+    BLOCK_ADD_REG = 0,
+    BLOCK_ADD_IMM,
+    BLOCK_AND_REG,
+    BLOCK_AND_IMM,
+    BLOCK_NOT,
+    BLOCK_LD,
+    BLOCK_LDI,
+    BLOCK_LDR,
+    BLOCK_ST,
+    BLOCK_STI,
+    BLOCK_STR,
+    BLOCK_LEA,
+    BLOCK_BR,
+    BLOCK_JMP,
+    BLOCK_HANDLERS       // Must be last.
+};
+
+/** lc3_translate_block
+  *
+  * Translates the basic block starting at an address.
+  * Translation stops after a BR/JMP or before any instruction that must be executed by lc3_step
+  * (JSR, TRAP, RTI, plugin instructions, malformed instructions).
+  * @param state LC3State object.
+  * @param addr Starting address of the block.
+  * @param block Output param for the translated block, if no instructions could be translated ops will be empty.
+  */
+void LC3_API lc3_translate_block(lc3_state& state, uint16_t addr, lc3_block& block);
+/** lc3_fetch_block
+  *
+  * Gets the translated block starting at an address from the block cache, translating it if it is missing or stale.
+  * @param state LC3State object.
+  * @param addr Starting address of the block.
+  * @return the translated block.
+  */
+LC3_API const lc3_block& lc3_fetch_block(lc3_state& state, uint16_t addr);
+/** lc3_execute_block
+  *
+  * Executes up to limit instructions of a translated block.
+  * The block must start at the current PC. Execution stops early if the machine halts, an instruction
+  * jumps elsewhere (i.e. an exception), a store modifies the block, or a RET needs bookkeeping.
+  * None of the per step bookkeeping of lc3_step is done, @see lc3_can_run_fast.
+  * @param state LC3State object.
+  * @param block Block to execute.
+  * @param limit Maximum number of instructions to execute.
+  * @return the number of instructions executed.
+  */
+unsigned int LC3_API lc3_execute_block(lc3_state& state, const lc3_block& block, unsigned int limit);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef LC3_CHECKPOINT_HPP
+#define LC3_CHECKPOINT_HPP
+
+#include <algorithm>
+
+#include "lc3/lc3.hpp"
+
+/** lc3_set_checkpoints
+  *
+  * Enables or disables periodic checkpoints used by lc3_seek, and takes the first checkpoint right away.
+  * Should be called after the program is loaded.
+  * When there are too many checkpoints every other one is discarded, so older history becomes sparser.
+  * @param state LC3State object.
+  * @param interval Number of executions between checkpoints, 0 to disable and discard all checkpoints.
+  * @param dirty_pages Also take a checkpoint once this many 256 word pages were written to, 0 to ignore.
+  * @param max_checkpoints Maximum number of checkpoints to keep (at least 2).
+  */
+void LC3_API lc3_set_checkpoints(lc3_state& state, uint32_t interval, uint32_t dirty_pages = 0, uint32_t max_checkpoints = 64);
+/** lc3_save_checkpoint
+  *
+  * Takes a checkpoint now, discarding any checkpoints at or after the current execution count.
+  * Must be called between instructions.
+  * @param state LC3State object.
+  */
+void LC3_API lc3_save_checkpoint(lc3_state& state);
+/** lc3_restore_checkpoint
+  *
+  * Restores the state saved in a checkpoint.
+  * The undo stack is cleared since it no longer matches, breakpoints, plugins and other settings are untouched.
+  * @param state LC3State object.
+  * @param checkpoint Checkpoint to restore.
+  */
+void LC3_API lc3_restore_checkpoint(lc3_state& state, const lc3_checkpoint& checkpoint);
+/** lc3_discard_checkpoints
+  *
+  * Discards checkpoints taken after the current execution count (i.e. after backstepping).
+  * @param state LC3State object.
+  */
+void LC3_API lc3_discard_checkpoints(lc3_state& state);
+/** lc3_seek
+  *
+  * Moves execution to the point where exactly execution_count instructions were executed.
+  * Going forward runs normally. Going back restores the nearest checkpoint and replays execution
+  * to the target with output, warnings and breakpoints suppressed, falling back to the undo stack
+  * if there is no checkpoint. Replay is deterministic (including KBSR/DSR polling) as long as the
+  * input stream can be repositioned and no plugins keep state of their own.
+  * @param state LC3State object.
+  * @param execution_count Target execution count.
+  * @return true if the target was reached.
+  */
+bool LC3_API lc3_seek(lc3_state& state, uint32_t execution_count);
+
+/** Checks if a checkpoint should be taken before the next instruction. */
+inline bool lc3_checkpoint_due(const lc3_state& state)
+{
+    return state.checkpoint_interval != 0 && (state.executions >= state.next_checkpoint ||
+        (state.checkpoint_dirty_pages != 0 && state.dirty_page_count >= state.checkpoint_dirty_pages));
+}
+/** Limits a number of instructions to execute in one go so the next checkpoint is not skipped over. */
+inline unsigned int lc3_checkpoint_limit(const lc3_state& state, unsigned int num)
+{
+    if (state.checkpoint_interval == 0 || state.executions >= state.next_checkpoint)
+        return num;
+    return std::min(num, state.next_checkpoint - state.executions);
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef LC3_EVENT_HPP
+#define LC3_EVENT_HPP
+
+#include <utility>
+
+#include "lc3/lc3.hpp"
+
+/* Events and the arguments they are emitted with.
+ *
+ * OUTPUT           Character written by OUT, the IN echo or a DDR write.
+ * OUTPUT_STRING    String written by PUTS, PUTSP or the IN prompt.
+ * INPUT            Character read by GETC, IN or a KBDR read.
+ * INTERRUPT        Vector of the interrupt or exception being handled.
+ * EXIT_INTERRUPT   Vector of the interrupt returned from via RTI.
+ * TRAP             Vector of the trap executed.
+ * EXIT_TRAP        Vector of the trap returned from, for true traps this is only known if the call stack is kept.
+ * SUBROUTINE       Address of the subroutine called by JSR/JSRR.
+ * EXIT_SUBROUTINE  Address returned to by RET.
+ * MEMORY_READ      Address read by an instruction.
+ * MEMORY_WRITE     Address and value written by an instruction.
+ * WARNING          Warning id, -1 for warnings given as a message.
+ * BREAKPOINT       Breakpoint that was hit.
+ * WATCHPOINT       Watchpoint that was hit.
+ */
+
+/** lc3_subscribe
+  *
+  * Calls function whenever the event happens, functions are called in the order they were added.
+  * The function's type depends on the event, i.e. lc3_subroutine_event for lc3_event_id::SUBROUTINE.
+  * A function must not subscribe or unsubscribe to the event it is called for.
+  * @param state LC3State object.
+  * @param function Function to call.
+  * @return Handle to remove just this function with lc3_unsubscribe.
+  */
+template <lc3_event_id id, typename Function>
+lc3_subscription lc3_subscribe(lc3_state& state, Function&& function)
+{
+    constexpr auto index = static_cast<size_t>(id);
+    const uint32_t serial = state.next_subscription++;
+    state.event_table[index].push_back(lc3_event_listener{serial, lc3_event_function(std::in_place_index<index>, std::forward<Function>(function))});
+    state.event_subscriptions |= 1U << index;
+    return lc3_subscription{id, serial};
+}
+/** lc3_unsubscribe
+  *
+  * Removes all functions listening to an event.
+  * @param state LC3State object.
+  * @param id Event to stop listening to.
+  */
+void LC3_API lc3_unsubscribe(lc3_state& state, lc3_event_id id);
+/** lc3_unsubscribe
+  *
+  * Removes the function added by a single call to lc3_subscribe, other functions listening to the event are kept.
+  * @param state LC3State object.
+  * @param subscription Handle returned by lc3_subscribe, nothing happens if it was already removed.
+  */
+void LC3_API lc3_unsubscribe(lc3_state& state, const lc3_subscription& subscription);
+/** lc3_is_subscribed
+  *
+  * Checks if anything is listening to an event.
+  * @param state LC3State object.
+  * @param id Event to check.
+  * @return true if there are functions listening.
+  */
+inline bool lc3_is_subscribed(const lc3_state& state, lc3_event_id id)
+{
+    return (state.event_subscriptions >> static_cast<size_t>(id)) & 1;
+}
+/** lc3_emit
+  *
+  * Calls the functions listening to an event, only a bit test if there are none.
+  * @param state LC3State object.
+  * @param args Arguments for the event, @see the list above.
+  */
+template <lc3_event_id id, typename... Args>
+inline void lc3_emit(lc3_state& state, Args&&... args)
+{
+    constexpr auto index = static_cast<size_t>(id);
+    if (!((state.event_subscriptions >> index) & 1))
+        return;
+    for (const auto& listener : state.event_table[index])
+        std::get<index>(listener.function)(state, args...);
+}
+
+#endif
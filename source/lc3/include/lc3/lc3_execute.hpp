@@ -11,6 +11,29 @@
   * @return the changes in lc3 state as performed by the instruction executed.
   */
 lc3_state_change lc3_execute(lc3_state& state, uint16_t instruction);
+/** lc3_execute
+  *
+  * Executes the given predecoded instruction.
+  * @param state LC3State object.
+  * @param instruction Predecoded instruction.
+  * @return the changes in lc3 state as performed by the instruction executed.
+  */
+lc3_state_change lc3_execute(lc3_state& state, const lc3_decoded_instruction& instruction);
+/** lc3_decode
+  *
+  * Decodes the instruction bits into their predecoded form.
+  * @param data Instruction data.
+  * @param decoded Output param for the decoded instruction.
+  */
+void LC3_API lc3_decode(uint16_t data, lc3_decoded_instruction& decoded);
+/** lc3_fetch
+  *
+  * Gets the predecoded instruction at an address from the instruction cache, decoding it if the cache entry is stale.
+  * @param state LC3State object.
+  * @param addr Address of the instruction.
+  * @return the predecoded instruction.
+  */
+LC3_API const lc3_decoded_instruction& lc3_fetch(lc3_state& state, uint16_t addr);
 /** lc3_trap
   *
   * Executes the trap instruction passed in.
@@ -46,7 +69,7 @@ int16_t LC3_API lc3_mem_read(lc3_state& state, uint16_t addr, bool privileged =
 void LC3_API lc3_mem_write(lc3_state& state, uint16_t addr, int16_t val, bool privileged = false);
 /** lc3_warning
   *
-  * Prints a warning message on the warnings stream.
+  * Records a warning and prints it on the warnings stream if there is one and its limit is not reached.
   * @param state LC3State object.
   * @param warn_id Warning ID to print @see WARNINGS.
   * @param arg1 Argument 1 for formatting.
@@ -60,5 +83,20 @@ void LC3_API lc3_warning(lc3_state& state, uint32_t warn_id, int16_t arg1, int16
   * @param warning Warning message to print out.
   */
 void LC3_API lc3_warning(lc3_state& state, const std::string& msg);
+/** lc3_format_warning
+  *
+  * Formats a warning record as it would be printed on the warnings stream.
+  * @param state LC3State object.
+  * @param record Warning to format.
+  * @return The warning message.
+  */
+std::string LC3_API lc3_format_warning(lc3_state& state, const lc3_warning_record& record);
+/** lc3_recent_warnings
+  *
+  * Gets the most recent warnings, oldest first.
+  * @param state LC3State object.
+  * @return Up to LC3_WARNING_LOG_SIZE warning records.
+  */
+std::vector<lc3_warning_record> LC3_API lc3_recent_warnings(const lc3_state& state);
 
 #endif
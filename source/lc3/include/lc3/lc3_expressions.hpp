@@ -3,17 +3,6 @@
 
 #include "lc3/lc3.hpp"
 
-int get_r0(bool, int);
-int get_r1(bool, int);
-int get_r2(bool, int);
-int get_r3(bool, int);
-int get_r4(bool, int);
-int get_r5(bool, int);
-int get_r6(bool, int);
-int get_r7(bool, int);
-int get_pc(bool, int);
-int get_mem(bool, int);
-
 class LC3_API LC3CalculateException : public std::exception
 {
 public:
@@ -30,7 +19,7 @@ private:
 /** lc3_calculate
   *
   * Computes an expression against the state passed in.
-  * @warning Not thread safe.
+  * Keeps no global state, so different states can be used from different threads.
   * @param state LC3State object.
   * @param expr A string containing an expression.
   * @return Return value
@@ -38,10 +27,25 @@ private:
   */
 int LC3_API lc3_calculate(lc3_state& state, std::string_view expr);
 
-/** lc3_int_eval
+/** lc3_compile_expression
+  *
+  * Compiles an expression into a program that can be evaluated repeatedly without reparsing it.
+  * Symbols are resolved now, so the program has to be recompiled if the symbol table changes, @see lc3_state::symbol_generation.
+  * @param state LC3State object.
+  * @param expr A string containing an expression.
+  * @param program Compiled expression, program.error is set to the return value.
+  * @return 0 on success, otherwise an error code for LC3CalculateException.
+  */
+int LC3_API lc3_compile_expression(lc3_state& state, std::string_view expr, lc3_expression& program);
+
+/** lc3_evaluate
   *
-  * Initializes expression evaluator for symbols.
+  * Evaluates a compiled expression against the state passed in.
+  * @param state LC3State object.
+  * @param program An expression successfully compiled with lc3_compile_expression.
+  * @return Return value
+  * @throws LC3CalculateException if an error occurs (i.e. division by zero).
   */
-void lc3_init_eval();
+int LC3_API lc3_evaluate(const lc3_state& state, const lc3_expression& program);
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef LC3_JIT_HPP
+#define LC3_JIT_HPP
+
+#include "lc3/lc3.hpp"
+
+/** lc3_jit_supported
+  *
+  * Checks if native code can be generated on this platform (x86-64 unix).
+  * @return true if lc3_run_jit compiles blocks to native code, otherwise it acts like lc3_run.
+  */
+bool LC3_API lc3_jit_supported();
+/** lc3_run_jit
+  *
+  * Runs for X instructions or until the lc3 is halted like lc3_run, but translated blocks are compiled
+  * to native code when lc3_can_run_fast is true. Memory accesses still go through lc3_mem_read / lc3_mem_write
+  * and JSR, TRAP, RTI and plugin instructions are executed by lc3_step, so the results are identical to lc3_run.
+  * @param state LC3State object.
+  * @param num Number of instructions to execute.
+  */
+void LC3_API lc3_run_jit(lc3_state& state, unsigned int num = -1);
+/** lc3_jit_reset
+  *
+  * Releases all native code compiled for a state.
+  * @param state LC3State object.
+  */
+void LC3_API lc3_jit_reset(lc3_state& state);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <exception>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "lc3/lc3.hpp"
@@ -47,8 +48,12 @@
 
 /* Removes leading and trailing whitespace*/
 void LC3_API trim(std::string& line);
+/* Removes leading and trailing whitespace from a view*/
+std::string_view LC3_API trim_view(std::string_view line);
 /* Removes comments from a string*/
 void LC3_API remove_comments(std::string& line, std::string& comment);
+/* Splits a line into code and comment like remove_comments without copying*/
+std::string_view LC3_API split_comment(std::string_view line, std::string_view& comment);
 /** process_str
   *
   * Unescapes and removes quotes from string
@@ -79,6 +84,8 @@ void LC3_API get_number(std::string&, int&, bool&);
 int16_t LC3_API check_value(int64_t, int, bool, bool, const LC3AssembleContext&);
 /* Tokenizes a string */
 void LC3_API tokenize(const std::string& str, std::vector<std::string>& tokens, const std::string& delimiters = " ");
+/* Tokenizes a string into views of it */
+void LC3_API tokenize(std::string_view str, std::vector<std::string_view>& tokens, std::string_view delimiters = " ");
 /* Checks if token is a register or immediate value */
 bool LC3_API is_register_or_imm(const std::string& token);
 /* Checks if token is a hexadecimal literal */
@@ -17,9 +17,21 @@ enum LC3_API PluginTypes
     PLUGIN_TYPES_SIZE
 };
 
-/** Define version of lc3 any plugins that are not of the same version will be rejected. */
-#define LC3_MAJOR_VERSION 1
-#define LC3_MINOR_VERSION 6
+/** Hooks a plugin can ask to have called, @see Plugin::ScheduleEvery. */
+enum LC3_API PluginHooks
+{
+    PLUGIN_HOOK_NONE = 0,
+    PLUGIN_HOOK_TICK = 1,
+    PLUGIN_HOOK_TOCK = 2,
+    PLUGIN_HOOK_ALL = PLUGIN_HOOK_TICK | PLUGIN_HOOK_TOCK,
+};
+
+/** Define version of lc3 any plugins that are not of the same version will be rejected.
+  * The major version changes whenever the layout of Plugin or anything else shared with plugins changes.
+  * 2.0 changed how Plugin schedules OnTick/OnTock and made LC3AssembleContext::tokens string_views.
+  */
+#define LC3_MAJOR_VERSION 2
+#define LC3_MINOR_VERSION 0
 
 /** Main class for complx's plugin system.
   *
@@ -64,6 +76,10 @@ public:
     const std::set<unsigned char>& GetBoundInterrupts() const {return interrupts;}
     /** Able to run in lc3_test */
     virtual bool AvailableInLC3Test() const {return true;}
+    /** Get the hooks (PluginHooks) the plugin wants called */
+    unsigned int GetScheduledHooks() const {return hooks;}
+    /** Get the generation of the plugin's schedule, bumped every time it is rescheduled */
+    uint32_t GetScheduleGeneration() const {return generation;}
 
     /** OnRead
       *
@@ -110,6 +126,14 @@ public:
       * Commits the bound addresses and interrupts.
       */
     void Commit() {locked = true;}
+    /** NextRun
+      *
+      * Users should not call this function directly.
+      * Gets the execution count the plugin next needs its hooks called at.
+      * @param executions Execution count of the next instruction to run.
+      * @return Execution count to run at, UINT64_MAX if never.
+      */
+    uint64_t NextRun(uint64_t executions);
 
 protected:
     /** BindAddresses
@@ -137,6 +161,29 @@ protected:
       * @param int_vector Interrupt vector to subscribe to.
       */
     void BindInterrupt(unsigned char int_vector);
+    /** ScheduleEvery
+      *
+      * Have hooks called once every instructions instructions, by default plugins run every instruction.
+      * Calling this from OnTick/OnTock takes effect after the current instruction,
+      * otherwise call lc3_schedule_plugin to apply it.
+      * @param instructions Number of instructions between calls.
+      * @param hooks Bitmask of PluginHooks to call.
+      */
+    void ScheduleEvery(uint64_t instructions, unsigned int hooks = PLUGIN_HOOK_ALL);
+    /** ScheduleAt
+      *
+      * Have hooks called once when the execution count reaches executions.
+      * @see ScheduleEvery for when this takes effect.
+      * @param executions Execution count to run at.
+      * @param hooks Bitmask of PluginHooks to call.
+      */
+    void ScheduleAt(uint64_t executions, unsigned int hooks = PLUGIN_HOOK_ALL);
+    /** ScheduleNever
+      *
+      * Stop calling OnTick/OnTock, for plugins that only respond to reads, writes or execution.
+      * @see ScheduleEvery for when this takes effect.
+      */
+    void ScheduleNever();
 
 private:
     unsigned int major;
@@ -146,6 +193,10 @@ private:
     bool locked = false;
     std::set<uint16_t> addresses;
     std::set<unsigned char> interrupts;
+    unsigned int hooks = PLUGIN_HOOK_ALL;
+    uint64_t interval = 1;      // 0 to run once at deadline.
+    uint64_t deadline = 0;
+    uint32_t generation = 0;
 };
 
 /** Represents a trap subroutine bound to a specific trap vector.
@@ -287,5 +338,26 @@ void LC3_API lc3_install_plugin(lc3_state& state, const std::string& filename, c
   * @param filename Filename of the plugin minus the lib prefix and .so/.dll extension.
   */
 bool LC3_API lc3_uninstall_plugin(lc3_state& state, const std::string& filename);
+/** lc3_index_address_plugins
+  *
+  * Rebuilds the device plugin table and page bitmap from address_plugins.
+  * Must be called whenever address_plugins is modified.
+  * @param state LC3State object.
+  */
+void LC3_API lc3_index_address_plugins(lc3_state& state);
+/** lc3_schedule_plugins
+  *
+  * Rebuilds the plugin schedule from every installed plugin.
+  * Must be called whenever plugins are installed or removed.
+  * @param state LC3State object.
+  */
+void LC3_API lc3_schedule_plugins(lc3_state& state);
+/** lc3_schedule_plugin
+  *
+  * Applies a plugin's schedule after it called ScheduleEvery/ScheduleAt/ScheduleNever outside of OnTick/OnTock.
+  * @param state LC3State object.
+  * @param plugin Installed plugin.
+  */
+void LC3_API lc3_schedule_plugin(lc3_state& state, Plugin* plugin);
 
 #endif
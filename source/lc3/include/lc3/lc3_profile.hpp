@@ -0,0 +1,46 @@
+#ifndef LC3_PROFILE_HPP
+#define LC3_PROFILE_HPP
+
+#include "lc3/lc3.hpp"
+
+/** Accesses to an address range [start, end] */
+struct LC3_API lc3_memory_range
+{
+    uint16_t start = 0;
+    uint16_t end = 0;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+};
+
+/** lc3_set_memory_profiling
+  *
+  * Enables or disables counting memory reads and writes per address.
+  * Counters are allocated when profiling is first enabled and kept when it is disabled.
+  * @param state LC3State object.
+  * @param enable If true count every lc3_mem_read / lc3_mem_write.
+  */
+void LC3_API lc3_set_memory_profiling(lc3_state& state, bool enable);
+/** lc3_reset_memory_profile
+  *
+  * Zeroes all memory access counters.
+  * @param state LC3State object.
+  */
+void LC3_API lc3_reset_memory_profile(lc3_state& state);
+/** lc3_memory_heatmap
+  *
+  * Sums the memory access counters over fixed size address ranges.
+  * @param state LC3State object.
+  * @param range_size Number of addresses in each range.
+  * @return the ranges that were accessed at least once in address order.
+  */
+std::vector<lc3_memory_range> LC3_API lc3_memory_heatmap(const lc3_state& state, uint32_t range_size = 256);
+/** lc3_memory_hotspots
+  *
+  * Finds the most accessed addresses.
+  * @param state LC3State object.
+  * @param count Maximum number of addresses to return.
+  * @return single address ranges ordered by total accesses (reads + writes) from most to least, ties in address order.
+  */
+std::vector<lc3_memory_range> LC3_API lc3_memory_hotspots(const lc3_state& state, size_t count = 10);
+
+#endif
@@ -6,10 +6,30 @@
 /** lc3_run
   *
   * Runs for X instructions or until the lc3 is halted.
+  * Uses lc3_run_fast whenever lc3_can_run_fast is true, headless runners need to call lc3_set_undo(state, false) for that
+  * since lc3_init turns undo history on.
   * @param state LC3State object.
   * @param num Number of instructions to execute.
   */
 void LC3_API lc3_run(lc3_state& state, unsigned int num = -1);
+/** lc3_run_fast
+  *
+  * Runs for X instructions or until the lc3 is halted by executing translated basic blocks and skipping all per step bookkeeping.
+  * Only valid to call when lc3_can_run_fast is true, returns early as soon as that is no longer the case.
+  * lc3_run will automatically use this when possible.
+  * @param state LC3State object.
+  * @param num Number of instructions to execute.
+  * @return the number of instructions executed.
+  */
+unsigned int LC3_API lc3_run_fast(lc3_state& state, unsigned int num = -1);
+/** lc3_can_run_fast
+  *
+  * Checks if nothing needs to observe individual steps, that is no breakpoints, watchpoints,
+  * plugins, trace streams, undo stack or interrupts are active, @see lc3_set_undo.
+  * @param state LC3State object.
+  * @return true if lc3_run_fast can be used.
+  */
+bool LC3_API lc3_can_run_fast(const lc3_state& state);
 /** lc3_step
   *
   * Executes one instruction.
@@ -65,8 +85,8 @@ bool lc3_interrupt(lc3_state& state);
 void LC3_API lc3_keyboard_interrupt(lc3_state& state);
 /** lc3_signal_interrupt
   *
-  * Adds an interrupt to be handled to the pending queue.
-  * Will stack if called multiple times with the same priority and interrupt vector.
+  * Marks an interrupt as pending.
+  * Does nothing if the same priority and interrupt vector is already pending.
   * @param state LC3State object.
   * @param priority Priority of the interrupt.
   * @param vector Interrupt vector to be accessed when interrupt occurs.
@@ -74,7 +94,7 @@ void LC3_API lc3_keyboard_interrupt(lc3_state& state);
 void LC3_API lc3_signal_interrupt(lc3_state& state, int priority, int vector);
 /** lc3_signal_interrupt_once
   *
-  * Adds an interrupt to be handled to the pending queue ONLY if it doesn't already exist.
+  * Marks an interrupt as pending ONLY if it isn't already.
   * @param state LC3State object.
   * @param priority Priority of the interrupt.
   * @param vector Interrupt vector to be accessed when interrupt occurs.
@@ -0,0 +1,125 @@
+#ifndef LC3_TRACE_HPP
+#define LC3_TRACE_HPP
+
+#include <array>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "lc3/lc3.hpp"
+
+// Raw bytes of records buffered before a block is written out.
+#define LC3_TRACE_BLOCK_SIZE (1 << 20)
+
+/** One executed instruction decoded from a binary trace. */
+struct LC3_API lc3_trace_step
+{
+    uint32_t executions = 0;                // Execution count before the instruction ran.
+    uint16_t pc = 0;
+    uint16_t instruction = 0;
+    std::array<int16_t, 8> regs{};          // Registers before the instruction ran.
+    bool n = false;
+    bool z = true;
+    bool p = false;
+    bool privilege = true;
+    std::vector<lc3_change_info> changes;   // Registers and memory written by the instruction with their new values.
+};
+
+/** Binary execution trace sink, @see lc3_state::binary_trace.
+  *
+  * Writes one fixed width record per instruction holding the pc, instruction, condition codes
+  * and what the instruction changed, instead of formatting the full state like lc3_trace.
+  * Records are buffered into large blocks which are optionally compressed before being written.
+  * Use lc3_trace_reader or the lc3trace tool to decode it.
+  */
+class LC3_API lc3_trace_writer
+{
+public:
+    /** Traces to out, compressing each block if compress is set. The stream must outlive the writer. */
+    explicit lc3_trace_writer(std::ostream& out, bool compress = true) : stream(out), compress(compress) {}
+    ~lc3_trace_writer();
+    lc3_trace_writer(const lc3_trace_writer&) = delete;
+    lc3_trace_writer& operator=(const lc3_trace_writer&) = delete;
+
+    /** Called by lc3_step before the instruction at pc is executed. */
+    void begin_step(const lc3_state& state);
+    /** Called by lc3_step after the instruction was executed. */
+    void end_step(const lc3_state& state, const lc3_state_change& change);
+    /** Writes out any buffered records. */
+    void flush();
+
+private:
+    void write_header(const lc3_state& state);
+    void add_record(uint8_t type, const lc3_state& state, uint16_t pc, uint16_t instruction, int reg, bool has_memory, uint16_t address);
+
+    std::ostream& stream;
+    bool compress;
+    bool started = false;
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> packed;
+    std::vector<uint16_t> written;
+    // What a reader knows about the state after the records written so far.
+    int16_t regs[8] = {0};
+    uint8_t flags = 0;
+    uint32_t executions = 0;
+    uint16_t step_pc = 0;
+    uint16_t step_instruction = 0;
+};
+
+/** Decodes a trace written by lc3_trace_writer. */
+class LC3_API lc3_trace_reader
+{
+public:
+    /** Reads the header from in, check error() before continuing. */
+    explicit lc3_trace_reader(std::istream& in);
+
+    /** Decodes the next executed instruction.
+      * @return false at the end of the trace or if it is malformed, @see error.
+      */
+    bool next(lc3_trace_step& step);
+    /** Description of why the trace is malformed, empty if it is not. */
+    const std::string& error() const { return failure; }
+    /** LC-3 version the traced program ran under, for lc3_disassemble. */
+    int32_t version() const { return lc3_version; }
+
+private:
+    bool read_record(const uint8_t*& record);
+    bool fill();
+
+    std::istream& stream;
+    std::string failure;
+    int32_t lc3_version = 0;
+    std::vector<uint8_t> block;
+    std::vector<uint8_t> packed;
+    size_t position = 0;
+    lc3_trace_step view;
+};
+
+/** lc3_write_trace_text
+  *
+  * Writes a traced instruction in the format used by lc3_trace.
+  * @param state LC3State object, only used for its symbols when disassembling.
+  * @param stream Stream to write to.
+  * @param pc Address of the instruction.
+  * @param instruction Instruction about to be executed.
+  * @param regs Registers before the instruction ran.
+  * @param n, z Condition codes before the instruction ran.
+  */
+void LC3_API lc3_write_trace_text(lc3_state& state, std::ostream& stream, uint16_t pc, uint16_t instruction, const int16_t* regs, bool n, bool z);
+/** lc3_write_trace_csv_header
+  *
+  * Writes the column names for lc3_write_trace_csv.
+  * @param stream Stream to write to.
+  */
+void LC3_API lc3_write_trace_csv_header(std::ostream& stream);
+/** lc3_write_trace_csv
+  *
+  * Writes a traced instruction as a line of comma separated values.
+  * @param state LC3State object, only used for its symbols when disassembling.
+  * @param stream Stream to write to.
+  * @param step Decoded instruction.
+  */
+void LC3_API lc3_write_trace_csv(lc3_state& state, std::ostream& stream, const lc3_trace_step& step);
+
+#endif
@@ -1,5 +1,6 @@
 #include "lc3/ExpressionEvaluator.hpp"
 
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -55,26 +56,26 @@
 namespace ExpressionEvaluator
 {
 using std::string;
-const char *operator_mul   = "*";
-const char *operator_div   = "/";
-const char *operator_mod   = "%";
-const char *operator_add   = "+";
-const char *operator_sub   = "-";
-const char *operator_xor   = "^";
-const char *operator_band  = "&";
-const char *operator_bor   = "|";
-const char *operator_land  = "&&";
-const char *operator_lor   = "||";
-const char *operator_nor   = "!|";
-const char *operator_nand  = "!&";
-const char *operator_iseq  = "==";
-const char *operator_ne    = "!=";
-const char *operator_shl   = "<<";
-const char *operator_shr   = ">>";
-const char *operator_lt    = "<";
-const char *operator_gt    = ">";
-const char *operator_gte   = ">=";
-const char *operator_lte   = "<=";
+const char* const operator_mul   = "*";
+const char* const operator_div   = "/";
+const char* const operator_mod   = "%";
+const char* const operator_add   = "+";
+const char* const operator_sub   = "-";
+const char* const operator_xor   = "^";
+const char* const operator_band  = "&";
+const char* const operator_bor   = "|";
+const char* const operator_land  = "&&";
+const char* const operator_lor   = "||";
+const char* const operator_nor   = "!|";
+const char* const operator_nand  = "!&";
+const char* const operator_iseq  = "==";
+const char* const operator_ne    = "!=";
+const char* const operator_shl   = "<<";
+const char* const operator_shr   = ">>";
+const char* const operator_lt    = "<";
+const char* const operator_gt    = ">";
+const char* const operator_gte   = ">=";
+const char* const operator_lte   = "<=";
 
 struct operator_t
 {
@@ -82,6 +83,14 @@ struct operator_t
     int  precedence;
 };
 
+// Index of each operator in operators.
+enum operator_index
+{
+    op_mul = 1, op_div, op_mod, op_shl, op_shr, op_sub, op_add,
+    op_xor, op_band, op_bor, op_nor, op_land, op_lor, op_nand,
+    op_iseq, op_lt, op_gt, op_gte, op_ne, op_lte
+};
+
 const operator_t operators[] =
 {
     {"<>=*/%+-^&|\\", -1}, // Operators[0] is reserved for storing all symbols that can be used in operators
@@ -95,12 +104,10 @@ const operator_t operators[] =
     {operator_iseq, 13}, {operator_lt, 13}, {operator_gt, 13},
     {operator_gte, 13}, {operator_ne, 13}, {operator_lte, 13}
 };
+static_assert(sizeof(operators) / sizeof(operators[0]) == op_lte + 1, "operator_index must match operators");
 
 
-std::unordered_map<std::string, eval_type> symbol_table;
-int (*OnUndefinedSymbol)(const string& symbol, bool hasref, int ref, int& error) = nullptr;
-
-int EvaluateOperand(const string&, int&);
+int EvaluateOperand(const string&, int&, const SymbolResolver&);
 
 // Returns < 0 if 'op' is not an operator
 // Otherwise it returns the index of the operator in the 'operators' array
@@ -279,7 +286,7 @@ int toRPN(std::string_view exp, string& rpn)
 }
 
 //template <typename T> int evaluateRPN(string rpn, T &result)
-int evaluateRPN(const string& rpn, int& result)
+int evaluateRPN(const string& rpn, int& result, const SymbolResolver& resolver)
 {
     std::stack<int> st;
     string token;
@@ -301,7 +308,7 @@ int evaluateRPN(const string& rpn, int& result)
             token    = rpn.substr(i, tokenLen);
 
             int error;
-            int val = EvaluateOperand(token, error);
+            int val = EvaluateOperand(token, error, resolver);
             r = val;
 
             if (error) return error;
@@ -324,50 +331,11 @@ int evaluateRPN(const string& rpn, int& result)
             else
                 return eval_unbalanced;
 
-            tokenLen = strlen(operators[idx].op);
-            token    = rpn.substr(i, tokenLen);
-            i += tokenLen - 1;
+            i += OperatorLength(idx) - 1;
+
+            int error = ApplyOperator(idx, op1, op2, r);
+            if (error) return error;
 
-            if (token == operator_mul)
-                r = op1 * op2;
-            else if (token == operator_div)
-                r = op1 / op2;
-            else if (token == operator_mod)
-                r = op1 % op2;
-            else if (token == operator_add)
-                r = op1 + op2;
-            else if (token == operator_sub)
-                r = op1 - op2;
-            else if (token == operator_land)
-                r = op1 && op2;
-            else if (token == operator_band)
-                r = op1 & op2;
-            else if (token == operator_lor)
-                r = op1 || op2;
-            else if (token == operator_bor)
-                r = op1 | op2;
-            else if (token == operator_xor)
-                r = op1 ^ op2;
-            else if (token == operator_nor)
-                r = ~(op1 | op2);
-            else if (token == operator_nand)
-                r = ~(op1 & op2);
-            else if (token == operator_iseq)
-                r = op1 == op2;
-            else if (token == operator_ne)
-                r = op1 != op2;
-            else if (token == operator_shl)
-                r = op1 << op2;
-            else if (token == operator_shr)
-                r = op1 >> op2;
-            else if (token == operator_lt)
-                r = op1 < op2;
-            else if (token == operator_lte)
-                r = op1 <= op2;
-            else if (token == operator_gt)
-                r = op1 > op2;
-            else if (token == operator_gte)
-                r = op1 >= op2;
             // push result
             st.push(r);
         }
@@ -379,7 +347,87 @@ int evaluateRPN(const string& rpn, int& result)
     return eval_ok;
 }
 
-int Calculate(std::string_view expr, int &r)
+size_t OperatorLength(int op)
+{
+    return strlen(operators[op].op);
+}
+
+int ApplyOperator(int op, int op1, int op2, int& r)
+{
+    // Arithmetic wraps around instead of overflowing.
+    const unsigned int u1 = static_cast<unsigned int>(op1);
+    const unsigned int u2 = static_cast<unsigned int>(op2);
+
+    switch (op)
+    {
+        case op_mul:
+            r = static_cast<int>(u1 * u2);
+            break;
+        case op_div:
+        case op_mod:
+            // INT_MIN / -1 doesn't fit in an int.
+            if (op2 == 0 || (op1 == INT_MIN && op2 == -1))
+                return eval_evalerr;
+            r = op == op_div ? op1 / op2 : op1 % op2;
+            break;
+        case op_add:
+            r = static_cast<int>(u1 + u2);
+            break;
+        case op_sub:
+            r = static_cast<int>(u1 - u2);
+            break;
+        case op_land:
+            r = op1 && op2;
+            break;
+        case op_band:
+            r = op1 & op2;
+            break;
+        case op_lor:
+            r = op1 || op2;
+            break;
+        case op_bor:
+            r = op1 | op2;
+            break;
+        case op_xor:
+            r = op1 ^ op2;
+            break;
+        case op_nor:
+            r = ~(op1 | op2);
+            break;
+        case op_nand:
+            r = ~(op1 & op2);
+            break;
+        case op_iseq:
+            r = op1 == op2;
+            break;
+        case op_ne:
+            r = op1 != op2;
+            break;
+        case op_shl:
+        case op_shr:
+            if (op2 < 0 || op2 >= 32)
+                return eval_evalerr;
+            r = op == op_shl ? static_cast<int>(u1 << op2) : op1 >> op2;
+            break;
+        case op_lt:
+            r = op1 < op2;
+            break;
+        case op_lte:
+            r = op1 <= op2;
+            break;
+        case op_gt:
+            r = op1 > op2;
+            break;
+        case op_gte:
+            r = op1 >= op2;
+            break;
+        default:
+            return eval_invalidoperator;
+    }
+    return eval_ok;
+}
+
+int Calculate(std::string_view expr, int &r, const SymbolResolver& resolver)
 {
     string rpn;
     int err = eval_evalerr; // unexpected error
@@ -394,7 +442,7 @@ int Calculate(std::string_view expr, int &r)
     {
         if ( (err = toRPN(expr, rpn)) != eval_ok)
             return err;
-        err = evaluateRPN(rpn, r);
+        err = evaluateRPN(rpn, r, resolver);
     }
     catch(...)
     {
@@ -402,41 +450,7 @@ int Calculate(std::string_view expr, int &r)
     return err;
 }
 
-int SymbolTableLookup(const string& symbol, bool hasref, int ref, int& error)
-{
-    if (symbol_table.find(symbol) == symbol_table.end())
-    {
-        error = eval_undefinedsymbol;
-        // Last hope~ if they defined the undefined symbol function
-        if (OnUndefinedSymbol)
-        {
-            int value = OnUndefinedSymbol(symbol, hasref, ref, error);
-            return value;
-        }
-        else
-        {
-            return -1;
-        }
-    }
-
-    eval_type value = symbol_table[symbol];
-
-    switch (value.type)
-    {
-    case EVAL_VALUE:
-        return value.eval.value;
-        break;
-    case EVAL_FUNCTION:
-        return value.eval.func(hasref, ref);
-        break;
-    default:
-        error = eval_evalerr;
-    }
-
-    return -1;
-}
-
-int EvaluateOperand(const string& token, int& error)
+int EvaluateOperand(const string& token, int& error, const SymbolResolver& resolver)
 {
     error = 0;
 
@@ -484,11 +498,16 @@ int EvaluateOperand(const string& token, int& error)
     bool has_ref = begin != end && begin != std::string::npos;
     if (has_ref)
     {
-        error = Calculate(token.substr(begin + 1, end - begin - 1), ref);
+        error = Calculate(token.substr(begin + 1, end - begin - 1), ref, resolver);
         if (error) return -1;
     }
 
-    return SymbolTableLookup(token.substr(0, begin), has_ref, ref, error);
+    if (!resolver)
+    {
+        error = eval_undefinedsymbol;
+        return -1;
+    }
+    return resolver(token.substr(0, begin), has_ref, ref, error);
 }
 }
 
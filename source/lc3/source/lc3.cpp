@@ -1,5 +1,6 @@
 #include "lc3/lc3.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
@@ -9,11 +10,13 @@
 #include <istream>
 #include <sstream>
 
+#include "lc3/lc3_event.hpp"
 #include "lc3/lc3_execute.hpp"
 #include "lc3/lc3_expressions.hpp"
 #include "lc3/lc3_os.hpp"
 #include "lc3/lc3_plugin.hpp"
 #include "lc3/lc3_symbol.hpp"
+#include "lc3/lc3_trace.hpp"
 
 void lc3_init(lc3_state& state, bool randomize_registers, bool randomize_memory, int16_t register_fill_value, int16_t memory_fill_value)
 {
@@ -57,8 +60,9 @@ void lc3_init(lc3_state& state, bool randomize_registers, bool randomize_memory,
     state.max_call_stack_size = -1;
     state.call_stack.clear();
 
-    state.warn_stats.clear();
-    state.warn_limits.clear();
+    state.warn_stats.fill(0);
+    state.warn_limits.fill(LC3_NO_WARNING_LIMIT);
+    state.warning_log_count = 0;
     state.warn_limits[LC3_INVALID_CHARACTER_WRITE] = 100;
     state.warn_limits[LC3_RESERVED_MEM_WRITE] = 100;
     state.warn_limits[LC3_RESERVED_MEM_READ] = 100;
@@ -70,6 +74,15 @@ void lc3_init(lc3_state& state, bool randomize_registers, bool randomize_memory,
     // Set Stack Flags
     state.max_stack_size = -1;
     state.undo_stack.clear();
+    state.undo_stack.set_budget(DEFAULT_UNDO_BUDGET);
+
+    state.checkpoints.clear();
+    state.checkpoint_interval = 0;
+    state.checkpoint_dirty_pages = 0;
+    state.max_checkpoints = 0;
+    state.next_checkpoint = 0;
+    state.dirty_pages.fill(0);
+    state.dirty_page_count = 0;
 
     // Set I/O Stuff
     state.input = &std::cin;
@@ -77,6 +90,9 @@ void lc3_init(lc3_state& state, bool randomize_registers, bool randomize_memory,
     state.peek = lc3_peek_char;
     state.output = &std::cout;
     state.writer = lc3_do_write_char;
+    state.output_flush = LC3_FLUSH_ALWAYS;
+    state.output_flush_size = DEFAULT_OUTPUT_FLUSH_SIZE;
+    state.output_pending = 0;
     state.warning = &std::cout;
 
     // Clear memory
@@ -94,17 +110,24 @@ void lc3_init(lc3_state& state, bool randomize_registers, bool randomize_memory,
     // Clear Symbol Table
     state.symbols.clear();
     state.rev_symbols.clear();
+    state.symbol_generation++;
 
     // Clear Breakpoints and all that jazz
     state.breakpoints.clear();
     state.comments.clear();
     state.reg_watchpoints.clear();
     state.mem_watchpoints.clear();
+    state.breakpoint_bits.fill(0);
+    state.mem_watchpoint_bits.fill(0);
+    state.reg_watchpoint_bits = 0;
     state.subroutines.clear();
 
     // Clear pending interrupts
     state.interrupts.clear();
     state.interrupt_test.clear();
+    for (auto& functions : state.event_table)
+        functions.clear();
+    state.event_subscriptions = 0;
     state.interrupt_vector = -1;
     state.savedssp = 0x3000;
     state.savedusp = 0xF000;
@@ -112,15 +135,116 @@ void lc3_init(lc3_state& state, bool randomize_registers, bool randomize_memory,
     state.keyboard_int_counter = 0;
     state.keyboard_int_delay = DEFAULT_KEYBOARD_INTERRUPT_DELAY;
 
+    state.memory_profiling = false;
     state.memory_ops.clear();
     state.total_reads = 0;
     state.total_writes = 0;
 
     state.trace = nullptr;
+    state.binary_trace = nullptr;
 
     state.in_lc3test = false;
 }
 
+void lc3_clone(lc3_state& clone, const lc3_state& state, bool keep_plugins)
+{
+    if (&clone == &state)
+        return;
+
+    std::copy(state.regs, state.regs + 8, clone.regs);
+    clone.pc = state.pc;
+    clone.privilege = state.privilege;
+    clone.priority = state.priority;
+    clone.n = state.n;
+    clone.z = state.z;
+    clone.p = state.p;
+    clone.halted = state.halted;
+    clone.true_traps = state.true_traps;
+    clone.interrupt_enabled = state.interrupt_enabled;
+    clone.strict_execution = state.strict_execution;
+    clone.lc3_version = state.lc3_version;
+    clone.warnings = state.warnings;
+    clone.executions = state.executions;
+
+    // The decode, block and jit caches are checked against memory so the clone's own stay valid.
+    std::copy(state.mem, state.mem + 65536, clone.mem);
+    clone.symbols = state.symbols;
+    clone.rev_symbols = state.rev_symbols;
+    clone.symbol_generation = state.symbol_generation;
+    clone.comments = state.comments;
+    clone.subroutines = state.subroutines;
+
+    clone.input = state.input;
+    clone.reader = state.reader;
+    clone.peek = state.peek;
+    clone.output = state.output;
+    clone.writer = state.writer;
+    clone.output_flush = state.output_flush;
+    clone.output_flush_size = state.output_flush_size;
+    clone.output_pending = 0;
+    clone.debug = state.debug;
+    clone.warning = state.warning;
+
+    // Plugins are owned by the state that installed them.
+    if (!keep_plugins)
+        lc3_remove_plugins(clone);
+
+    clone.max_stack_size = state.max_stack_size;
+    clone.undo_stack.clear();
+    clone.undo_stack.set_budget(state.undo_stack.budget());
+    clone.checkpoints.clear();
+    clone.checkpoint_interval = 0;
+    clone.checkpoint_dirty_pages = 0;
+    clone.max_checkpoints = 0;
+    clone.next_checkpoint = 0;
+    clone.dirty_pages.fill(0);
+    clone.dirty_page_count = 0;
+
+    clone.max_call_stack_size = state.max_call_stack_size;
+    clone.call_stack = state.call_stack;
+    clone.rti_stack = state.rti_stack;
+    clone.first_level_calls = state.first_level_calls;
+    clone.first_level_traps = state.first_level_traps;
+    for (auto& functions : clone.event_table)
+        functions.clear();
+    clone.event_subscriptions = 0;
+
+    clone.rng = state.rng;
+    clone.dist = state.dist;
+    clone.default_seed = state.default_seed;
+
+    clone.warn_stats = state.warn_stats;
+    clone.warn_limits = state.warn_limits;
+    clone.warning_log = state.warning_log;
+    clone.warning_log_count = state.warning_log_count;
+
+    clone.interrupts = state.interrupts;
+    clone.interrupt_test = state.interrupt_test;
+    clone.interrupt_vector = state.interrupt_vector;
+    clone.interrupt_vector_stack = state.interrupt_vector_stack;
+    clone.savedusp = state.savedusp;
+    clone.savedssp = state.savedssp;
+    clone.keyboard_int_delay = state.keyboard_int_delay;
+    clone.keyboard_int_counter = state.keyboard_int_counter;
+
+    clone.breakpoints = state.breakpoints;
+    clone.mem_watchpoints = state.mem_watchpoints;
+    clone.reg_watchpoints = state.reg_watchpoints;
+    clone.breakpoint_bits = state.breakpoint_bits;
+    clone.mem_watchpoint_bits = state.mem_watchpoint_bits;
+    clone.reg_watchpoint_bits = state.reg_watchpoint_bits;
+
+    clone.memory_profiling = false;
+    clone.memory_ops.clear();
+    clone.total_reads = 0;
+    clone.total_writes = 0;
+
+    clone.trace = nullptr;
+    clone.binary_trace = nullptr;
+
+    clone.in_lc3test = state.in_lc3test;
+}
+
 void lc3_set_version(lc3_state& state, int version)
 {
     if (version >= 0 && version <= 1)
@@ -134,10 +258,19 @@ void lc3_set_version(lc3_state& state, int version)
     }
 }
 
+void lc3_set_undo(lc3_state& state, bool enabled)
+{
+    state.max_stack_size = enabled ? static_cast<uint32_t>(-1) : 0;
+    if (!enabled)
+        state.undo_stack.clear();
+}
+
 void lc3_remove_plugins(lc3_state& state)
 {
     state.instructionPlugin = nullptr;
     state.plugins.clear();
+    state.plugin_schedule.clear();
+    state.plugins_due.clear();
     state.address_plugins.clear();
     state.trapPlugins.clear();
     state.interruptPlugin.clear();
@@ -167,6 +300,8 @@ void lc3_remove_plugins(lc3_state& state)
 
     if (state.lc3_version >= 1)
         state.address_plugins[DEV_PSR] = nullptr;
+
+    lc3_index_address_plugins(state);
 }
 
 const char* BASIC_DISASSEMBLE_LOOKUP[16][2] =
@@ -845,6 +980,7 @@ int32_t lc3_write_char(lc3_state& state, std::ostream& file, int32_t chr)
 {
     if (chr > 255 || !(isgraph(chr) || isspace(chr) || chr == '\b'))
         lc3_warning(state, LC3_INVALID_CHARACTER_WRITE, chr);
+    lc3_emit<lc3_event_id::OUTPUT>(state, static_cast<char>(chr));
     return state.writer(state, file, chr);
 }
 
@@ -865,6 +1001,89 @@ int32_t lc3_write_str(lc3_state& state, const std::function<int32_t(lc3_state&,
     return 0;
 }
 
+// Writes characters without checking them.
+static int32_t lc3_write_valid_chars(lc3_state& state, std::ostream& file, const int32_t* chars, size_t count)
+{
+    using write_function = int32_t(*)(lc3_state&, std::ostream&, int32_t);
+    const write_function* writer = state.writer.target<write_function>();
+    if (writer == nullptr || *writer != lc3_do_write_char)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (state.writer(state, file, chars[i]))
+                return -1;
+        }
+        return 0;
+    }
+
+    if (!file.good()) return -1;
+    char buffer[256];
+    for (size_t i = 0; i < count; i += sizeof(buffer))
+    {
+        const size_t length = std::min(count - i, sizeof(buffer));
+        for (size_t j = 0; j < length; j++)
+            buffer[j] = static_cast<char>(chars[i + j]);
+        file.write(buffer, static_cast<std::streamsize>(length));
+    }
+    return (!file.good()) ? -1 : 0;
+}
+
+int32_t lc3_write_chars(lc3_state& state, std::ostream& file, const int32_t* chars, size_t count)
+{
+    // Warnings go out just before the character they are for, same as with lc3_write_char.
+    size_t start = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const int32_t chr = chars[i];
+        if (chr > 255 || !(isgraph(chr) || isspace(chr) || chr == '\b'))
+        {
+            if (lc3_write_valid_chars(state, file, chars + start, i - start))
+                return -1;
+            start = i;
+            lc3_warning(state, LC3_INVALID_CHARACTER_WRITE, chr);
+        }
+    }
+    return lc3_write_valid_chars(state, file, chars + start, count - start);
+}
+
+void lc3_set_output_flush(lc3_state& state, lc3_flush_policy policy, uint32_t size)
+{
+    lc3_flush_output(state);
+    state.output_flush = policy;
+    state.output_flush_size = size;
+}
+
+void lc3_output_written(lc3_state& state, uint32_t count, bool newline)
+{
+    state.output_pending += count;
+    bool flush;
+    switch(state.output_flush)
+    {
+        case LC3_FLUSH_NEWLINE:
+            flush = newline;
+            break;
+        case LC3_FLUSH_SIZE:
+            flush = state.output_pending >= state.output_flush_size;
+            break;
+        case LC3_FLUSH_INPUT:
+            flush = false;
+            break;
+        default:
+            flush = true;
+            break;
+    }
+    if (!flush) return;
+    state.output->flush();
+    state.output_pending = 0;
+}
+
+void lc3_flush_output(lc3_state& state)
+{
+    if (state.output_pending == 0) return;
+    state.output->flush();
+    state.output_pending = 0;
+}
+
 void lc3_randomize(lc3_state& state)
 {
     for (uint32_t i = 0; i <= 0xFFFF; i++)
@@ -876,33 +1095,5 @@ void lc3_randomize(lc3_state& state)
 
 void lc3_trace(lc3_state& state)
 {
-    char buf[128];
-    std::ostream& stream = *state.trace;
-
-    snprintf(buf, 128, "PC x%04x\n", state.pc);
-    stream << buf;
-
-    snprintf(buf, 128, "instr: %s", lc3_disassemble(state, state.mem[state.pc], state.pc, 1).c_str());
-    stream << buf;
-
-    snprintf(buf, 128, " (%04x)\n", static_cast<uint16_t>(state.mem[state.pc]));
-    stream << buf;
-
-    snprintf(buf, 128, "R0 %6d|x%04x\tR1 %6d|x%04x\tR2 %6d|x%04x\tR3 %6d|x%04x\n",
-             state.regs[0], static_cast<uint16_t>(state.regs[0]),
-             state.regs[1], static_cast<uint16_t>(state.regs[1]),
-             state.regs[2], static_cast<uint16_t>(state.regs[2]),
-             state.regs[3], static_cast<uint16_t>(state.regs[3]));
-    stream << buf;
-
-
-    snprintf(buf, 128, "R4 %6d|x%04x\tR5 %6d|x%04x\tR6 %6d|x%04x\tR7 %6d|x%04x\n",
-             state.regs[4], static_cast<uint16_t>(state.regs[4]),
-             state.regs[5], static_cast<uint16_t>(state.regs[5]),
-             state.regs[6], static_cast<uint16_t>(state.regs[6]),
-             state.regs[7], static_cast<uint16_t>(state.regs[7]));
-    stream << buf;
-
-    snprintf(buf, 128, "CC: %s\n\n", (state.n ? "N" : (state.z ? "Z" : "P")));
-    stream << buf;
+    lc3_write_trace_text(state, *state.trace, state.pc, static_cast<uint16_t>(state.mem[state.pc]), state.regs, state.n, state.z);
 }
@@ -6,10 +6,14 @@
 #include <cerrno>
 #include <cmath>
 #include <cstring>
+#include <exception>
 #include <iomanip>
 #include <iostream>
 #include <istream>
+#include <iterator>
+#include <list>
 #include <sstream>
+#include <thread>
 
 #ifdef __linux__
 #include <arpa/inet.h>
@@ -26,12 +30,51 @@
 #include "lc3/lc3_runner.hpp"
 #include "lc3/lc3_symbol.hpp"
 
-// For non line comments.
+// Files with fewer lines than this per thread are encoded on one thread.
+#define PARALLEL_ASSEMBLE_MIN_LINES 2048
+
+// For non line comments, its tokens are kept in the token arena shared by both passes.
 struct code_line
 {
-    code_line(const std::string& line_str, unsigned int loc) : line(line_str), location(loc) {}
-    std::string line;
+    code_line(std::string_view line_str, unsigned int loc, uint16_t addr, size_t first, size_t count) :
+        line(line_str), location(loc), address(addr), first_token(first), num_tokens(count) {}
+    std::string_view line;
     unsigned int location;
+    uint16_t address;   // Address the first pass had for the start of the line.
+    size_t first_token;
+    size_t num_tokens;
+};
+
+// A run of lines the second pass encodes on its own, @see assemble_code.
+struct code_chunk
+{
+    size_t begin = 0;
+    size_t end = 0;
+    uint16_t start = 0;     // Address the chunk starts at.
+    uint16_t address = 0;   // Address after the chunk.
+    std::vector<std::pair<uint16_t, int16_t>> writes;
+    std::list<LC3AssembleException> exceptions;
+    std::exception_ptr error;   // What stopped the chunk early if not collecting multiple errors.
+};
+
+// Tokens of a line, a window into the token arena.
+class token_span
+{
+public:
+    token_span(const std::vector<std::string_view>& arena, size_t first, size_t count) :
+        first_token(arena.data() + first), last_token(arena.data() + first + count) {}
+    const std::string_view& operator[](size_t index) const { return first_token[index]; }
+    const std::string_view* begin() const { return first_token; }
+    const std::string_view* end() const { return last_token; }
+    size_t size() const { return static_cast<size_t>(last_token - first_token); }
+    bool empty() const { return first_token == last_token; }
+    // Drops the first token.
+    void pop_front() { first_token++; }
+    // Brings back the last token dropped.
+    void unpop_front() { first_token--; }
+private:
+    const std::string_view* first_token;
+    const std::string_view* last_token;
 };
 
 // For comments with debugging information
@@ -44,7 +87,7 @@ struct debug_statement
     uint16_t address;
 };
 
-uint16_t lc3_assemble_one(lc3_state& state, LC3AssembleContext& context);
+uint16_t lc3_assemble_one(lc3_state& state, LC3AssembleContext& context, std::string_view text, const token_span& tokens);
 
 void process_debug_info(lc3_state& state, const debug_statement& statement, bool enable_debug_statements);
 void process_plugin_info(lc3_state& state, const LC3AssembleContext& context);
@@ -188,7 +231,9 @@ uint16_t lc3_assemble_one(lc3_state& state, uint16_t address, const std::string&
     context.address = address;
     context.options = options;
 
-    uint16_t ret = lc3_assemble_one(state, context);
+    std::vector<std::string_view> tokens;
+    tokenize(context.line, tokens, " \t,");
+    uint16_t ret = lc3_assemble_one(state, context, context.line, token_span(tokens, 0, tokens.size()));
 
     if (context.options.multiple_errors && !context.exceptions.empty())
         throw LC3AssembleException(context.exceptions);
@@ -196,20 +241,54 @@ uint16_t lc3_assemble_one(lc3_state& state, uint16_t address, const std::string&
     return ret;
 }
 
-uint16_t lc3_assemble_one(lc3_state& state, LC3AssembleContext& context)
+/** Adds an empty operand for each run of whitespace between two commas in gap, as splitting on commas would. */
+static void add_empty_operands(std::string_view gap, std::vector<std::string_view>& operands)
+{
+    size_t comma = gap.find(',');
+    while (comma != std::string_view::npos)
+    {
+        size_t next = gap.find(',', comma + 1);
+        if (next != std::string_view::npos && next > comma + 1)
+            operands.emplace_back();
+        comma = next;
+    }
+}
+
+/** Assembles one instruction.
+  * @param text The instruction without its symbols, context.line holds a copy of it.
+  * @param tokens The instruction split on whitespace and commas, views into text.
+  */
+uint16_t lc3_assemble_one(lc3_state& state, LC3AssembleContext& context, std::string_view text, const token_span& tokens)
 {
-    size_t pos = context.line.find_first_of(" \t");
-    std::string opcode = context.line.substr(0, pos);
-    trim(opcode);
-    std::string line = (pos == std::string::npos) ? "" : context.line.c_str() + pos + 1;
-    trim(line);
-    tokenize(context.line, context.tokens, " \t,");
-
-    std::vector<std::string> tokens;
-    tokenize(line, tokens, ",");
-    // Remove spaces
-    for (auto& token : tokens)
-        trim(token);
+    size_t pos = text.find_first_of(" \t");
+    std::string opcode(trim_view(text.substr(0, pos)));
+    std::string_view line = (pos == std::string::npos) ? text.substr(text.size()) : trim_view(text.substr(pos + 1));
+    context.tokens.assign(tokens.begin(), tokens.end());
+
+    // Operands are separated by commas, so tokens with only whitespace between them are one operand.
+    std::vector<std::string_view> operands;
+    const char* previous = nullptr;
+    for (const auto& token : tokens)
+    {
+        if (token.data() < line.data())
+            continue;
+        const char* start = previous ? previous : line.data();
+        const std::string_view gap(start, token.data() - start);
+        if (previous && gap.find(',') == std::string_view::npos)
+        {
+            operands.back() = std::string_view(operands.back().data(), token.data() + token.size() - operands.back().data());
+        }
+        else
+        {
+            add_empty_operands(gap, operands);
+            operands.push_back(token);
+        }
+        previous = token.data() + token.size();
+    }
+    if (previous)
+        add_empty_operands(std::string_view(previous, line.data() + line.size() - previous), operands);
+    else
+        add_empty_operands(line, operands);
 
     int specialop;
     int opcode_id = get_opcode(opcode, specialop, context);
@@ -257,17 +336,17 @@ uint16_t lc3_assemble_one(lc3_state& state, LC3AssembleContext& context)
         break;
     case ERROR_INSTR:
         // Let the plugin handle it
-        params = tokens.size();
+        params = operands.size();
         break;
     default: /* Just in case */
         break;
     }
 
-    if (tokens.size() < params)
+    if (operands.size() < params)
     {
         THROWANDDO(LC3AssembleException(context.line, "", SYNTAX_ERROR, context.lineno), return 0);
     }
-    else if (tokens.size() > params)
+    else if (operands.size() > params)
     {
         THROW(LC3AssembleException(context.line, "", EXTRA_INPUT, context.lineno));
     }
@@ -276,24 +355,24 @@ uint16_t lc3_assemble_one(lc3_state& state, LC3AssembleContext& context)
     {
     case ADD_INSTR:
     case AND_INSTR:
-        dr = get_register(tokens[0], context);
-        sr1 = get_register(tokens[1], context);
-        sr2_imm = get_register_imm5(tokens[2], is_reg, context);
+        dr = get_register(std::string(operands[0]), context);
+        sr1 = get_register(std::string(operands[1]), context);
+        sr2_imm = get_register_imm5(std::string(operands[2]), is_reg, context);
         instruction |= (dr << 9) | (sr1 << 6) | (!is_reg << 5) | sr2_imm;
         break;
     case NOT_INSTR:
-        dr = get_register(tokens[0], context);
-        sr1 = get_register(tokens[1], context);
+        dr = get_register(std::string(operands[0]), context);
+        sr1 = get_register(std::string(operands[1]), context);
         instruction |= (dr << 9) | (sr1 << 6) | 0x3F;
         break;
     case BR_INSTR:
         get_cc_flags(opcode, n, z, p, context);
-        dr = get_offset(tokens[0], 9, context);
+        dr = get_offset(std::string(operands[0]), 9, context);
         instruction |= (n << 11) | (z << 10) | (p << 9) | dr;
         break;
     case JMP_INSTR:
         // Special op contains 1 if RET
-        dr = specialop ? 7 : get_register(tokens[0], context);
+        dr = specialop ? 7 : get_register(std::string(operands[0]), context);
         instruction |= dr << 6;
         break;
     case JSR_INSTR:
@@ -301,12 +380,12 @@ uint16_t lc3_assemble_one(lc3_state& state, LC3AssembleContext& context)
         // special op contains a 1 if JSR
         if (specialop)
         {
-            dr = get_offset(tokens[0], 11, context);
+            dr = get_offset(std::string(operands[0]), 11, context);
             instruction |= dr;
         }
         else
         {
-            dr = get_register(tokens[0], context);
+            dr = get_register(std::string(operands[0]), context);
             instruction |= dr << 6;
         }
         break;
@@ -317,21 +396,21 @@ uint16_t lc3_assemble_one(lc3_state& state, LC3AssembleContext& context)
     case LDI_INSTR:
     case ST_INSTR:
     case STI_INSTR:
-        dr = get_register(tokens[0], context);
-        sr1 = get_offset(tokens[1], 9, context);
+        dr = get_register(std::string(operands[0]), context);
+        sr1 = get_offset(std::string(operands[1]), 9, context);
         instruction |= (dr << 9) | sr1;
         break;
     case LDR_INSTR:
     case STR_INSTR:
-        dr = get_register(tokens[0], context);
-        sr1 = get_register(tokens[1], context);
-        sr2_imm = get_imm(tokens[2], 6, false, true, context);
+        dr = get_register(std::string(operands[0]), context);
+        sr1 = get_register(std::string(operands[1]), context);
+        sr2_imm = get_imm(std::string(operands[2]), 6, false, true, context);
         instruction |= (dr << 9) | (sr1 << 6) | sr2_imm;
         break;
     case TRAP_INSTR:
         // Special op contains trap number if trapname.
         // get_imm with false because its unsigned
-        dr = specialop ? specialop : get_imm(tokens[0], 8, true, false, context);
+        dr = specialop ? specialop : get_imm(std::string(operands[0]), 8, true, false, context);
         instruction |= dr;
         break;
     case ERROR_INSTR:
@@ -339,16 +418,182 @@ uint16_t lc3_assemble_one(lc3_state& state, LC3AssembleContext& context)
         if (state.instructionPlugin)
             instruction = state.instructionPlugin->DoAssembleOne(state, context);
         else
-            THROWANDDO(LC3AssembleException(line, opcode, INVALID_INSTRUCTION, context.lineno), return 0);
+            THROWANDDO(LC3AssembleException(std::string(line), opcode, INVALID_INSTRUCTION, context.lineno), return 0);
         break;
     default: /* Just in case */
-        THROWANDDO(LC3AssembleException(line, opcode, INVALID_INSTRUCTION, context.lineno), return 0);
+        THROWANDDO(LC3AssembleException(std::string(line), opcode, INVALID_INSTRUCTION, context.lineno), return 0);
         break;
     }
 
     return instruction;
 }
 
+/** Second pass of one line, memory is written through write(address, value). */
+template<typename Writer>
+static void assemble_line(LC3AssembleContext& context, const code_line& code, const std::vector<std::string_view>& token_arena, Writer&& write)
+{
+    const std::string_view line = code.line;
+    context.lineno = static_cast<int>(code.location);
+    std::vector<std::string_view> symbols;
+
+    token_span tokens(token_arena, code.first_token, code.num_tokens);
+
+    std::string symbol;
+    //printf("-------\n");
+    while (!tokens.empty() && !tokens[0].empty() && tokens[0][0] != '.')
+    {
+        symbol = std::string(tokens[0]);
+        // If a Register or an immediate value then we have gone too far.
+        if (is_register_or_imm(symbol))
+        {
+            // undo last and break
+            if (!symbols.empty())
+            {
+                symbols.pop_back();
+                tokens.unpop_front();
+            }
+            break;
+        }
+        //printf("symbol: %s ", symbol.c_str());
+
+        int specialop;
+        int op = get_opcode(symbol, specialop, context, false);
+        //printf("op: %d specialop: %d\n", op, specialop);
+        if (op == -1 && specialop == -1)
+        {
+            symbols.push_back(tokens[0]);
+            tokens.pop_front();
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (tokens.empty()) return;
+    // If assembler directive
+    if (tokens[0][0] == '.')
+    {
+        context.line.assign(line.data(), line.size());
+        context.tokens.assign(token_arena.begin() + code.first_token, token_arena.begin() + code.first_token + code.num_tokens);
+        std::string param(tokens.size() > 1 ? tokens[1] : std::string_view());
+        std::string directive(tokens[0]);
+        std::string rest(trim_view(line.substr(line.find(directive) + directive.size())));
+        std::transform(directive.begin(), directive.end(), directive.begin(), static_cast<int (*)(int)>(std::tolower));
+
+        if (directive == ".orig")
+        {
+            context.address = get_imm(param, 16, true, false, context);
+        }
+        else if (directive == ".stringz")
+        {
+            std::string processed = process_str(rest, context);
+            size_t size = processed.size() + 1;
+
+            for (size_t j = 0; j < size - 1; j++)
+                write(static_cast<uint16_t>(context.address + j), static_cast<int16_t>(processed[j]));
+            write(static_cast<uint16_t>(context.address + size - 1), 0);
+
+            context.address += size;
+        }
+        else if (directive == ".fill")
+        {
+            write(context.address, get_fill_value(rest, context));
+            context.address += 1;
+        }
+        else if (directive == ".blkw")
+        {
+            uint16_t locs = get_imm(param, 16, true, false, context);
+            // blkw should not emit anything to memory
+            context.address += locs;
+        }
+    }
+    else
+    {
+        // Everything after the symbols, the tokens left start at the opcode.
+        size_t index = symbols.empty() ? 0 : static_cast<size_t>(symbols.back().data() + symbols.back().size() - line.data());
+        const std::string_view instruction = trim_view(line.substr(index));
+        context.line.assign(instruction.data(), instruction.size());
+        // Should have a valid instruction here.
+        write(context.address, lc3_assemble_one(*context.state, context, instruction, tokens));
+        context.address += 1;
+    }
+}
+
+/** Runs the second pass over a chunk on its own context, buffering its memory writes and errors. */
+static void assemble_chunk(const LC3AssembleContext& context, const std::vector<code_line>& code, const std::vector<std::string_view>& token_arena, code_chunk& chunk)
+{
+    LC3AssembleContext chunk_context;
+    chunk_context.state = context.state;
+    chunk_context.options = context.options;
+    chunk_context.address = chunk.start;
+    chunk.writes.clear();
+    chunk.error = nullptr;
+
+    try
+    {
+        for (size_t i = chunk.begin; i < chunk.end; i++)
+            assemble_line(chunk_context, code[i], token_arena, [&chunk](uint16_t address, int16_t value) { chunk.writes.emplace_back(address, value); });
+    }
+    catch (...)
+    {
+        chunk.error = std::current_exception();
+    }
+
+    chunk.address = chunk_context.address;
+    chunk.exceptions = std::move(chunk_context.exceptions);
+}
+
+/** Second pass, encodes all of the code into memory.
+  *
+  * Big files are split into chunks of lines encoded in parallel, each starting at the address the first pass had for it.
+  * Chunks are merged in line order so errors come out the same as going through the file in one go. If a chunk doesn't
+  * start where the one before it really ended (only on lines the first pass got wrong) it is encoded again from there.
+  */
+static void assemble_code(lc3_state& state, LC3AssembleContext& context, const std::vector<code_line>& code, const std::vector<std::string_view>& token_arena)
+{
+    const unsigned int max_threads = context.options.threads != 0 ? context.options.threads : std::thread::hardware_concurrency();
+    const auto threads = static_cast<unsigned int>(std::min<size_t>(max_threads, code.size() / PARALLEL_ASSEMBLE_MIN_LINES));
+    // Warnings are printed as they are found and instruction plugins may not be thread safe, so those go in order.
+    const bool warnings = context.options.enable_warnings && !context.options.warnings_as_errors;
+    if (threads < 2 || warnings || state.instructionPlugin)
+    {
+        for (const auto& line : code)
+            assemble_line(context, line, token_arena, [&state](uint16_t address, int16_t value) { state.mem[address] = value; });
+        return;
+    }
+
+    std::vector<code_chunk> chunks(threads);
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        chunks[i].begin = code.size() * i / threads;
+        chunks[i].end = code.size() * (i + 1) / threads;
+        chunks[i].start = i == 0 ? context.address : code[chunks[i].begin].address;
+    }
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++)
+        pool.emplace_back([&, i]() { assemble_chunk(context, code, token_arena, chunks[i]); });
+    assemble_chunk(context, code, token_arena, chunks[0]);
+    for (auto& thread : pool)
+        thread.join();
+
+    for (auto& chunk : chunks)
+    {
+        if (chunk.start != context.address)
+        {
+            chunk.start = context.address;
+            assemble_chunk(context, code, token_arena, chunk);
+        }
+        for (const auto& write : chunk.writes)
+            state.mem[write.first] = write.second;
+        context.exceptions.splice(context.exceptions.end(), chunk.exceptions);
+        if (chunk.error)
+            std::rethrow_exception(chunk.error);
+        context.address = chunk.address;
+    }
+}
+
 void lc3_assemble(lc3_state& state, const std::string& filename, const LC3AssembleOptions& options)
 {
     std::vector<code_range> ranges;
@@ -366,11 +611,15 @@ void lc3_assemble(lc3_state& state, const std::string& filename, std::vector<cod
 
 void lc3_assemble(lc3_state& state, std::istream& file, std::vector<code_range>& ranges, const LC3AssembleOptions& options)
 {
+    // Everything below is a view into source, lines are split and tokenized once here for both passes.
+    const std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<std::string_view> token_arena;
     std::vector<code_line> code;
     std::vector<debug_statement> debugging;
     std::stringstream comments;
     code_range current_location(0, 0);
-    code_line last_orig("", 0);
+    std::string_view last_orig_line;
+    unsigned int last_orig_location = 0;
 
     LC3AssembleContext context;
     context.state = &state;
@@ -378,15 +627,23 @@ void lc3_assemble(lc3_state& state, std::istream& file, std::vector<code_range>&
     bool in_orig = false;
 
     // First pass get all symbols.
-    while (!file.eof())
+    size_t line_start = 0;
+    bool last_line = false;
+    while (!last_line)
     {
         uint16_t last_addr = context.address;
-        std::string line;
-        std::string comment;
-        std::getline(file, line);
+        // Lines are split as std::getline would, so a trailing newline is followed by an empty line.
+        size_t line_end = source.find('\n', line_start);
+        last_line = line_end == std::string::npos;
+        if (last_line)
+            line_end = source.size();
+        const std::string_view raw_line(source.data() + line_start, line_end - line_start);
+        line_start = line_end + 1;
+
+        std::string_view comment;
         context.lineno++;
-        context.line = line;
-        remove_comments(line, comment);
+        context.line.assign(raw_line.data(), raw_line.size());
+        const std::string_view line = split_comment(raw_line, comment);
 
         // Plugins are mission critical especially if they are instruction plugins that modify the assembling process!
         if (comment.size() > 2 && comment.substr(1, 7) == std::string("@plugin") && !context.options.disable_plugins)
@@ -399,14 +656,12 @@ void lc3_assemble(lc3_state& state, std::istream& file, std::vector<code_range>&
         }
         else if (comment.size() > 2 && comment[1] == '@')
         {
-            debugging.emplace_back(comment.substr(2), context.lineno, context.address);
+            debugging.emplace_back(std::string(comment.substr(2)), context.lineno, context.address);
         }
         else if (!comment.empty() && in_orig)
         {
 
-            std::string trimmed = comment.substr(1, std::string::npos);
-            trim(trimmed);
-            comments << trimmed;
+            comments << trim_view(comment.substr(1));
             comments << "\n";
         }
 
@@ -424,11 +679,12 @@ void lc3_assemble(lc3_state& state, std::istream& file, std::vector<code_range>&
             comments.str("");
         }
 
-        code.emplace_back(line, context.lineno);
+        const size_t first_token = token_arena.size();
+        tokenize(line, token_arena, " \t,");
+        code.emplace_back(line, context.lineno, context.address, first_token, token_arena.size() - first_token);
 
-        std::vector<std::string> tokens;
-        tokenize(line, tokens, " \t,");
-        context.tokens = tokens;
+        token_span tokens(token_arena, first_token, token_arena.size() - first_token);
+        context.tokens.assign(token_arena.begin() + first_token, token_arena.end());
 
         std::string symbol;
 
@@ -436,7 +692,7 @@ void lc3_assemble(lc3_state& state, std::istream& file, std::vector<code_range>&
         if (tokens[0][0] != '.')
         {
             bool validate_failed = false;
-            symbol = tokens[0];
+            symbol = std::string(tokens[0]);
 
             //if (symbol[symbol.size() - 1] == ':')
             //symbol = symbol.substr(0, symbol.size() - 1);
@@ -490,7 +746,7 @@ symbolcheckdone:
                 // Example .asm file snippet to get this
                 // HELLO
                 // WORLD ADD R0, R0, R0
-                tokens.erase(tokens.begin());
+                tokens.pop_front();
                 if (!in_orig)
                 {
                     THROWANDDO(LC3AssembleException(context.line, "", STRAY_DATA, context.lineno), continue);
@@ -520,12 +776,12 @@ symbolcheckdone:
                 //printf("CHECK %d %s %s\n", tokens.size(), symbol.c_str(), context.line.c_str());
                 while (!tokens.empty() && tokens[0][0] != '.')
                 {
-                    std::string symbol2 = tokens[0];
+                    std::string symbol2(tokens[0]);
                     op = get_opcode(symbol2, specialop, context, false);
                     //printf("SYMBOL2 %d %s\n", op, symbol2.c_str());
                     if (op == -1 && specialop == -1)
                     {
-                        tokens.erase(tokens.begin());
+                        tokens.pop_front();
                         std::vector<std::string> params;
                         std::stringstream oss;
                         oss << std::hex << context.address;
@@ -548,19 +804,19 @@ symbolcheckdone:
         if (tokens[0][0] == '.')
         {
             unsigned int paramcheck = 2;
-            std::string directive = tokens[0];
+            std::string directive(tokens[0]);
             std::transform(directive.begin(), directive.end(), directive.begin(), static_cast<int (*)(int)>(std::tolower));
-            std::string param = tokens.size() > 1 ? tokens[1] : "";
+            std::string param(tokens.size() > 1 ? tokens[1] : std::string_view());
 
             if (directive == ".orig")
             {
                 if (current_location.size != 0)
-                    THROW(LC3AssembleException(last_orig.line, "",  ORIG_MATCHUP, last_orig.location));
+                    THROW(LC3AssembleException(std::string(last_orig_line), "",  ORIG_MATCHUP, last_orig_location));
 
                 current_location.location = get_imm(param, 16, true, false, context);
                 current_location.size = 0;
-                last_orig.line = context.line;
-                last_orig.location = context.lineno;
+                last_orig_line = raw_line;
+                last_orig_location = context.lineno;
                 context.address = current_location.location;
                 in_orig = true;
             }
@@ -589,7 +845,7 @@ symbolcheckdone:
                     THROW(LC3AssembleException(context.line, "", MALFORMED_STRING, context.lineno));
                 }
 
-                std::string str = line.substr(start, end - start + 1);
+                std::string str(line.substr(start, end - start + 1));
                 size_t size = process_str(str, context).size() + 1;
                 if (context.address + size > 0xFFFF)
                 {
@@ -619,7 +875,7 @@ symbolcheckdone:
             else
             {
                 // Using an assembler directive I don't know of ex. .fillme 24
-                THROW(LC3AssembleException("", tokens[0], INVALID_DIRECTIVE, context.lineno));
+                THROW(LC3AssembleException("", std::string(tokens[0]), INVALID_DIRECTIVE, context.lineno));
             }
 
             if (tokens.size() > paramcheck)
@@ -632,7 +888,7 @@ symbolcheckdone:
         {
             // Should have a valid instruction here.
             int specialop;
-            get_opcode(tokens[0], specialop, context, false);
+            get_opcode(std::string(tokens[0]), specialop, context, false);
             /*int op = get_opcode(tokens[0], specialop, context, false);
             if (!context.multiple)
                 assert(!(op == -1 && specialop == -1));*/
@@ -657,7 +913,7 @@ symbolcheckdone:
 
     if (in_orig)
     {
-        THROW(LC3AssembleException(last_orig.line, "",  ORIG_MATCHUP, last_orig.location));
+        THROW(LC3AssembleException(std::string(last_orig_line), "",  ORIG_MATCHUP, last_orig_location));
     }
 
     for (unsigned int i = 0; i < ranges.size(); i++)
@@ -685,103 +941,7 @@ symbolcheckdone:
     context.state = &state;
 
     // Second pass actually do things now.
-    for (const auto& code_line : code)
-    {
-        std::string line = code_line.line;
-        context.lineno = static_cast<int>(code_line.location);
-        context.line = line;
-        std::vector<std::string> symbols;
-
-        std::vector<std::string> tokens;
-        tokenize(line, tokens, " \t,");
-
-        context.tokens = tokens;
-
-        std::string symbol;
-        //printf("-------\n");
-        while (!tokens.empty() && !tokens[0].empty() && tokens[0][0] != '.')
-        {
-            symbol = tokens[0];
-            // If a Register or an immediate value then we have gone too far.
-            if (is_register_or_imm(symbol))
-            {
-                // undo last and break
-                if (!symbols.empty())
-                {
-                    symbol = symbols.back();
-                    symbols.pop_back();
-                    tokens.insert(tokens.begin(), symbol);
-                }
-                break;
-            }
-            //printf("symbol: %s ", symbol.c_str());
-
-            int specialop;
-            int op = get_opcode(symbol, specialop, context, false);
-            //printf("op: %d specialop: %d\n", op, specialop);
-            if (op == -1 && specialop == -1)
-            {
-                tokens.erase(tokens.begin());
-                symbols.push_back(symbol);
-            }
-            else
-            {
-                break;
-            }
-        }
-
-        if (tokens.empty()) continue;
-        // If assembler directive
-        if (tokens[0][0] == '.')
-        {
-            std::string param = tokens.size() > 1 ? tokens[1] : "";
-            std::string directive = tokens[0];
-            std::string rest = line.substr(line.find(directive) + directive.size());
-            trim(rest);
-            std::transform(directive.begin(), directive.end(), directive.begin(), static_cast<int (*)(int)>(std::tolower));
-
-            if (directive == ".orig")
-            {
-                current_location.location = get_imm(param, 16, true, false, context);
-                context.address = current_location.location;
-            }
-            else if (directive == ".stringz")
-            {
-                std::string processed = process_str(rest, context);
-                size_t size = processed.size() + 1;
-
-                for (size_t j = 0; j < size - 1; j++)
-                    state.mem[context.address + j] = static_cast<int16_t>(processed[j]);
-                state.mem[context.address + size - 1] = 0;
-
-                context.address += size;
-            }
-            else if (directive == ".fill")
-            {
-                state.mem[context.address] = get_fill_value(rest, context);
-                context.address += 1;
-            }
-            else if (directive == ".blkw")
-            {
-                uint16_t locs = get_imm(param, 16, true, false, context);
-                // blkw should not emit anything to memory
-                context.address += locs;
-            }
-        }
-        else
-        {
-            //printf("context.line: %s tokens[0] %s\n", context.line.c_str(), symbols.empty() ? "" : symbols[0].c_str());
-            size_t index = symbols.empty() ? 0 : context.line.find(symbols[symbols.size() - 1]) + symbols[symbols.size() - 1].size();
-            std::string instruction = context.line.substr(index);
-            trim(instruction);
-
-            context.line = instruction;
-            context.tokens.clear();
-            // Should have a valid instruction here.
-            state.mem[context.address] = lc3_assemble_one(*context.state, context);
-            context.address += 1;
-        }
-    }
+    assemble_code(state, context, code, token_arena);
 
     // Process all debug statements you have received during first pass
     // @break[point]
@@ -917,27 +1077,32 @@ bool lc3_assemble(const std::string& filename, const std::string& output_prefix,
     if (output_prefix.empty())
         prefix = filename.substr(0, filename.rfind('.'));
 
-    if (!state->symbols.empty())
+    return lc3_assemble_write(prefix, *state, ranges, options);
+}
+
+bool lc3_assemble_write(const std::string& output_prefix, lc3_state& state, const std::vector<code_range>& ranges, const LC3AssembleOptions& options)
+{
+    if (!state.symbols.empty())
     {
-        std::string sym_file = prefix + ".sym";
+        std::string sym_file = output_prefix + ".sym";
         std::ofstream sym(sym_file.c_str());
         if (!sym.good()) return false;
-        for (const auto& addr_symbol : state->rev_symbols)
+        for (const auto& addr_symbol : state.rev_symbols)
             sym << std::hex << addr_symbol.first << std::dec << "\t" << addr_symbol.second << std::endl;
     }
 
     switch (options.output_mode)
     {
         case LC3AssembleOptions::OutputMode::OBJECT_FILE:
-            return lc3_assemble_object_writer(prefix, *state, ranges);
+            return lc3_assemble_object_writer(output_prefix, state, ranges);
         case LC3AssembleOptions::OutputMode::BINARY_FILE:
-            return lc3_assemble_binary_writer(prefix, *state, ranges);
+            return lc3_assemble_binary_writer(output_prefix, state, ranges);
         case LC3AssembleOptions::OutputMode::HEXADECIMAL_FILE:
-            return lc3_assemble_hexadecimal_writer(prefix, *state, ranges);
+            return lc3_assemble_hexadecimal_writer(output_prefix, state, ranges);
         case LC3AssembleOptions::OutputMode::FULL_REPRESENTATION_FILE:
-            return lc3_assemble_full_writer(prefix, *state, ranges);
+            return lc3_assemble_full_writer(output_prefix, state, ranges);
         default:
-            return lc3_assemble_object_writer(prefix, *state, ranges);
+            return lc3_assemble_object_writer(output_prefix, state, ranges);
     }
 }
 
@@ -0,0 +1,281 @@
+#include "lc3/lc3_block.hpp"
+
+#include <algorithm>
+
+#include "lc3/lc3_execute.hpp"
+
+void lc3_translate_block(lc3_state& state, uint16_t addr, lc3_block& block)
+{
+    block.address = addr;
+    block.generation = ++state.block_generation;
+    block.words.clear();
+    block.ops.clear();
+
+    bool translating = true;
+    for (uint32_t pc = addr; translating && pc <= 0xFFFFU && block.ops.size() < LC3_MAX_BLOCK_SIZE; pc++)
+    {
+        const lc3_decoded_instruction& instruction = lc3_fetch(state, pc);
+        // Remember the word even if it ends the block, so the block is retranslated if it changes.
+        block.words.push_back(instruction.data);
+
+        if (instruction.flags & LC3_DECODED_MALFORMED)
+            break;
+
+        lc3_block_op op;
+        op.dr = instruction.dr;
+        op.sr1 = instruction.sr1;
+        op.sr2 = instruction.sr2;
+        op.value = instruction.offset;
+
+        // PC relative addresses can be resolved now.
+        const auto pc_relative = static_cast<int16_t>(pc + 1 + instruction.offset);
+        switch(instruction.opcode)
+        {
+            case ADD_INSTR:
+                op.handler = (instruction.flags & LC3_DECODED_IMM) ? BLOCK_ADD_IMM : BLOCK_ADD_REG;
+                break;
+            case AND_INSTR:
+                op.handler = (instruction.flags & LC3_DECODED_IMM) ? BLOCK_AND_IMM : BLOCK_AND_REG;
+                break;
+            case NOT_INSTR:
+                op.handler = BLOCK_NOT;
+                break;
+            case LD_INSTR:
+                op.handler = BLOCK_LD;
+                op.value = pc_relative;
+                break;
+            case LDI_INSTR:
+                op.handler = BLOCK_LDI;
+                op.value = pc_relative;
+                break;
+            case LDR_INSTR:
+                op.handler = BLOCK_LDR;
+                break;
+            case ST_INSTR:
+                op.handler = BLOCK_ST;
+                op.value = pc_relative;
+                break;
+            case STI_INSTR:
+                op.handler = BLOCK_STI;
+                op.value = pc_relative;
+                break;
+            case STR_INSTR:
+                op.handler = BLOCK_STR;
+                break;
+            case LEA_INSTR:
+                op.handler = BLOCK_LEA;
+                op.value = pc_relative;
+                break;
+            case BR_INSTR:
+                op.handler = BLOCK_BR;
+                op.value = pc_relative;
+                translating = false;
+                break;
+            case JMP_INSTR:
+                op.handler = BLOCK_JMP;
+                translating = false;
+                break;
+            default:
+                // JSR, TRAP, RTI and plugin instructions are left to lc3_step.
+                op.handler = BLOCK_HANDLERS;
+                break;
+        }
+
+        if (op.handler == BLOCK_HANDLERS)
+            break;
+
+        block.ops.push_back(op);
+    }
+}
+
+const lc3_block& lc3_fetch_block(lc3_state& state, uint16_t addr)
+{
+    lc3_block& block = state.block_cache[addr];
+
+    if (block.words.empty() || !std::equal(block.words.begin(), block.words.end(), state.mem + addr))
+        lc3_translate_block(state, addr, block);
+
+    return block;
+}
+
+static inline void lc3_block_setcc(lc3_state& state, int16_t value)
+{
+    state.n = value < 0;
+    state.z = value == 0;
+    state.p = value > 0;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+// Labels as values is a GNU extension.
+#define LC3_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+#ifdef LC3_THREADED_DISPATCH
+#define LC3_DISPATCH() goto *dispatch_table[op->handler]
+#define LC3_HANDLER(label, handler) label
+#else
+#define LC3_DISPATCH() goto dispatch
+#define LC3_HANDLER(label, handler) case handler
+#endif
+
+// PC after executing the current op.
+#define LC3_NEXT_PC() static_cast<uint16_t>(block.address + (op - begin) + 1)
+
+#define LC3_NEXT() do \
+{ \
+    if (++op == end) \
+        goto finished; \
+    LC3_DISPATCH(); \
+} while(0)
+
+// Memory accesses can halt the machine or raise an exception.
+#define LC3_CHECK_MEMORY() do \
+{ \
+    if (state.halted || state.pc != LC3_NEXT_PC()) \
+    { \
+        ++op; \
+        goto done; \
+    } \
+} while(0)
+
+// Self modifying code, remaining ops may be stale.
+#define LC3_CHECK_STORE(addr) do \
+{ \
+    LC3_CHECK_MEMORY(); \
+    if (static_cast<uint16_t>((addr) - block.address) < block.words.size()) \
+    { \
+        ++op; \
+        goto done; \
+    } \
+} while(0)
+
+unsigned int lc3_execute_block(lc3_state& state, const lc3_block& block, unsigned int limit)
+{
+    const lc3_block_op* const begin = block.ops.data();
+    const lc3_block_op* const end = begin + std::min<size_t>(limit, block.ops.size());
+    const lc3_block_op* op = begin;
+    uint16_t addr;
+    unsigned int executed;
+
+#ifdef LC3_THREADED_DISPATCH
+    static const void* const dispatch_table[BLOCK_HANDLERS] =
+    {
+        &&add_reg, &&add_imm, &&and_reg, &&and_imm, &&not_, &&ld, &&ldi, &&ldr,
+        &&st, &&sti, &&str, &&lea, &&br, &&jmp,
+    };
+#endif
+
+    if (op == end)
+        return 0;
+
+    LC3_DISPATCH();
+
+#ifndef LC3_THREADED_DISPATCH
+dispatch:
+#endif
+    switch(op->handler)
+    {
+        LC3_HANDLER(add_reg, BLOCK_ADD_REG):
+            state.regs[op->dr] = state.regs[op->sr1] + state.regs[op->sr2];
+            lc3_block_setcc(state, state.regs[op->dr]);
+            LC3_NEXT();
+        LC3_HANDLER(add_imm, BLOCK_ADD_IMM):
+            state.regs[op->dr] = state.regs[op->sr1] + op->value;
+            lc3_block_setcc(state, state.regs[op->dr]);
+            LC3_NEXT();
+        LC3_HANDLER(and_reg, BLOCK_AND_REG):
+            state.regs[op->dr] = state.regs[op->sr1] & state.regs[op->sr2];
+            lc3_block_setcc(state, state.regs[op->dr]);
+            LC3_NEXT();
+        LC3_HANDLER(and_imm, BLOCK_AND_IMM):
+            state.regs[op->dr] = state.regs[op->sr1] & op->value;
+            lc3_block_setcc(state, state.regs[op->dr]);
+            LC3_NEXT();
+        LC3_HANDLER(not_, BLOCK_NOT):
+            state.regs[op->dr] = ~state.regs[op->sr1];
+            lc3_block_setcc(state, state.regs[op->dr]);
+            LC3_NEXT();
+        LC3_HANDLER(ld, BLOCK_LD):
+            // Memory reads check the PC to see if we are in kernel mode.
+            state.pc = LC3_NEXT_PC();
+            state.regs[op->dr] = lc3_mem_read(state, op->value);
+            lc3_block_setcc(state, state.regs[op->dr]);
+            LC3_CHECK_MEMORY();
+            LC3_NEXT();
+        LC3_HANDLER(ldi, BLOCK_LDI):
+            state.pc = LC3_NEXT_PC();
+            state.regs[op->dr] = lc3_mem_read(state, lc3_mem_read(state, op->value));
+            lc3_block_setcc(state, state.regs[op->dr]);
+            LC3_CHECK_MEMORY();
+            LC3_NEXT();
+        LC3_HANDLER(ldr, BLOCK_LDR):
+            state.pc = LC3_NEXT_PC();
+            state.regs[op->dr] = lc3_mem_read(state, state.regs[op->sr1] + op->value);
+            lc3_block_setcc(state, state.regs[op->dr]);
+            LC3_CHECK_MEMORY();
+            LC3_NEXT();
+        LC3_HANDLER(st, BLOCK_ST):
+            state.pc = LC3_NEXT_PC();
+            addr = op->value;
+            lc3_mem_write(state, addr, state.regs[op->dr]);
+            LC3_CHECK_STORE(addr);
+            LC3_NEXT();
+        LC3_HANDLER(sti, BLOCK_STI):
+            state.pc = LC3_NEXT_PC();
+            addr = lc3_mem_read(state, op->value);
+            lc3_mem_write(state, addr, state.regs[op->dr]);
+            LC3_CHECK_STORE(addr);
+            LC3_NEXT();
+        LC3_HANDLER(str, BLOCK_STR):
+            state.pc = LC3_NEXT_PC();
+            addr = state.regs[op->sr1] + op->value;
+            lc3_mem_write(state, addr, state.regs[op->dr]);
+            LC3_CHECK_STORE(addr);
+            LC3_NEXT();
+        LC3_HANDLER(lea, BLOCK_LEA):
+            state.regs[op->dr] = op->value;
+            // In the 2019 revision of LC-3 LEA no longer sets condition codes.
+            if (state.lc3_version == 0)
+                lc3_block_setcc(state, state.regs[op->dr]);
+            LC3_NEXT();
+        LC3_HANDLER(br, BLOCK_BR):
+            if (((op->dr & 4) && state.n) || ((op->dr & 2) && state.z) || ((op->dr & 1) && state.p))
+                state.pc = op->value;
+            else
+                state.pc = LC3_NEXT_PC();
+            ++op;
+            goto done;
+        LC3_HANDLER(jmp, BLOCK_JMP):
+            // RET in user mode does call stack bookkeeping, leave it for lc3_step.
+            if (state.privilege && op->sr1 == 0x7)
+            {
+                state.pc = LC3_NEXT_PC() - 1;
+                goto done;
+            }
+            state.pc = state.regs[op->sr1];
+            ++op;
+            goto done;
+        default:
+            break;
+    }
+
+finished:
+    state.pc = static_cast<uint16_t>(block.address + (op - begin));
+done:
+    executed = op - begin;
+    state.executions += executed;
+    return executed;
+}
+
+#undef LC3_CHECK_STORE
+#undef LC3_CHECK_MEMORY
+#undef LC3_NEXT
+#undef LC3_NEXT_PC
+#undef LC3_HANDLER
+#undef LC3_DISPATCH
+
+#ifdef LC3_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,206 @@
+#include "lc3/lc3_checkpoint.hpp"
+
+#include "lc3/lc3_runner.hpp"
+
+void lc3_set_checkpoints(lc3_state& state, uint32_t interval, uint32_t dirty_pages, uint32_t max_checkpoints)
+{
+    state.checkpoints.clear();
+    state.checkpoint_interval = interval;
+    state.checkpoint_dirty_pages = dirty_pages;
+    state.max_checkpoints = std::max<uint32_t>(max_checkpoints, 2);
+
+    if (interval != 0)
+        lc3_save_checkpoint(state);
+}
+
+void lc3_save_checkpoint(lc3_state& state)
+{
+    while (!state.checkpoints.empty() && state.checkpoints.back().executions >= state.executions)
+        state.checkpoints.pop_back();
+
+    // Thin out the history, the first checkpoint is always kept.
+    if (state.checkpoints.size() >= state.max_checkpoints)
+    {
+        size_t kept = 1;
+        for (size_t i = 2; i < state.checkpoints.size(); i += 2)
+            state.checkpoints[kept++] = std::move(state.checkpoints[i]);
+        state.checkpoints.resize(kept);
+    }
+
+    state.checkpoints.emplace_back();
+    lc3_checkpoint& checkpoint = state.checkpoints.back();
+    checkpoint.executions = state.executions;
+    std::copy(state.regs, state.regs + 8, checkpoint.regs);
+    checkpoint.pc = state.pc;
+    checkpoint.privilege = state.privilege;
+    checkpoint.priority = state.priority;
+    checkpoint.n = state.n;
+    checkpoint.z = state.z;
+    checkpoint.p = state.p;
+    checkpoint.halted = state.halted;
+    checkpoint.warnings = state.warnings;
+    checkpoint.mem.assign(state.mem, state.mem + 65536);
+    checkpoint.call_stack = state.call_stack;
+    checkpoint.rti_stack = state.rti_stack;
+    checkpoint.first_level_calls = state.first_level_calls;
+    checkpoint.first_level_traps = state.first_level_traps;
+    checkpoint.rng = state.rng;
+    checkpoint.warn_stats = state.warn_stats;
+    checkpoint.interrupts = state.interrupts;
+    checkpoint.interrupt_vector = state.interrupt_vector;
+    checkpoint.interrupt_vector_stack = state.interrupt_vector_stack;
+    checkpoint.savedusp = state.savedusp;
+    checkpoint.savedssp = state.savedssp;
+    checkpoint.keyboard_int_counter = state.keyboard_int_counter;
+    // tellg sets failbit on a stream at eof.
+    checkpoint.input_position = state.input != nullptr && state.input->good() ? state.input->tellg() : std::streampos(-1);
+
+    state.next_checkpoint = state.executions + state.checkpoint_interval;
+    state.dirty_pages.fill(0);
+    state.dirty_page_count = 0;
+}
+
+void lc3_restore_checkpoint(lc3_state& state, const lc3_checkpoint& checkpoint)
+{
+    state.executions = checkpoint.executions;
+    std::copy(checkpoint.regs, checkpoint.regs + 8, state.regs);
+    state.pc = checkpoint.pc;
+    state.privilege = checkpoint.privilege;
+    state.priority = checkpoint.priority;
+    state.n = checkpoint.n;
+    state.z = checkpoint.z;
+    state.p = checkpoint.p;
+    state.halted = checkpoint.halted;
+    state.warnings = checkpoint.warnings;
+    std::copy(checkpoint.mem.begin(), checkpoint.mem.end(), state.mem);
+    state.call_stack = checkpoint.call_stack;
+    state.rti_stack = checkpoint.rti_stack;
+    state.first_level_calls = checkpoint.first_level_calls;
+    state.first_level_traps = checkpoint.first_level_traps;
+    state.rng = checkpoint.rng;
+    state.warn_stats = checkpoint.warn_stats;
+    state.interrupts = checkpoint.interrupts;
+    state.interrupt_vector = checkpoint.interrupt_vector;
+    state.interrupt_vector_stack = checkpoint.interrupt_vector_stack;
+    state.savedusp = checkpoint.savedusp;
+    state.savedssp = checkpoint.savedssp;
+    state.keyboard_int_counter = checkpoint.keyboard_int_counter;
+    if (state.input != nullptr && checkpoint.input_position != std::streampos(-1))
+    {
+        state.input->clear();
+        state.input->seekg(checkpoint.input_position);
+    }
+
+    state.undo_stack.clear();
+    state.next_checkpoint = state.executions + state.checkpoint_interval;
+    state.dirty_pages.fill(0);
+    state.dirty_page_count = 0;
+}
+
+void lc3_discard_checkpoints(lc3_state& state)
+{
+    while (!state.checkpoints.empty() && state.checkpoints.back().executions > state.executions)
+        state.checkpoints.pop_back();
+    if (state.checkpoint_interval != 0 && !state.checkpoints.empty())
+        state.next_checkpoint = state.checkpoints.back().executions + state.checkpoint_interval;
+}
+
+/** Detaches everything that observes a run from state and puts it back when it goes away, @see lc3_seek.
+  * Custom writers may not write to state.output, so the writer is replaced too.
+  */
+class observer_guard
+{
+public:
+    explicit observer_guard(lc3_state& target) : state(target), discard(nullptr)
+    {
+        writer = std::move(state.writer);
+        state.writer = [](lc3_state&, std::ostream&, int32_t) -> int32_t { return 0; };
+        output = state.output;
+        warning = state.warning;
+        trace = state.trace;
+        binary_trace = state.binary_trace;
+        state.output = &discard;
+        state.warning = nullptr;
+        state.trace = nullptr;
+        state.binary_trace = nullptr;
+        event_subscriptions = state.event_subscriptions;
+        state.event_subscriptions = 0;
+        breakpoints.swap(state.breakpoints);
+        mem_watchpoints.swap(state.mem_watchpoints);
+        reg_watchpoints.swap(state.reg_watchpoints);
+        breakpoint_bits = state.breakpoint_bits;
+        mem_watchpoint_bits = state.mem_watchpoint_bits;
+        reg_watchpoint_bits = state.reg_watchpoint_bits;
+        state.breakpoint_bits.fill(0);
+        state.mem_watchpoint_bits.fill(0);
+        state.reg_watchpoint_bits = 0;
+    }
+
+    ~observer_guard()
+    {
+        breakpoints.swap(state.breakpoints);
+        mem_watchpoints.swap(state.mem_watchpoints);
+        reg_watchpoints.swap(state.reg_watchpoints);
+        state.breakpoint_bits = breakpoint_bits;
+        state.mem_watchpoint_bits = mem_watchpoint_bits;
+        state.reg_watchpoint_bits = reg_watchpoint_bits;
+        state.writer = std::move(writer);
+        state.output = output;
+        state.warning = warning;
+        state.trace = trace;
+        state.binary_trace = binary_trace;
+        state.event_subscriptions = event_subscriptions;
+    }
+
+    observer_guard(const observer_guard&) = delete;
+    observer_guard& operator=(const observer_guard&) = delete;
+
+private:
+    lc3_state& state;
+    std::ostream discard;
+    decltype(lc3_state::writer) writer;
+    std::ostream* output;
+    std::ostream* warning;
+    std::ostream* trace;
+    lc3_trace_writer* binary_trace;
+    uint32_t event_subscriptions;
+    std::unordered_map<uint16_t, lc3_debug_info> breakpoints;
+    std::unordered_map<uint16_t, lc3_debug_info> mem_watchpoints;
+    std::unordered_map<uint8_t, lc3_debug_info> reg_watchpoints;
+    decltype(lc3_state::breakpoint_bits) breakpoint_bits;
+    decltype(lc3_state::mem_watchpoint_bits) mem_watchpoint_bits;
+    decltype(lc3_state::reg_watchpoint_bits) reg_watchpoint_bits;
+};
+
+bool lc3_seek(lc3_state& state, uint32_t execution_count)
+{
+    if (execution_count >= state.executions)
+    {
+        lc3_run(state, execution_count - state.executions);
+        return state.executions == execution_count;
+    }
+
+    // Newest checkpoint at or before the target, backstepping discards the ones after it.
+    const auto after = std::upper_bound(state.checkpoints.begin(), state.checkpoints.end(), execution_count,
+        [](uint32_t executions, const lc3_checkpoint& other) { return executions < other.executions; });
+    const bool has_checkpoint = after != state.checkpoints.begin();
+    const size_t checkpoint = has_checkpoint ? static_cast<size_t>(after - state.checkpoints.begin()) - 1 : 0;
+
+    // The undo stack does not track device register polling (or the rng behind it) so replaying
+    // from a checkpoint is the only exact way back, backstepping is a fallback.
+    if (!has_checkpoint)
+    {
+        while (state.executions > execution_count && !state.undo_stack.empty() && state.undo_stack.back().changes != LC3_INTERRUPT_BEGIN)
+            lc3_back(state);
+        return state.executions == execution_count;
+    }
+
+    // Output written before the seek still belongs on the real stream.
+    lc3_flush_output(state);
+    lc3_restore_checkpoint(state, state.checkpoints[checkpoint]);
+
+    observer_guard guard(state);
+    lc3_run(state, execution_count - state.executions);
+
+    return state.executions == execution_count;
+}
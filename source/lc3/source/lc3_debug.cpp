@@ -3,11 +3,13 @@
 #include <cassert>
 #include <sstream>
 
+#include "lc3/lc3_event.hpp"
 #include "lc3/lc3_execute.hpp"
 #include "lc3/lc3_expressions.hpp"
 #include "lc3/lc3_symbol.hpp"
 
 bool lc3_add_subroutine(lc3_state& state, uint16_t address, const std::string& name, int num_params, const std::vector<std::string>& params);
+static void lc3_compile_debug_info(lc3_state& state, lc3_debug_info& info);
 
 bool lc3_has_breakpoint(lc3_state& state, const std::string& symbol)
 {
@@ -19,7 +21,7 @@ bool lc3_has_breakpoint(lc3_state& state, const std::string& symbol)
 
 bool lc3_has_breakpoint(lc3_state& state, uint16_t addr)
 {
-    return state.breakpoints.find(addr) != state.breakpoints.end();
+    return lc3_test_address_bit(state.breakpoint_bits, addr);
 }
 
 bool lc3_has_watchpoint(lc3_state& state, const std::string& symbol)
@@ -33,9 +35,9 @@ bool lc3_has_watchpoint(lc3_state& state, const std::string& symbol)
 bool lc3_has_watchpoint(lc3_state& state, bool is_reg, uint16_t data)
 {
     if (is_reg)
-        return state.reg_watchpoints.find(data) != state.reg_watchpoints.end();
+        return data <= 7 && ((state.reg_watchpoint_bits >> data) & 1);
     else
-        return state.mem_watchpoints.find(data) != state.mem_watchpoints.end();
+        return lc3_test_address_bit(state.mem_watchpoint_bits, data);
 }
 
 bool lc3_add_breakpoint(lc3_state& state, const std::string& symbol, const std::string& name, const std::string& message, const std::string& condition, int times)
@@ -58,8 +60,10 @@ bool lc3_add_breakpoint(lc3_state& state, uint16_t addr, const std::string& name
     info.name = name;
     info.message = message;
     info.condition = condition;
+    lc3_compile_debug_info(state, info);
 
     state.breakpoints[addr] = info;
+    lc3_set_address_bit(state.breakpoint_bits, addr, true);
 
     return false;
 }
@@ -92,11 +96,18 @@ bool lc3_add_watchpoint(lc3_state& state, bool is_reg, uint16_t data, const std:
     info.name = name;
     info.condition = condition;
     info.message = message;
+    lc3_compile_debug_info(state, info);
 
     if (is_reg)
+    {
         state.reg_watchpoints[data] = info;
+        state.reg_watchpoint_bits |= 1 << data;
+    }
     else
+    {
         state.mem_watchpoints[data] = info;
+        lc3_set_address_bit(state.mem_watchpoint_bits, data, true);
+    }
 
     return false;
 }
@@ -154,6 +165,7 @@ bool lc3_remove_breakpoint(lc3_state& state, uint16_t addr)
     if (state.breakpoints.find(addr) == state.breakpoints.end()) return true;
 
     state.breakpoints.erase(addr);
+    lc3_set_address_bit(state.breakpoint_bits, addr, false);
 
     return false;
 }
@@ -173,16 +185,74 @@ bool lc3_remove_watchpoint(lc3_state& state, bool is_reg, uint16_t data)
     {
         if (state.reg_watchpoints.find(data) == state.reg_watchpoints.end()) return true;
         state.reg_watchpoints.erase(data);
+        state.reg_watchpoint_bits &= ~(1 << data);
     }
     else
     {
         if (state.mem_watchpoints.find(data) == state.mem_watchpoints.end()) return true;
         state.mem_watchpoints.erase(data);
+        lc3_set_address_bit(state.mem_watchpoint_bits, data, false);
     }
 
     return false;
 }
 
+static void lc3_debug_error(lc3_state& state, const lc3_debug_info& info, const LC3CalculateException& e)
+{
+    std::stringstream msg;
+    msg << info.target_string() << " name: " << info.name << " " << e.what() << "\nHalting processor.";
+    lc3_warning(state, msg.str());
+    state.halted = 1;
+    state.pc--;
+}
+
+static void lc3_compile_message(lc3_state& state, const std::string& message, lc3_message_template& program)
+{
+    program.source = message;
+    program.parts.clear();
+    program.error = 0;
+    program.symbol_generation = state.symbol_generation;
+
+    // Split the same way as form_debug_message.
+    std::string_view text = program.source;
+    size_t i = 0;
+    while (i < text.size())
+    {
+        lc3_message_part part{};
+        part.text_start = i;
+        size_t n = text.find_first_of("{{", i);
+        size_t z = n == std::string_view::npos ? n : text.find_first_of("}}", n);
+        if (z == std::string_view::npos)
+        {
+            part.text_length = text.size() - i;
+            program.parts.push_back(std::move(part));
+            break;
+        }
+
+        part.text_length = n - i;
+        part.has_expression = true;
+        program.error = lc3_compile_expression(state, text.substr(n + 2, z - (n + 2)), part.expression);
+        if (program.error)
+        {
+            program.parts.clear();
+            return;
+        }
+        program.parts.push_back(std::move(part));
+
+        i = z + 2;
+    }
+}
+
+static void lc3_compile_debug_info(lc3_state& state, lc3_debug_info& info)
+{
+    const lc3_expression& condition = info.condition_program;
+    if (condition.error == -1 || condition.symbol_generation != state.symbol_generation || condition.source != info.condition)
+        lc3_compile_expression(state, info.condition, info.condition_program);
+    const lc3_message_template& message = info.message_program;
+    if (message.error == -1 || message.symbol_generation != state.symbol_generation || message.source != info.message)
+        lc3_compile_message(state, info.message, info.message_program);
+}
+
 static std::string form_debug_message(lc3_state& state, lc3_debug_info& info)
 {
     std::string_view message = info.message;
@@ -208,11 +278,7 @@ static std::string form_debug_message(lc3_state& state, lc3_debug_info& info)
         }
         catch (const LC3CalculateException& e)
         {
-            std::stringstream msg;
-            msg << info.target_string() << " name: " << info.name << " " << e.what() << "\nHalting processor.";
-            lc3_warning(state, msg.str());
-            state.halted = 1;
-            state.pc--;
+            lc3_debug_error(state, info, e);
             return "";
         }
 
@@ -222,21 +288,59 @@ static std::string form_debug_message(lc3_state& state, lc3_debug_info& info)
     return msg.str();
 }
 
-void lc3_break_eval(lc3_state& state, lc3_debug_info& info)
+static void lc3_write_debug_message(lc3_state& state, lc3_debug_info& info)
 {
+    const lc3_message_template& program = info.message_program;
+    if (program.error != 0)
+    {
+        (*state.debug) << form_debug_message(state, info) << "\n";
+        return;
+    }
+
+    // Evaluate everything first so nothing is written if there is an error.
+    std::vector<int> values;
+    values.reserve(program.parts.size());
+    try
+    {
+        for (const auto& part : program.parts)
+            if (part.has_expression)
+                values.push_back(lc3_evaluate(state, part.expression));
+    }
+    catch (const LC3CalculateException& e)
+    {
+        lc3_debug_error(state, info, e);
+        (*state.debug) << "\n";
+        return;
+    }
+
+    std::string_view text = program.source;
+    auto value = values.begin();
+    for (const auto& part : program.parts)
+    {
+        (*state.debug) << text.substr(part.text_start, part.text_length);
+        if (part.has_expression)
+            (*state.debug) << *value++;
+    }
+    (*state.debug) << "\n";
+}
+
+static bool lc3_break_eval(lc3_state& state, lc3_debug_info& info)
+{
+        lc3_compile_debug_info(state, info);
+
         int triggered = 0;
         try
         {
-            triggered = lc3_calculate(state, info.condition);
+            // Anything that did not compile is left to lc3_calculate to report.
+            if (info.condition_program.error == 0)
+                triggered = lc3_evaluate(state, info.condition_program);
+            else
+                triggered = lc3_calculate(state, info.condition);
         }
         catch (const LC3CalculateException& e)
         {
-            std::stringstream msg;
-            msg << info.target_string() << " name: " << info.name << " " << e.what() << "\nHalting processor.";
-            lc3_warning(state, msg.str());
-            state.halted = 1;
-            state.pc--;
-            return;
+            lc3_debug_error(state, info, e);
+            return false;
         }
 
         if (triggered)
@@ -245,59 +349,66 @@ void lc3_break_eval(lc3_state& state, lc3_debug_info& info)
             info.hit_count++;
 
             if (state.debug)
-                (*state.debug) << form_debug_message(state, info) << "\n";
+                lc3_write_debug_message(state, info);
 
             if (info.max_hits >= 0 && info.hit_count >= info.max_hits)
                 info.enabled = false;
         }
+
+        return triggered != 0;
 }
 
 
+static void lc3_break_mem_watchpoint(lc3_state& state, uint16_t addr)
+{
+    if (!lc3_test_address_bit(state.mem_watchpoint_bits, addr))
+        return;
+    const auto& watchpoint = state.mem_watchpoints.find(addr);
+    if (watchpoint != state.mem_watchpoints.end() && lc3_break_eval(state, watchpoint->second))
+        lc3_emit<lc3_event_id::WATCHPOINT>(state, watchpoint->second);
+}
+
+static void lc3_break_reg_watchpoint(lc3_state& state, uint16_t reg)
+{
+    if (reg > 7 || !((state.reg_watchpoint_bits >> reg) & 1))
+        return;
+    const auto& watchpoint = state.reg_watchpoints.find(reg);
+    if (watchpoint != state.reg_watchpoints.end() && lc3_break_eval(state, watchpoint->second))
+        lc3_emit<lc3_event_id::WATCHPOINT>(state, watchpoint->second);
+}
+
 bool lc3_break_test(lc3_state& state, const lc3_state_change* changes)
 {
     // Test for breakpoints
-    const auto& breakpoint = state.breakpoints.find(state.pc);
-    if (breakpoint != state.breakpoints.end())
-        lc3_break_eval(state, breakpoint->second);
+    if (lc3_test_address_bit(state.breakpoint_bits, state.pc))
+    {
+        const auto& breakpoint = state.breakpoints.find(state.pc);
+        if (breakpoint != state.breakpoints.end() && lc3_break_eval(state, breakpoint->second))
+            lc3_emit<lc3_event_id::BREAKPOINT>(state, breakpoint->second);
+    }
 
     // Test for watchpoints
     if (changes->changes == LC3_REGISTER_CHANGE)
     {
-        const auto& watchpoint = state.reg_watchpoints.find(changes->location);
-        if (watchpoint != state.reg_watchpoints.end())
-            lc3_break_eval(state, watchpoint->second);
+        lc3_break_reg_watchpoint(state, changes->location);
     }
     else if (changes->changes == LC3_MEMORY_CHANGE)
     {
-        const auto& watchpoint = state.mem_watchpoints.find(changes->location);
-        if (watchpoint != state.mem_watchpoints.end())
-            lc3_break_eval(state, watchpoint->second);
+        lc3_break_mem_watchpoint(state, changes->location);
     }
     else if (changes->changes == LC3_MULTI_CHANGE)
     {
         for (const auto& info : changes->info)
         {
             if (info.is_reg)
-            {
-                const auto& watchpoint = state.reg_watchpoints.find(info.location);
-                if (watchpoint != state.reg_watchpoints.end())
-                    lc3_break_eval(state, watchpoint->second);
-            }
+                lc3_break_reg_watchpoint(state, info.location);
             else
-            {
-                const auto& watchpoint = state.mem_watchpoints.find(info.location);
-                if (watchpoint != state.mem_watchpoints.end())
-                    lc3_break_eval(state, watchpoint->second);
-            }
+                lc3_break_mem_watchpoint(state, info.location);
         }
     }
 
     if (state.regs[7] != changes->r7)
-    {
-        const auto& watchpoint = state.reg_watchpoints.find(7);
-        if (watchpoint != state.reg_watchpoints.end())
-            lc3_break_eval(state, watchpoint->second);
-    }
+        lc3_break_reg_watchpoint(state, 7);
 
     return state.halted;
 }
@@ -0,0 +1,20 @@
+#include "lc3/lc3_event.hpp"
+
+#include <algorithm>
+
+void lc3_unsubscribe(lc3_state& state, lc3_event_id id)
+{
+    const auto index = static_cast<size_t>(id);
+    state.event_table[index].clear();
+    state.event_subscriptions &= ~(1U << index);
+}
+
+void lc3_unsubscribe(lc3_state& state, const lc3_subscription& subscription)
+{
+    const auto index = static_cast<size_t>(subscription.id);
+    auto& listeners = state.event_table[index];
+    listeners.erase(std::remove_if(listeners.begin(), listeners.end(),
+        [&subscription](const lc3_event_listener& listener) { return listener.serial == subscription.serial; }), listeners.end());
+    if (listeners.empty())
+        state.event_subscriptions &= ~(1U << index);
+}
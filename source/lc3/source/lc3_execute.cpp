@@ -1,8 +1,10 @@
 #include "lc3/lc3_execute.hpp"
 
 #include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 
+#include "lc3/lc3_event.hpp"
 #include "lc3/lc3_plugin.hpp"
 #include "lc3/lc3_runner.hpp"
 
@@ -27,10 +29,104 @@ const char* WARNING_MESSAGES[LC3_WARNINGS] =
     "W%03d: ""Executing interrupt vector table address x%04x.",
 };
 
-lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
+void lc3_decode(uint16_t data, lc3_decoded_instruction& decoded)
 {
     lc3_instruction instruction(data);
 
+    decoded.data = data;
+    decoded.opcode = instruction.opcode();
+    decoded.dr = instruction.dr();
+    decoded.sr1 = instruction.sr1();
+    decoded.sr2 = instruction.sr2();
+    decoded.flags = LC3_DECODED_VALID;
+    decoded.offset = 0;
+
+    if (lc3_check_malformed_instruction(instruction))
+        decoded.flags |= LC3_DECODED_MALFORMED;
+
+    switch(decoded.opcode)
+    {
+        case ADD_INSTR:
+        case AND_INSTR:
+            if (instruction.is_imm())
+            {
+                decoded.flags |= LC3_DECODED_IMM;
+                decoded.offset = instruction.imm5();
+            }
+            break;
+        case BR_INSTR:
+        case LD_INSTR:
+        case ST_INSTR:
+        case LDI_INSTR:
+        case STI_INSTR:
+        case LEA_INSTR:
+            decoded.offset = instruction.pc_offset9();
+            break;
+        case LDR_INSTR:
+        case STR_INSTR:
+            decoded.offset = instruction.offset6();
+            break;
+        case JSR_INSTR:
+            if (instruction.is_jsr())
+            {
+                decoded.flags |= LC3_DECODED_JSR;
+                decoded.offset = instruction.pc_offset11();
+            }
+            break;
+        case TRAP_INSTR:
+            decoded.offset = instruction.vector();
+            break;
+        default:
+            break;
+    }
+}
+
+const lc3_decoded_instruction& lc3_fetch(lc3_state& state, uint16_t addr)
+{
+    if (state.decode_cache.empty())
+        state.decode_cache.resize(0x10000);
+
+    // Entries are tagged with the data they were decoded from, so a write to memory by any means invalidates it.
+    lc3_decoded_instruction& decoded = state.decode_cache[addr];
+    const auto data = static_cast<uint16_t>(state.mem[addr]);
+    if (!(decoded.flags & LC3_DECODED_VALID) || decoded.data != data)
+        lc3_decode(data, decoded);
+
+    return decoded;
+}
+
+/** Emits the event for returning from the subroutine or trap in changes.
+  * Traps only know their address, so the vector is looked up in the trap vector table.
+  */
+static void lc3_emit_return(lc3_state& state, const lc3_state_change& changes, bool is_trap)
+{
+    if (!is_trap)
+    {
+        lc3_emit<lc3_event_id::EXIT_SUBROUTINE>(state, state.pc);
+        return;
+    }
+
+    uint8_t vector = 0;
+    for (uint16_t i = 0; i < 0x100; i++)
+    {
+        if (static_cast<uint16_t>(state.mem[i]) == changes.subroutine.address)
+        {
+            vector = static_cast<uint8_t>(i);
+            break;
+        }
+    }
+    lc3_emit<lc3_event_id::EXIT_TRAP>(state, vector);
+}
+
+lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
+{
+    lc3_decoded_instruction instruction;
+    lc3_decode(data, instruction);
+    return lc3_execute(state, instruction);
+}
+
+lc3_state_change lc3_execute(lc3_state& state, const lc3_decoded_instruction& instruction)
+{
     // Initialize Changes (We don't know everything yet)
     lc3_state_change changes;
     changes.pc = state.pc;
@@ -51,7 +147,7 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
     changes.subroutine.r6 = 0x0;
     changes.subroutine.is_trap = false;
 
-    if (state.strict_execution && lc3_check_malformed_instruction(instruction))
+    if (state.strict_execution && (instruction.flags & LC3_DECODED_MALFORMED))
     {
         state.halted = 1;
         state.pc--;
@@ -59,46 +155,47 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
         goto post_processing;
     }
 
-    switch(instruction.opcode())
+    switch(instruction.opcode)
     {
         case BR_INSTR:
-            if ((instruction.n() && state.n) || (instruction.z() && state.z) || (instruction.p() && state.p))
-                state.pc = state.pc + instruction.pc_offset9();
+            if (((instruction.dr & 4) && state.n) || ((instruction.dr & 2) && state.z) || ((instruction.dr & 1) && state.p))
+                state.pc = state.pc + instruction.offset;
             break;
         case ADD_INSTR:
             changes.changes = LC3_REGISTER_CHANGE;
-            changes.location = instruction.dr();
+            changes.location = instruction.dr;
             changes.value = state.regs[changes.location];
-            if (instruction.is_imm())
-                state.regs[changes.location] = state.regs[instruction.sr1()] + instruction.imm5();
+            if (instruction.flags & LC3_DECODED_IMM)
+                state.regs[changes.location] = state.regs[instruction.sr1] + instruction.offset;
             else
-                state.regs[changes.location] = state.regs[instruction.sr1()] + state.regs[instruction.sr2()];
+                state.regs[changes.location] = state.regs[instruction.sr1] + state.regs[instruction.sr2];
             lc3_setcc(state, state.regs[changes.location]);
             break;
         case LD_INSTR:
             changes.changes = LC3_REGISTER_CHANGE;
-            changes.location = instruction.dr();
+            changes.location = instruction.dr;
             changes.value = state.regs[changes.location];
 
-            state.regs[changes.location] = lc3_mem_read(state, state.pc + instruction.pc_offset9());
+            state.regs[changes.location] = lc3_mem_read(state, state.pc + instruction.offset);
             lc3_setcc(state, state.regs[changes.location]);
             break;
         case ST_INSTR:
             changes.changes = LC3_MEMORY_CHANGE;
-            changes.location = state.pc + instruction.pc_offset9();
+            changes.location = state.pc + instruction.offset;
             changes.value = state.mem[changes.location];
 
-            lc3_mem_write(state, changes.location, state.regs[instruction.dr()]);
+            lc3_mem_write(state, changes.location, state.regs[instruction.dr]);
             break;
         case JSR_INSTR:
             state.regs[0x7] = state.pc;
-            if (instruction.is_jsr())
-                state.pc += instruction.pc_offset11();
+            if (instruction.flags & LC3_DECODED_JSR)
+                state.pc += instruction.offset;
             // Special case you trash R7...
-            else if (instruction.base_r() == 0x7)
+            else if (instruction.sr1 == 0x7)
                 state.pc = changes.r7;
             else
-                state.pc = state.regs[instruction.base_r()];
+                state.pc = state.regs[instruction.sr1];
+            lc3_emit<lc3_event_id::SUBROUTINE>(state, state.pc);
 
             // Special bookeeping.
             // If not within an interrupt, then don't want to store subroutines within an interrupt.
@@ -118,7 +215,7 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
                         num_params = state.subroutines[state.pc].num_params;
                     for (int32_t i = 0; i < num_params; i++)
                     {
-                        call_info.params.push_back(state.mem[call_info.r6 + i]);
+                        call_info.params.push_back(state.mem[static_cast<uint16_t>(call_info.r6 + i)]);
                     }
 
            	        for (int32_t i = 0; i < 8; i++)
@@ -138,28 +235,28 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
             break;
         case AND_INSTR:
             changes.changes = LC3_REGISTER_CHANGE;
-            changes.location = instruction.dr();
+            changes.location = instruction.dr;
             changes.value = state.regs[changes.location];
-            if (instruction.is_imm())
-                state.regs[changes.location] = state.regs[instruction.sr1()] & instruction.imm5();
+            if (instruction.flags & LC3_DECODED_IMM)
+                state.regs[changes.location] = state.regs[instruction.sr1] & instruction.offset;
             else
-                state.regs[changes.location] = state.regs[instruction.sr1()] & state.regs[instruction.sr2()];
+                state.regs[changes.location] = state.regs[instruction.sr1] & state.regs[instruction.sr2];
             lc3_setcc(state, state.regs[changes.location]);
             break;
         case LDR_INSTR:
             changes.changes = LC3_REGISTER_CHANGE;
-            changes.location = instruction.dr();
+            changes.location = instruction.dr;
             changes.value = state.regs[changes.location];
 
-            state.regs[changes.location] = lc3_mem_read(state, state.regs[instruction.base_r()] + instruction.offset6());
+            state.regs[changes.location] = lc3_mem_read(state, state.regs[instruction.sr1] + instruction.offset);
             lc3_setcc(state, state.regs[changes.location]);
             break;
         case STR_INSTR:
             changes.changes = LC3_MEMORY_CHANGE;
-            changes.location = state.regs[instruction.base_r()] + instruction.offset6();
+            changes.location = state.regs[instruction.sr1] + instruction.offset;
             changes.value = state.mem[changes.location];
 
-            lc3_mem_write(state, changes.location, state.regs[instruction.dr()]);
+            lc3_mem_write(state, changes.location, state.regs[instruction.dr]);
             break;
         case RTI_INSTR:
             if (state.privilege)
@@ -182,8 +279,8 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
             {
                 const bool bits[8] = {0, 1, 1, 0, 1, 0, 0, 0};
                 // Pop PC and psr
-                state.pc = state.mem[state.regs[6]];
-                uint16_t psr = state.mem[state.regs[6] + 1];
+                state.pc = state.mem[static_cast<uint16_t>(state.regs[6])];
+                uint16_t psr = state.mem[static_cast<uint16_t>(state.regs[6] + 1)];
                 // Invalid PSR check, if the unspecified bits are filled or trying
                 // to set multiple nzp bits warn.
                 if ((psr & 0x78F8) != 0 || bits[psr & 7] != 1)
@@ -213,6 +310,7 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
 
                 if (in_interrupt)
                 {
+                    lc3_emit<lc3_event_id::EXIT_INTERRUPT>(state, static_cast<uint8_t>(state.interrupt_vector));
                     if (!state.interrupt_vector_stack.empty())
                     {
                         state.interrupt_vector = state.interrupt_vector_stack.back();
@@ -233,34 +331,36 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
                         changes.subroutine = state.call_stack.back();
                         state.call_stack.pop_back();
                     }
+                    if (state.event_subscriptions)
+                        lc3_emit_return(state, changes, true);
                 }
             }
             break;
         case NOT_INSTR:
             changes.changes = LC3_REGISTER_CHANGE;
-            changes.location = instruction.dr();
+            changes.location = instruction.dr;
             changes.value = state.regs[changes.location];
-            state.regs[changes.location] = ~state.regs[instruction.sr1()];
+            state.regs[changes.location] = ~state.regs[instruction.sr1];
             lc3_setcc(state, state.regs[changes.location]);
             break;
         case LDI_INSTR:
             changes.changes = LC3_REGISTER_CHANGE;
-            changes.location = instruction.dr();
+            changes.location = instruction.dr;
             changes.value = state.regs[changes.location];
 
-            state.regs[changes.location] = lc3_mem_read(state, lc3_mem_read(state, state.pc + instruction.pc_offset9()));
+            state.regs[changes.location] = lc3_mem_read(state, lc3_mem_read(state, state.pc + instruction.offset));
             lc3_setcc(state, state.regs[changes.location]);
             break;
         case STI_INSTR:
             changes.changes = LC3_MEMORY_CHANGE;
-            changes.location = lc3_mem_read(state, state.pc + instruction.pc_offset9());
+            changes.location = lc3_mem_read(state, state.pc + instruction.offset);
             changes.value = state.mem[changes.location];
 
-            lc3_mem_write(state, changes.location, state.regs[instruction.dr()]);
+            lc3_mem_write(state, changes.location, state.regs[instruction.dr]);
             break;
         case JMP_INSTR:
-            state.pc = state.regs[instruction.base_r()];
-            if (state.privilege && instruction.base_r() == 0x7)
+            state.pc = state.regs[instruction.sr1];
+            if (state.privilege && instruction.sr1 == 0x7)
             {
                 changes.changes = LC3_SUBROUTINE_END;
                 if (!state.call_stack.empty())
@@ -268,14 +368,16 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
                     changes.subroutine = state.call_stack.back();
                     state.call_stack.pop_back();
                 }
+                if (state.event_subscriptions)
+                    lc3_emit_return(state, changes, changes.subroutine.is_trap);
             }
             break;
         case LEA_INSTR:
             changes.changes = LC3_REGISTER_CHANGE;
-            changes.location = instruction.dr();
+            changes.location = instruction.dr;
             changes.value = state.regs[changes.location];
 
-            state.regs[changes.location] = state.pc + instruction.pc_offset9();
+            state.regs[changes.location] = state.pc + instruction.offset;
             // In the 2019 revision of LC-3 LEA no longer sets condition codes.
             if (state.lc3_version == 0)
                 lc3_setcc(state, state.regs[changes.location]);
@@ -288,17 +390,17 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
 
             // Return information is done via the stack in the lc3 revision and is handled in lc3_trap.
             // Execute the trap
-            lc3_trap(state, changes, instruction.vector());
+            lc3_trap(state, changes, static_cast<uint8_t>(instruction.offset));
             break;
         case ERROR_INSTR:
             if (state.instructionPlugin)
             {
                 // Success use it.
-                state.instructionPlugin->OnExecute(state, instruction, changes);
+                state.instructionPlugin->OnExecute(state, lc3_instruction(instruction.data), changes);
             }
             else
             {
-                lc3_warning(state, LC3_UNSUPPORTED_INSTRUCTION, instruction.bits());
+                lc3_warning(state, LC3_UNSUPPORTED_INSTRUCTION, instruction.data);
                 if (!state.true_traps)
                 {
                     state.halted = 1;
@@ -307,7 +409,7 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
             }
             break;
         default:
-            lc3_warning(state, LC3_UNSUPPORTED_INSTRUCTION, instruction.bits());
+            lc3_warning(state, LC3_UNSUPPORTED_INSTRUCTION, instruction.data);
             if (!state.true_traps)
             {
                 state.halted = 1;
@@ -331,6 +433,7 @@ lc3_state_change lc3_execute(lc3_state& state, uint16_t data)
 
 void lc3_trap(lc3_state& state, lc3_state_change& changes, uint8_t vector)
 {
+    lc3_emit<lc3_event_id::TRAP>(state, vector);
     if (state.privilege)
     {
         if (state.call_stack.empty() && state.in_lc3test && vector != TRAP_HALT)
@@ -397,11 +500,14 @@ void lc3_trap(lc3_state& state, lc3_state_change& changes, uint8_t vector)
                 changes.changes = LC3_REGISTER_CHANGE;
                 changes.location = 0;
                 changes.value = state.regs[0];
+                lc3_flush_output(state);
                 state.regs[0] = state.reader(state, *state.input);
+                if (state.regs[0] >= 0)
+                    lc3_emit<lc3_event_id::INPUT>(state, static_cast<uint8_t>(state.regs[0]));
                 break;
             case TRAP_OUT:
                 lc3_write_char(state, *state.output, state.regs[0]);
-                state.output->flush();
+                lc3_output_written(state, 1, state.regs[0] == '\n');
                 break;
             case TRAP_PUTS:
                 if ((r0 < 0x3000U || r0 >= 0xFE00U) && !kernel_mode)
@@ -410,24 +516,52 @@ void lc3_trap(lc3_state& state, lc3_state_change& changes, uint8_t vector)
                 }
                 else
                 {
+                    int32_t chars[256];
+                    size_t count = 0;
+                    uint32_t written = 0;
+                    bool newline = false;
                     while (state.mem[r0] != 0x0000)
                     {
-                        lc3_write_char(state,*state.output, state.mem[r0]);
+                        chars[count++] = state.mem[r0];
+                        newline |= state.mem[r0] == '\n';
                         r0++;
+                        if (count == 256)
+                        {
+                            lc3_write_chars(state, *state.output, chars, count);
+                            written += count;
+                            count = 0;
+                        }
+                    }
+                    lc3_write_chars(state, *state.output, chars, count);
+                    lc3_output_written(state, written + count, newline);
+                    if (lc3_is_subscribed(state, lc3_event_id::OUTPUT_STRING))
+                    {
+                        std::string str;
+                        for (uint16_t addr = state.regs[0]; state.mem[addr] != 0x0000; addr++)
+                            str.push_back(static_cast<char>(state.mem[addr]));
+                        lc3_emit<lc3_event_id::OUTPUT_STRING>(state, str);
                     }
-                    state.output->flush();
                 }
                 break;
             case TRAP_IN:
+            {
                 changes.changes = LC3_REGISTER_CHANGE;
                 changes.location = 0;
                 changes.value = state.regs[0];
-                lc3_write_str(state, state.writer, *state.output, "Input character: ");
+                const std::string prompt = "Input character: ";
+                lc3_write_str(state, state.writer, *state.output, prompt);
+                lc3_output_written(state, static_cast<uint32_t>(prompt.size()), false);
+                lc3_emit<lc3_event_id::OUTPUT_STRING>(state, prompt);
+                lc3_flush_output(state);
                 state.regs[0] = state.reader(state, *state.input);
+                if (state.regs[0] >= 0)
+                    lc3_emit<lc3_event_id::INPUT>(state, static_cast<uint8_t>(state.regs[0]));
                 // Don't call lc3_write_char since it will spit out a warning on non printable character
                 state.writer(state, *state.output, state.regs[0]);
-                state.output->flush();
+                lc3_output_written(state, 1, state.regs[0] == '\n');
+                lc3_emit<lc3_event_id::OUTPUT>(state, static_cast<char>(state.regs[0]));
                 break;
+            }
             case TRAP_PUTSP:
                 // PUTSP is considered in the appendix to be incorrect.
                 // Or at least every implementation I've seen writes it
@@ -440,22 +574,59 @@ void lc3_trap(lc3_state& state, lc3_state_change& changes, uint8_t vector)
                 else
                 {
                     bool putsp_should_stop = false;
+                    int32_t chars[256];
+                    size_t count = 0;
+                    uint32_t written = 0;
+                    bool newline = false;
+                    // Warnings have to come out after the characters before them.
+                    auto write_pending = [&]()
+                    {
+                        lc3_write_chars(state, *state.output, chars, count);
+                        written += count;
+                        count = 0;
+                    };
                     while (state.mem[r0] != 0x0000)
                     {
                         if (putsp_should_stop)
+                        {
+                            write_pending();
                             lc3_warning(state, LC3_PUTSP_UNEXPECTED_NUL, r0);
+                        }
                         uint16_t chunk = state.mem[r0];
                         if ((chunk & 0xFF) != 0)
-                            lc3_write_char(state, *state.output, chunk & 0xFF);
+                        {
+                            chars[count++] = chunk & 0xFF;
+                        }
                         else
+                        {
+                            write_pending();
                             lc3_warning(state, LC3_PUTSP_UNEXPECTED_NUL, r0);
+                        }
                         if ((chunk & 0xFF00) != 0)
-                            lc3_write_char(state, *state.output, (chunk >> 8) & 0xFF);
+                            chars[count++] = (chunk >> 8) & 0xFF;
                         else
                             putsp_should_stop = true;
+                        newline |= (chunk & 0xFF) == '\n' || (chunk >> 8) == '\n';
                         r0++;
+                        if (count >= 254)
+                            write_pending();
+                    }
+                    write_pending();
+                    lc3_output_written(state, written, newline);
+                    if (lc3_is_subscribed(state, lc3_event_id::OUTPUT_STRING))
+                    {
+                        std::string str;
+                        for (uint16_t addr = state.regs[0]; state.mem[addr] != 0x0000; addr++)
+                        {
+                            const uint16_t chunk = state.mem[addr];
+                            if ((chunk & 0xFF) != 0)
+                                str.push_back(static_cast<char>(chunk & 0xFF));
+                            if ((chunk & 0xFF00) == 0)
+                                break;
+                            str.push_back(static_cast<char>(chunk >> 8));
+                        }
+                        lc3_emit<lc3_event_id::OUTPUT_STRING>(state, str);
                     }
-                    state.output->flush();
                 }
 
                 break;
@@ -483,6 +654,9 @@ void lc3_trap(lc3_state& state, lc3_state_change& changes, uint8_t vector)
                 }
             }
         }
+
+        if (!state.halted)
+            lc3_emit<lc3_event_id::EXIT_TRAP>(state, vector);
     }
 }
 
@@ -495,8 +669,12 @@ void lc3_setcc(lc3_state& state, int16_t value)
 
 int16_t lc3_mem_read(lc3_state& state, uint16_t addr, bool privileged)
 {
-    state.memory_ops[addr].reads++;
-    state.total_reads++;
+    lc3_emit<lc3_event_id::MEMORY_READ>(state, addr);
+    if (state.memory_profiling)
+    {
+        state.memory_ops[addr].reads++;
+        state.total_reads++;
+    }
 
     // You are executing a trap if you are between 0x200 and 0x3000.
     bool kernel_mode = (state.pc >= 0x200 && state.pc < 0x3000) || (state.privilege == 0) || privileged;
@@ -510,6 +688,7 @@ int16_t lc3_mem_read(lc3_state& state, uint16_t addr, bool privileged)
             /// Unless the code polls from both status registers at the same time...
             if (lc3_random(state) % 16 < 5)
             {
+                lc3_flush_output(state);
                 int val = state.peek(state, *state.input);
                 if (val != -1)
                 {
@@ -521,8 +700,11 @@ int16_t lc3_mem_read(lc3_state& state, uint16_t addr, bool privileged)
         case DEV_KBDR:
             if (state.mem[DEV_KBSR]) // Will work if interrupts are enabled immediately available!
             {
+                lc3_flush_output(state);
                 state.mem[DEV_KBDR] = state.reader(state, *state.input); // In case of interrupt
                 state.mem[DEV_KBSR] &= 0x4000;
+                if (state.mem[DEV_KBDR] >= 0)
+                    lc3_emit<lc3_event_id::INPUT>(state, static_cast<uint8_t>(state.mem[DEV_KBDR]));
             }
             else
             {
@@ -548,8 +730,8 @@ int16_t lc3_mem_read(lc3_state& state, uint16_t addr, bool privileged)
                 state.mem[DEV_PSR] = lc3_psr(state);
             } else
             {
-                if (addr >= 0xFE00U && state.address_plugins.find(addr) != state.address_plugins.end())
-                    return state.address_plugins[addr]->OnRead(state, addr);
+                if (Plugin* plugin = lc3_address_plugin(state, addr))
+                    return plugin->OnRead(state, addr);
                 else if (!kernel_mode)
                     // Warn if reading from reserved memory if you aren't in kernel mode
                     lc3_warning(state, LC3_RESERVED_MEM_READ, addr);
@@ -560,8 +742,8 @@ int16_t lc3_mem_read(lc3_state& state, uint16_t addr, bool privileged)
             break;
         default:
             // Hey does a plugin handle this address
-            if (addr >= 0xFE00U && state.address_plugins.find(addr) != state.address_plugins.end())
-                return state.address_plugins[addr]->OnRead(state, addr);
+            if (Plugin* plugin = lc3_address_plugin(state, addr))
+                return plugin->OnRead(state, addr);
             else if (!kernel_mode)
                 // Warn if reading from reserved memory if you aren't in kernel mode
                 lc3_warning(state, LC3_RESERVED_MEM_READ, addr);
@@ -570,16 +752,31 @@ int16_t lc3_mem_read(lc3_state& state, uint16_t addr, bool privileged)
     }
 
     // Intercept if plugin registered for address.
-    if (state.address_plugins.find(addr) != state.address_plugins.end() && state.address_plugins[addr])
-            return state.address_plugins[addr]->OnRead(state, addr);
+    if (Plugin* plugin = lc3_address_plugin(state, addr))
+        return plugin->OnRead(state, addr);
 
     return state.mem[addr];
 }
 
 void lc3_mem_write(lc3_state& state, uint16_t addr, int16_t value, bool privileged)
 {
-    state.memory_ops[addr].writes++;
-    state.total_writes++;
+    lc3_emit<lc3_event_id::MEMORY_WRITE>(state, addr, value);
+    if (state.memory_profiling)
+    {
+        state.memory_ops[addr].writes++;
+        state.total_writes++;
+    }
+
+    // Track pages written to for checkpoints, only if enough of them trigger one.
+    if (state.checkpoint_dirty_pages != 0)
+    {
+        const uint64_t page_bit = 1ULL << ((addr >> 8) & 63);
+        if (!(state.dirty_pages[addr >> 14] & page_bit))
+        {
+            state.dirty_pages[addr >> 14] |= page_bit;
+            state.dirty_page_count++;
+        }
+    }
 
     // You are executing a trap if you are between 0x200 and 0x3000.
     bool kernel_mode = (state.pc >= 0x200 && state.pc < 0x3000) || (state.privilege == 0) || privileged;
@@ -604,7 +801,7 @@ void lc3_mem_write(lc3_state& state, uint16_t addr, int16_t value, bool privileg
             {
                 state.mem[DEV_DSR] = 0;
                 lc3_write_char(state, *state.output, value);
-                state.output->flush();
+                lc3_output_written(state, 1, value == '\n');
             }
             else
             {
@@ -616,8 +813,8 @@ void lc3_mem_write(lc3_state& state, uint16_t addr, int16_t value, bool privileg
                 lc3_warning(state, LC3_RESERVED_MEM_WRITE, addr);
                 /// TODO consider allowing writing to the PSR.
             } else {
-                if (addr >= 0xFE00U && state.address_plugins.find(addr) != state.address_plugins.end())
-                    state.address_plugins[addr]->OnWrite(state, addr, value);
+                if (Plugin* plugin = lc3_address_plugin(state, addr))
+                    plugin->OnWrite(state, addr, value);
                 else if (!kernel_mode)
                     lc3_warning(state, LC3_RESERVED_MEM_WRITE, value, addr);
             }
@@ -632,24 +829,43 @@ void lc3_mem_write(lc3_state& state, uint16_t addr, int16_t value, bool privileg
             break;
         default:
             // Hey does a plugin handle this address
-            if (addr >= 0xFE00U && state.address_plugins.find(addr) != state.address_plugins.end())
-                state.address_plugins[addr]->OnWrite(state, addr, value);
+            if (Plugin* plugin = lc3_address_plugin(state, addr))
+                plugin->OnWrite(state, addr, value);
             else if (!kernel_mode)
                 lc3_warning(state, LC3_RESERVED_MEM_WRITE, value, addr);
         }
     }
 
     // Intercept if plugin registered for address.
-    if (state.address_plugins.find(addr) != state.address_plugins.end() && state.address_plugins[addr])
-        return state.address_plugins[addr]->OnWrite(state, addr, value);
+    if (Plugin* plugin = lc3_address_plugin(state, addr))
+        return plugin->OnWrite(state, addr, value);
 
     state.mem[addr] = value;
 }
 
+static void lc3_print_warning(lc3_state& state, const std::string& msg)
+{
+    uint16_t addr = state.pc - 1;
+    std::string instr = lc3_disassemble(state, state.mem[addr]);
+
+    char warning[64];
+    snprintf(warning, sizeof(warning), "Warning at x%04x (instruction - ", addr);
+    (*state.warning) << warning << instr << "): " << msg << std::endl;
+}
+
 void lc3_warning(lc3_state& state, uint32_t warn_id, int16_t arg1, int16_t arg2)
 {
     state.warn_stats[warn_id] += 1;
 
+    lc3_warning_record& record = state.warning_log[state.warning_log_count++ % LC3_WARNING_LOG_SIZE];
+    record.id = warn_id;
+    record.executions = state.executions;
+    record.pc = state.pc;
+    record.instruction = state.mem[static_cast<uint16_t>(state.pc - 1)];
+    record.arg1 = arg1;
+    record.arg2 = arg2;
+    lc3_emit<lc3_event_id::WARNING>(state, static_cast<int32_t>(warn_id));
+
     if (state.true_traps)
     {
         // Trigger an exception for these warnings.
@@ -672,38 +888,47 @@ void lc3_warning(lc3_state& state, uint32_t warn_id, int16_t arg1, int16_t arg2)
         }
     }
 
-    if (state.warn_limits.find(warn_id) != state.warn_limits.end() && state.warn_limits[warn_id] <= state.warn_stats[warn_id])
+    // Only format text if somebody is going to read it.
+    if (state.warning == nullptr || state.warn_stats[warn_id] > state.warn_limits[warn_id])
     {
         // This happens in other overload that takes a message below.
         state.warnings++;
         return;
     }
 
-    char warning[128];
-    sprintf(warning, WARNING_MESSAGES[warn_id], warn_id, static_cast<uint16_t>(arg1), static_cast<uint16_t>(arg2));
-    std::string msg = warning;
-
-    lc3_warning(state, msg);
+    (*state.warning) << lc3_format_warning(state, record) << std::endl;
+    state.warnings++;
 
-    if (state.warn_limits.find(warn_id) != state.warn_limits.end() && state.warn_limits[warn_id] <= state.warn_stats[warn_id])
-    {
-        lc3_warning(state, "Limit for previous warning has been reached will no longer output messages of this type");
-        return;
-    }
+    if (state.warn_stats[warn_id] == state.warn_limits[warn_id])
+        lc3_print_warning(state, "Limit for previous warning has been reached will no longer output messages of this type");
 }
 
 void lc3_warning(lc3_state& state, const std::string& msg)
 {
-    char warning[256];
-    std::string message;
+    state.warnings++;
+    lc3_emit<lc3_event_id::WARNING>(state, -1);
+    if (state.warning != nullptr)
+        lc3_print_warning(state, msg);
+}
 
-    uint16_t addr = state.pc - 1;
-    std::string instr = lc3_disassemble(state, state.mem[addr]);
+std::string lc3_format_warning(lc3_state& state, const lc3_warning_record& record)
+{
+    uint16_t addr = record.pc - 1;
+    std::string instr = lc3_disassemble(state, record.instruction, record.pc);
 
-    sprintf(warning, "Warning at x%04x (instruction - %s): %s", addr, instr.c_str(), msg.c_str());
+    char message[128];
+    snprintf(message, sizeof(message), WARNING_MESSAGES[record.id], record.id, static_cast<uint16_t>(record.arg1), static_cast<uint16_t>(record.arg2));
+    char warning[64];
+    snprintf(warning, sizeof(warning), "Warning at x%04x (instruction - ", addr);
 
-    message = warning;
-    (*state.warning) << message << std::endl;
+    return warning + instr + "): " + message;
+}
 
-    state.warnings++;
+std::vector<lc3_warning_record> lc3_recent_warnings(const lc3_state& state)
+{
+    std::vector<lc3_warning_record> records;
+    const uint32_t count = std::min<uint32_t>(state.warning_log_count, LC3_WARNING_LOG_SIZE);
+    for (uint32_t i = state.warning_log_count - count; i != state.warning_log_count; i++)
+        records.push_back(state.warning_log[i % LC3_WARNING_LOG_SIZE]);
+    return records;
 }
@@ -1,6 +1,7 @@
 #include "lc3/lc3_expressions.hpp"
 
-#include <cassert>
+#include <algorithm>
+#include <cstdlib>
 #include <sstream>
 
 #include "lc3/ExpressionEvaluator.hpp"
@@ -8,104 +9,60 @@
 
 using namespace ExpressionEvaluator;
 
-static int lc3_get_symbol(const std::string& symbol, bool hasref, int ref, int& error);
+#define EXPRESSION_MAX_DEPTH 32
 
-static lc3_state* calc_state;
-
-int get_r0(bool hasref, int ref)
-{
-    if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(calc_state->regs[0] + ref)];
-    else
-        return calc_state->regs[0];
-}
-
-int get_r1(bool hasref, int ref)
-{
-    if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(calc_state->regs[1] + ref)];
-    else
-        return calc_state->regs[1];
-}
-
-int get_r2(bool hasref, int ref)
-{
-    if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(calc_state->regs[2] + ref)];
-    else
-        return calc_state->regs[2];
-}
-
-int get_r3(bool hasref, int ref)
-{
-    if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(calc_state->regs[3] + ref)];
-    else
-        return calc_state->regs[3];
-}
-
-int get_r4(bool hasref, int ref)
+namespace
 {
-    if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(calc_state->regs[4] + ref)];
-    else
-        return calc_state->regs[4];
-}
 
-int get_r5(bool hasref, int ref)
+enum
 {
-    if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(calc_state->regs[5] + ref)];
-    else
-        return calc_state->regs[5];
-}
-
-int get_r6(bool hasref, int ref)
+    // 0-7 are the registers.
+    BUILTIN_PC = 8,
+    BUILTIN_MEM = 9,
+    BUILTIN_NONE = -1,
+};
+
+/** Returns the register number, BUILTIN_PC or BUILTIN_MEM for symbols the evaluator defines, BUILTIN_NONE otherwise. */
+int lc3_builtin_symbol(const std::string& symbol)
 {
-    if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(calc_state->regs[6] + ref)];
-    else
-        return calc_state->regs[6];
+    if (symbol.size() == 2 && (symbol[0] == 'R' || symbol[0] == 'r') && symbol[1] >= '0' && symbol[1] <= '7')
+        return symbol[1] - '0';
+    if (symbol == "PC" || symbol == "pc")
+        return BUILTIN_PC;
+    if (symbol == "MEM" || symbol == "mem")
+        return BUILTIN_MEM;
+    return BUILTIN_NONE;
 }
 
-int get_r7(bool hasref, int ref)
+int lc3_resolve_symbol(lc3_state& state, const std::string& symbol, bool hasref, int ref, int& error)
 {
-    if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(calc_state->regs[7] + ref)];
+    const int builtin = lc3_builtin_symbol(symbol);
+    if (builtin == BUILTIN_MEM)
+        return state.mem[static_cast<uint16_t>(ref)];
+
+    int value;
+    if (builtin == BUILTIN_PC)
+        value = state.pc;
+    else if (builtin != BUILTIN_NONE)
+        value = state.regs[builtin];
     else
-        return calc_state->regs[7];
-}
+    {
+        int addr = lc3_sym_lookup(state, symbol);
+        if (addr == -1)
+        {
+            error = eval_undefinedsymbol;
+            return -1;
+        }
+        if (!hasref)
+            return static_cast<uint16_t>(addr);
+        value = addr;
+    }
 
-int get_pc(bool hasref, int ref)
-{
     if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(calc_state->pc + ref)];
-    else
-        return calc_state->pc;
+        return state.mem[static_cast<uint16_t>(value + ref)];
+    return value;
 }
 
-int get_mem(bool /*hasref*/, int ref)
-{
-    return calc_state->mem[static_cast<uint16_t>(ref)];
-}
-
-int lc3_get_symbol(const std::string& symbol, bool hasref, int ref, int& error)
-{
-    assert(calc_state != nullptr);
-
-    int addr = lc3_sym_lookup(*calc_state, symbol);
-
-    // No Symbol in LC3 symbol table error
-    if (addr == -1)
-        return -1;
-
-    // There isn't an error.
-    error = 0;
-
-    if (hasref)
-        return calc_state->mem[static_cast<uint16_t>(addr + ref)];
-    else
-        return static_cast<uint16_t>(addr);
 }
 
 LC3CalculateException::LC3CalculateException(std::string_view expr, unsigned int error_id) : expression(expr), id(error_id)
@@ -143,50 +100,206 @@ std::string LC3CalculateException::form_error_message() const noexcept
 }
 
 
-int lc3_calculate(lc3_state& state, std::string_view expr)
+namespace
 {
-    static int lazy_load = 1;
 
-    if (lazy_load)
+enum
+{
+    EXPRESSION_CONST = 0,   // Push value.
+    EXPRESSION_REG,         // Push register value.
+    EXPRESSION_PC,          // Push pc.
+    EXPRESSION_LOAD,        // Replace the top of the stack with mem[top].
+    EXPRESSION_OPERATOR,    // Apply operator value to the top two values.
+};
+
+/** Compiles expressions following the same rules as ExpressionEvaluator::Calculate. */
+struct expression_compiler
+{
+    lc3_state& state;
+    std::vector<lc3_expression_op>& code;
+    int depth = 0;
+    int max_depth = 0;
+
+    void emit(uint8_t opcode, int32_t value, int stack_change)
     {
-        lc3_init_eval();
-        OnUndefinedSymbol = lc3_get_symbol;
-        lazy_load = 0;
+        code.push_back(lc3_expression_op{opcode, value});
+        depth += stack_change;
+        max_depth = std::max(depth, max_depth);
     }
 
-    calc_state = &state;
+    int compile(std::string_view expr)
+    {
+        if (expr.empty())
+        {
+            emit(EXPRESSION_CONST, 0, 1);
+            return eval_ok;
+        }
+
+        std::string rpn;
+        int error = toRPN(expr, rpn);
+        if (error) return error;
+
+        const int base = depth;
+        const std::string_view tokens = rpn;
+        for (size_t i = 0; i < tokens.size(); i++)
+        {
+            if (isspace(tokens[i]))
+                continue;
+
+            int idx = isOperator(tokens.substr(i));
+            if (idx < 0)
+            {
+                int length = getToken(tokens.substr(i));
+                if (length == 0) return eval_invalidoperand;
+                error = compile_operand(std::string(tokens.substr(i, length)));
+                if (error) return error;
+                i += length - 1;
+            }
+            else
+            {
+                if (depth - base < 2) return eval_unbalanced;
+                emit(EXPRESSION_OPERATOR, idx, -1);
+                i += OperatorLength(idx) - 1;
+            }
+        }
+
+        return depth - base == 1 ? eval_ok : eval_evalerr;
+    }
 
-    int result = 0;
-    int error = Calculate(expr, result);
+    int compile_operand(const std::string& token)
+    {
+        // Handle numerals
+        char* errstr;
+        int d = strtol(token.c_str(), &errstr, 0);
+        if (!(*errstr))
+        {
+            emit(EXPRESSION_CONST, d, 1);
+            return eval_ok;
+        }
+        if (token[0] == 'x' || token[0] == 'X')
+        {
+            std::string hex = "0" + token;
+            d = strtol(hex.c_str(), &errstr, 0);
+            if (!(*errstr))
+            {
+                emit(EXPRESSION_CONST, d, 1);
+                return eval_ok;
+            }
+        }
+
+        // Same validation of references as ExpressionEvaluator::EvaluateOperand.
+        size_t begin = token.find('[');
+        size_t end = token.rfind(']');
+        if (begin == 0 || (end != std::string::npos && end != token.length() - 1) || !isalpha(token[0]) || begin + 1 == end)
+            return eval_malformedreference;
+
+        bool has_ref = begin != end && begin != std::string::npos;
+        if (has_ref)
+        {
+            int error = compile(std::string_view(token).substr(begin + 1, end - begin - 1));
+            if (error) return error;
+        }
+
+        const std::string symbol = token.substr(0, begin);
+        const int builtin = lc3_builtin_symbol(symbol);
+        if (builtin == BUILTIN_PC)
+        {
+            emit(EXPRESSION_PC, 0, 1);
+        }
+        else if (builtin == BUILTIN_MEM)
+        {
+            // MEM without a reference reads mem[-1] as get_mem does.
+            if (!has_ref)
+                emit(EXPRESSION_CONST, -1, 1);
+            emit(EXPRESSION_LOAD, 0, 0);
+            return eval_ok;
+        }
+        else if (builtin != BUILTIN_NONE)
+        {
+            emit(EXPRESSION_REG, builtin, 1);
+        }
+        else
+        {
+            int addr = lc3_sym_lookup(state, symbol);
+            if (addr == -1) return eval_undefinedsymbol;
+            emit(EXPRESSION_CONST, has_ref ? addr : static_cast<uint16_t>(addr), 1);
+        }
+
+        if (has_ref)
+        {
+            emit(EXPRESSION_OPERATOR, isOperator("+"), -1);
+            emit(EXPRESSION_LOAD, 0, 0);
+        }
+        return eval_ok;
+    }
+};
 
-    calc_state = nullptr;
+}
 
-    if (error)
-        throw LC3CalculateException(expr, error);
+int lc3_compile_expression(lc3_state& state, std::string_view expr, lc3_expression& program)
+{
+    program.source = expr;
+    program.code.clear();
+    program.symbol_generation = state.symbol_generation;
+
+    expression_compiler compiler{state, program.code};
+    program.error = compiler.compile(expr);
+    // Too complex to evaluate on a fixed size stack.
+    if (program.error == eval_ok && compiler.max_depth > EXPRESSION_MAX_DEPTH)
+        program.error = eval_evalerr;
+    if (program.error != eval_ok)
+        program.code.clear();
+    return program.error;
+}
 
-    return result;
+int lc3_evaluate(const lc3_state& state, const lc3_expression& program)
+{
+    if (program.error != eval_ok)
+        throw LC3CalculateException(program.source, program.error < 0 ? eval_evalerr : program.error);
+
+    int stack[EXPRESSION_MAX_DEPTH];
+    int top = -1;
+    for (const auto& op : program.code)
+    {
+        switch(op.opcode)
+        {
+            case EXPRESSION_CONST:
+                stack[++top] = op.value;
+                break;
+            case EXPRESSION_REG:
+                stack[++top] = state.regs[op.value];
+                break;
+            case EXPRESSION_PC:
+                stack[++top] = state.pc;
+                break;
+            case EXPRESSION_LOAD:
+                stack[top] = state.mem[static_cast<uint16_t>(stack[top])];
+                break;
+            case EXPRESSION_OPERATOR:
+                top--;
+                if (ApplyOperator(op.value, stack[top], stack[top + 1], stack[top]) != eval_ok)
+                    throw LC3CalculateException(program.source, eval_evalerr);
+                break;
+            default:
+                break;
+        }
+    }
+
+    return stack[0];
 }
 
-void lc3_init_eval()
+int lc3_calculate(lc3_state& state, std::string_view expr)
 {
-    symbol_table["R0"] =  {EVAL_FUNCTION, {get_r0}};
-    symbol_table["r0"] =  {EVAL_FUNCTION, {get_r0}};
-    symbol_table["R1"] =  {EVAL_FUNCTION, {get_r1}};
-    symbol_table["r1"] =  {EVAL_FUNCTION, {get_r1}};
-    symbol_table["R2"] =  {EVAL_FUNCTION, {get_r2}};
-    symbol_table["r2"] =  {EVAL_FUNCTION, {get_r2}};
-    symbol_table["R3"] =  {EVAL_FUNCTION, {get_r3}};
-    symbol_table["r3"] =  {EVAL_FUNCTION, {get_r3}};
-    symbol_table["R4"] =  {EVAL_FUNCTION, {get_r4}};
-    symbol_table["r4"] =  {EVAL_FUNCTION, {get_r4}};
-    symbol_table["R5"] =  {EVAL_FUNCTION, {get_r5}};
-    symbol_table["r5"] =  {EVAL_FUNCTION, {get_r5}};
-    symbol_table["R6"] =  {EVAL_FUNCTION, {get_r6}};
-    symbol_table["r6"] =  {EVAL_FUNCTION, {get_r6}};
-    symbol_table["R7"] =  {EVAL_FUNCTION, {get_r7}};
-    symbol_table["r7"] =  {EVAL_FUNCTION, {get_r7}};
-    symbol_table["PC"] =  {EVAL_FUNCTION, {get_pc}};
-    symbol_table["pc"] =  {EVAL_FUNCTION, {get_pc}};
-    symbol_table["MEM"] = {EVAL_FUNCTION, {get_mem}};
-    symbol_table["mem"] = {EVAL_FUNCTION, {get_mem}};
+    const SymbolResolver resolver = [&state](const std::string& symbol, bool hasref, int ref, int& error)
+    {
+        return lc3_resolve_symbol(state, symbol, hasref, ref, error);
+    };
+
+    int result = 0;
+    int error = Calculate(expr, result, resolver);
+
+    if (error)
+        throw LC3CalculateException(expr, error);
+
+    return result;
 }
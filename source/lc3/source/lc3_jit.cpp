@@ -0,0 +1,558 @@
+#include "lc3/lc3_jit.hpp"
+
+#include "lc3/lc3_block.hpp"
+#include "lc3/lc3_checkpoint.hpp"
+#include "lc3/lc3_execute.hpp"
+#include "lc3/lc3_runner.hpp"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define LC3_JIT_X86_64
+#endif
+
+#ifdef LC3_JIT_X86_64
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+// Size of each chunk of executable memory.
+#define LC3_JIT_CHUNK_SIZE (1 << 20)
+// Once this many chunks are in use all compiled code is thrown away.
+#define LC3_JIT_MAX_CHUNKS 16
+
+/** Where a compiled block stopped, filled in by the native code. */
+struct lc3_jit_exit
+{
+    uint16_t pc;
+    uint8_t nzp;
+    uint8_t mode;
+    uint32_t looped;        // Instructions executed by earlier iterations of a block that loops to itself.
+    uint32_t budget;        // Instructions left before the current iteration.
+};
+
+enum lc3_jit_exit_mode
+{
+    JIT_EXIT_NORMAL = 0,    // pc and nzp are in lc3_jit_exit.
+    JIT_EXIT_LOAD = 1,      // A load left the block, pc is in the state, nzp in lc3_jit_exit.
+    JIT_EXIT_STORE = 2,     // A store left the block, pc and nzp are in the state.
+};
+
+/** Signature of a compiled block, returns the number of instructions executed. */
+typedef uint32_t (*lc3_jit_function)(lc3_state* state, int16_t* regs, uint32_t nzp, lc3_jit_exit* exit, uint32_t privilege);
+
+struct lc3_jit_block
+{
+    uint32_t generation;    // lc3_block::generation of the translation this was compiled from.
+    int32_t lc3_version;
+    lc3_jit_function function;
+};
+
+class lc3_jit_cache
+{
+public:
+    lc3_jit_cache() = default;
+    ~lc3_jit_cache();
+    lc3_jit_cache(const lc3_jit_cache&) = delete;
+    lc3_jit_cache& operator=(const lc3_jit_cache&) = delete;
+
+    /** Gets the compiled code for a block, compiling it if needed. nullptr if out of executable memory. */
+    lc3_jit_function Get(const lc3_state& state, const lc3_block& block);
+
+private:
+    lc3_jit_function Install(const std::vector<uint8_t>& code);
+    void Clear();
+
+    std::unordered_map<uint16_t, lc3_jit_block> blocks;
+    std::vector<uint8_t*> chunks;
+    size_t used = LC3_JIT_CHUNK_SIZE;
+};
+
+/** Sync the parts of the state that memory accesses look at (kernel mode checks and exceptions). */
+static inline void lc3_jit_sync(lc3_state& state, uint32_t pc_nzp)
+{
+    state.pc = static_cast<uint16_t>(pc_nzp);
+    state.n = (pc_nzp >> 18) & 1;
+    state.z = (pc_nzp >> 17) & 1;
+    state.p = (pc_nzp >> 16) & 1;
+}
+
+// Loads return the value in the low 16 bits and whether to leave the block in bit 16.
+static uint32_t lc3_jit_load(lc3_state* state, uint32_t addr, uint32_t pc_nzp)
+{
+    lc3_jit_sync(*state, pc_nzp);
+    const auto value = static_cast<uint16_t>(lc3_mem_read(*state, static_cast<uint16_t>(addr)));
+    const bool leave = state->halted || state->pc != static_cast<uint16_t>(pc_nzp);
+    return value | (leave << 16);
+}
+
+static uint32_t lc3_jit_load_indirect(lc3_state* state, uint32_t addr, uint32_t pc_nzp)
+{
+    lc3_jit_sync(*state, pc_nzp);
+    const auto value = static_cast<uint16_t>(lc3_mem_read(*state, lc3_mem_read(*state, static_cast<uint16_t>(addr))));
+    const bool leave = state->halted || state->pc != static_cast<uint16_t>(pc_nzp);
+    return value | (leave << 16);
+}
+
+// Stores return nonzero to leave the block, block_range is the block address and its length in words.
+static uint32_t lc3_jit_store_done(lc3_state* state, uint16_t addr, uint32_t pc_nzp, uint32_t block_range)
+{
+    if (state->halted || state->pc != static_cast<uint16_t>(pc_nzp))
+        return 1;
+    // Self modifying code, remaining instructions may be stale.
+    return static_cast<uint16_t>(addr - static_cast<uint16_t>(block_range)) < (block_range >> 16);
+}
+
+static uint32_t lc3_jit_store(lc3_state* state, uint32_t addr, uint32_t value, uint32_t pc_nzp, uint32_t block_range)
+{
+    lc3_jit_sync(*state, pc_nzp);
+    lc3_mem_write(*state, static_cast<uint16_t>(addr), static_cast<int16_t>(value));
+    return lc3_jit_store_done(state, static_cast<uint16_t>(addr), pc_nzp, block_range);
+}
+
+static uint32_t lc3_jit_store_indirect(lc3_state* state, uint32_t addr, uint32_t value, uint32_t pc_nzp, uint32_t block_range)
+{
+    lc3_jit_sync(*state, pc_nzp);
+    const auto target = static_cast<uint16_t>(lc3_mem_read(*state, static_cast<uint16_t>(addr)));
+    lc3_mem_write(*state, target, static_cast<int16_t>(value));
+    return lc3_jit_store_done(state, target, pc_nzp, block_range);
+}
+
+/** Emits x86-64 machine code.
+  *
+  * Register assignments within a compiled block
+  * rbx = lc3_state*, r12 = regs, r13d = nzp (n = 4, z = 2, p = 1), r14 = lc3_jit_exit*, r15d = privilege.
+  */
+class lc3_jit_emitter
+{
+public:
+    std::vector<uint8_t> code;
+
+    void Bytes(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+    void Imm16(uint16_t value) { Bytes({static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8)}); }
+    void Imm32(uint32_t value) { Imm16(static_cast<uint16_t>(value)); Imm16(static_cast<uint16_t>(value >> 16)); }
+    void Imm64(uint64_t value) { Imm32(static_cast<uint32_t>(value)); Imm32(static_cast<uint32_t>(value >> 32)); }
+
+    void Prologue()
+    {
+        // push rbx, r12-r15 (also aligns the stack for calls)
+        Bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+        // mov rbx, rdi; mov r12, rsi; mov r13d, edx; mov r14, rcx; mov r15d, r8d
+        Bytes({0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0x41, 0x89, 0xD5, 0x49, 0x89, 0xCE, 0x45, 0x89, 0xC7});
+    }
+
+    /** Leaves the block with pc = ax when use_ax, otherwise pc. */
+    void Exit(uint16_t pc, bool use_ax, uint8_t mode, uint32_t count)
+    {
+        if (use_ax)
+            Bytes({0x66, 0x41, 0x89, 0x06});                // mov [r14], ax
+        else
+        {
+            Bytes({0x66, 0x41, 0xC7, 0x06});                // mov word [r14], imm16
+            Imm16(pc);
+        }
+        Bytes({0x45, 0x88, 0x6E, 0x02});                    // mov [r14 + 2], r13b
+        Bytes({0x41, 0xC6, 0x46, 0x03, mode});              // mov byte [r14 + 3], mode
+        Bytes({0xB8});                                      // mov eax, count
+        Imm32(count);
+        Bytes({0x41, 0x03, 0x46, 0x04});                    // add eax, [r14 + 4]
+        Bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+    }
+
+    // mov ax, regs[reg]
+    void LoadAx(uint8_t reg) { Bytes({0x66, 0x41, 0x8B, 0x44, 0x24, Disp(reg)}); }
+    // mov regs[reg], ax
+    void StoreAx(uint8_t reg) { Bytes({0x66, 0x41, 0x89, 0x44, 0x24, Disp(reg)}); }
+    // add/and ax, regs[reg]
+    void AddAx(uint8_t reg) { Bytes({0x66, 0x41, 0x03, 0x44, 0x24, Disp(reg)}); }
+    void AndAx(uint8_t reg) { Bytes({0x66, 0x41, 0x23, 0x44, 0x24, Disp(reg)}); }
+    // add/and/mov ax, imm16
+    void AddAxImm(int16_t value) { Bytes({0x66, 0x05}); Imm16(static_cast<uint16_t>(value)); }
+    void AndAxImm(int16_t value) { Bytes({0x66, 0x25}); Imm16(static_cast<uint16_t>(value)); }
+    void MovAxImm(int16_t value) { Bytes({0x66, 0xB8}); Imm16(static_cast<uint16_t>(value)); }
+    // not ax
+    void NotAx() { Bytes({0x66, 0xF7, 0xD0}); }
+    // mov word regs[reg], imm16
+    void StoreImm(uint8_t reg, int16_t value) { Bytes({0x66, 0x41, 0xC7, 0x44, 0x24, Disp(reg)}); Imm16(static_cast<uint16_t>(value)); }
+
+    /** Sets r13d to the condition codes of ax. */
+    void SetCC()
+    {
+        Bytes({0x66, 0x85, 0xC0});                          // test ax, ax
+        Bytes({0x41, 0xBD, 0x02, 0x00, 0x00, 0x00});        // mov r13d, 2
+        Bytes({0xB9, 0x04, 0x00, 0x00, 0x00});              // mov ecx, 4
+        Bytes({0x44, 0x0F, 0x48, 0xE9});                    // cmovs r13d, ecx
+        Bytes({0xB9, 0x01, 0x00, 0x00, 0x00});              // mov ecx, 1
+        Bytes({0x44, 0x0F, 0x4F, 0xE9});                    // cmovg r13d, ecx
+    }
+
+    // movzx esi, regs[reg]; add esi, imm32
+    void AddressEsi(uint8_t reg, int16_t offset)
+    {
+        Bytes({0x41, 0x0F, 0xB7, 0x74, 0x24, Disp(reg)});
+        Bytes({0x81, 0xC6});
+        Imm32(static_cast<uint32_t>(static_cast<int32_t>(offset)));
+    }
+    // mov esi, imm32
+    void AddressEsi(uint16_t addr) { Bytes({0xBE}); Imm32(addr); }
+    // movzx edx, regs[reg]
+    void ValueEdx(uint8_t reg) { Bytes({0x41, 0x0F, 0xB7, 0x54, 0x24, Disp(reg)}); }
+    // edx / ecx = nzp << 16 | pc
+    void PcNzpEdx(uint16_t pc) { Bytes({0x44, 0x89, 0xEA, 0xC1, 0xE2, 0x10, 0x81, 0xCA}); Imm32(pc); }
+    void PcNzpEcx(uint16_t pc) { Bytes({0x44, 0x89, 0xE9, 0xC1, 0xE1, 0x10, 0x81, 0xC9}); Imm32(pc); }
+    // mov r8d, imm32
+    void ImmR8d(uint32_t value) { Bytes({0x41, 0xB8}); Imm32(value); }
+
+    /** Calls a helper with the state as the first argument. */
+    template <typename Function>
+    void Call(Function function)
+    {
+        Bytes({0x48, 0x89, 0xDF});                          // mov rdi, rbx
+        Bytes({0x48, 0xB8});                                // mov rax, imm64
+        Imm64(reinterpret_cast<uint64_t>(function));
+        Bytes({0xFF, 0xD0});                                // call rax
+    }
+
+    /** Jumps back to the start of the block if there is enough budget for another count instructions. */
+    void Loop(size_t start, uint32_t count)
+    {
+        Bytes({0x41, 0x81, 0x46, 0x04});                    // add dword [r14 + 4], count
+        Imm32(count);
+        Bytes({0x41, 0x81, 0x6E, 0x08});                    // sub dword [r14 + 8], count
+        Imm32(count);
+        Bytes({0x41, 0x81, 0x7E, 0x08});                    // cmp dword [r14 + 8], count
+        Imm32(count);
+        Bytes({0x72, 0x05});                                // jb past the jmp
+        Bytes({0xE9});                                      // jmp start
+        Imm32(static_cast<uint32_t>(static_cast<int32_t>(start - (code.size() + 4))));
+    }
+
+    /** Emits a forward jump, returns the position to patch with Patch. */
+    size_t JumpIf(uint8_t opcode) { Bytes({opcode, 0x00}); return code.size(); }
+    void Patch(size_t position) { code[position - 1] = static_cast<uint8_t>(code.size() - position); }
+
+private:
+    static uint8_t Disp(uint8_t reg) { return static_cast<uint8_t>(reg * sizeof(int16_t)); }
+};
+
+#define JIT_JZ 0x74
+
+static void lc3_jit_compile(const lc3_state& state, const lc3_block& block, std::vector<uint8_t>& code)
+{
+    lc3_jit_emitter emit;
+    emit.Prologue();
+    const size_t start = emit.code.size();
+
+    const uint32_t block_range = block.address | (static_cast<uint32_t>(block.words.size()) << 16);
+    uint32_t count = 0;
+    for (const lc3_block_op& op : block.ops)
+    {
+        const auto next = static_cast<uint16_t>(block.address + count + 1);
+        size_t skip;
+        switch(op.handler)
+        {
+            case BLOCK_ADD_REG:
+            case BLOCK_AND_REG:
+                emit.LoadAx(op.sr1);
+                if (op.handler == BLOCK_ADD_REG)
+                    emit.AddAx(op.sr2);
+                else
+                    emit.AndAx(op.sr2);
+                emit.StoreAx(op.dr);
+                emit.SetCC();
+                break;
+            case BLOCK_ADD_IMM:
+            case BLOCK_AND_IMM:
+                emit.LoadAx(op.sr1);
+                if (op.handler == BLOCK_ADD_IMM)
+                    emit.AddAxImm(op.value);
+                else
+                    emit.AndAxImm(op.value);
+                emit.StoreAx(op.dr);
+                emit.SetCC();
+                break;
+            case BLOCK_NOT:
+                emit.LoadAx(op.sr1);
+                emit.NotAx();
+                emit.StoreAx(op.dr);
+                emit.SetCC();
+                break;
+            case BLOCK_LD:
+            case BLOCK_LDI:
+            case BLOCK_LDR:
+                if (op.handler == BLOCK_LDR)
+                    emit.AddressEsi(op.sr1, op.value);
+                else
+                    emit.AddressEsi(static_cast<uint16_t>(op.value));
+                emit.PcNzpEdx(next);
+                if (op.handler == BLOCK_LDI)
+                    emit.Call(lc3_jit_load_indirect);
+                else
+                    emit.Call(lc3_jit_load);
+                emit.StoreAx(op.dr);
+                emit.SetCC();
+                emit.Bytes({0xA9, 0x00, 0x00, 0x01, 0x00}); // test eax, 0x10000
+                skip = emit.JumpIf(JIT_JZ);
+                emit.Exit(0, false, JIT_EXIT_LOAD, count + 1);
+                emit.Patch(skip);
+                break;
+            case BLOCK_ST:
+            case BLOCK_STI:
+            case BLOCK_STR:
+                if (op.handler == BLOCK_STR)
+                    emit.AddressEsi(op.sr1, op.value);
+                else
+                    emit.AddressEsi(static_cast<uint16_t>(op.value));
+                emit.ValueEdx(op.dr);
+                emit.PcNzpEcx(next);
+                emit.ImmR8d(block_range);
+                if (op.handler == BLOCK_STI)
+                    emit.Call(lc3_jit_store_indirect);
+                else
+                    emit.Call(lc3_jit_store);
+                emit.Bytes({0x85, 0xC0});                   // test eax, eax
+                skip = emit.JumpIf(JIT_JZ);
+                emit.Exit(0, false, JIT_EXIT_STORE, count + 1);
+                emit.Patch(skip);
+                break;
+            case BLOCK_LEA:
+                emit.StoreImm(op.dr, op.value);
+                // In the 2019 revision of LC-3 LEA no longer sets condition codes.
+                if (state.lc3_version == 0)
+                {
+                    emit.MovAxImm(op.value);
+                    emit.SetCC();
+                }
+                break;
+            case BLOCK_BR:
+                if ((op.dr & 7) == 0)
+                {
+                    emit.Exit(next, false, JIT_EXIT_NORMAL, count + 1);
+                    break;
+                }
+                skip = 0;
+                if ((op.dr & 7) != 7)
+                {
+                    emit.Bytes({0x41, 0xF6, 0xC5, static_cast<uint8_t>(op.dr & 7)}); // test r13b, mask
+                    skip = emit.JumpIf(JIT_JZ);
+                }
+                // Tight loops stay in native code, anything stored into the block has already left it.
+                if (static_cast<uint16_t>(op.value) == block.address)
+                {
+                    emit.Loop(start, count + 1);
+                    emit.Exit(static_cast<uint16_t>(op.value), false, JIT_EXIT_NORMAL, 0);
+                }
+                else
+                    emit.Exit(static_cast<uint16_t>(op.value), false, JIT_EXIT_NORMAL, count + 1);
+                if (skip != 0)
+                {
+                    emit.Patch(skip);
+                    emit.Exit(next, false, JIT_EXIT_NORMAL, count + 1);
+                }
+                break;
+            case BLOCK_JMP:
+                // RET in user mode does call stack bookkeeping, leave it for lc3_step.
+                if (op.sr1 == 0x7)
+                {
+                    emit.Bytes({0x45, 0x85, 0xFF});         // test r15d, r15d
+                    skip = emit.JumpIf(JIT_JZ);
+                    emit.Exit(static_cast<uint16_t>(next - 1), false, JIT_EXIT_NORMAL, count);
+                    emit.Patch(skip);
+                }
+                emit.LoadAx(op.sr1);
+                emit.Exit(0, true, JIT_EXIT_NORMAL, count + 1);
+                break;
+            default:
+                break;
+        }
+        count++;
+    }
+
+    // Ran off the end of the block without a branch.
+    if (block.ops.empty() || (block.ops.back().handler != BLOCK_BR && block.ops.back().handler != BLOCK_JMP))
+        emit.Exit(static_cast<uint16_t>(block.address + count), false, JIT_EXIT_NORMAL, count);
+
+    code.swap(emit.code);
+}
+
+#undef JIT_JZ
+
+lc3_jit_cache::~lc3_jit_cache()
+{
+    for (uint8_t* chunk : chunks)
+        munmap(chunk, LC3_JIT_CHUNK_SIZE);
+}
+
+void lc3_jit_cache::Clear()
+{
+    blocks.clear();
+    for (size_t i = 1; i < chunks.size(); i++)
+        munmap(chunks[i], LC3_JIT_CHUNK_SIZE);
+    chunks.resize(std::min<size_t>(chunks.size(), 1));
+    used = chunks.empty() ? LC3_JIT_CHUNK_SIZE : 0;
+}
+
+lc3_jit_function lc3_jit_cache::Install(const std::vector<uint8_t>& code)
+{
+    if (code.size() > LC3_JIT_CHUNK_SIZE)
+        return nullptr;
+
+    if (used + code.size() > LC3_JIT_CHUNK_SIZE)
+    {
+        if (chunks.size() >= LC3_JIT_MAX_CHUNKS)
+            Clear();
+        if (used + code.size() > LC3_JIT_CHUNK_SIZE)
+        {
+            void* chunk = mmap(nullptr, LC3_JIT_CHUNK_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (chunk == MAP_FAILED)
+                return nullptr;
+            chunks.push_back(static_cast<uint8_t*>(chunk));
+            used = 0;
+        }
+    }
+
+    // Code is never writable and executable at the same time.
+    uint8_t* chunk = chunks.back();
+    if (mprotect(chunk, LC3_JIT_CHUNK_SIZE, PROT_READ | PROT_WRITE) != 0)
+        return nullptr;
+    uint8_t* function = chunk + used;
+    std::memcpy(function, code.data(), code.size());
+    if (mprotect(chunk, LC3_JIT_CHUNK_SIZE, PROT_READ | PROT_EXEC) != 0)
+        return nullptr;
+
+    // Keep functions 16 byte aligned.
+    used += (code.size() + 15) & ~static_cast<size_t>(15);
+    return reinterpret_cast<lc3_jit_function>(function);
+}
+
+lc3_jit_function lc3_jit_cache::Get(const lc3_state& state, const lc3_block& block)
+{
+    auto it = blocks.find(block.address);
+    if (it != blocks.end() && it->second.lc3_version == state.lc3_version && it->second.generation == block.generation)
+        return it->second.function;
+
+    std::vector<uint8_t> code;
+    lc3_jit_compile(state, block, code);
+    lc3_jit_function function = Install(code);
+    if (function == nullptr)
+        return nullptr;
+
+    // Install may have cleared the cache.
+    lc3_jit_block& compiled = blocks[block.address];
+    compiled.generation = block.generation;
+    compiled.lc3_version = state.lc3_version;
+    compiled.function = function;
+    return function;
+}
+
+/** Executes a compiled block, the block must start at the current PC. */
+static unsigned int lc3_jit_execute(lc3_state& state, lc3_jit_function function, unsigned int budget)
+{
+    lc3_jit_exit exit;
+    exit.looped = 0;
+    exit.budget = budget;
+    const uint32_t nzp = (state.n << 2) | (state.z << 1) | state.p;
+    const uint32_t executed = function(&state, state.regs, nzp, &exit, state.privilege);
+
+    if (exit.mode != JIT_EXIT_STORE)
+    {
+        state.n = (exit.nzp >> 2) & 1;
+        state.z = (exit.nzp >> 1) & 1;
+        state.p = exit.nzp & 1;
+    }
+    if (exit.mode == JIT_EXIT_NORMAL)
+        state.pc = exit.pc;
+
+    state.executions += executed;
+    return executed;
+}
+
+/** Like lc3_run_fast but executes native code for each block. */
+static unsigned int lc3_jit_run_fast(lc3_state& state, unsigned int num)
+{
+    if (!state.jit.cache)
+        state.jit.cache = std::make_shared<lc3_jit_cache>();
+
+    unsigned int i = 0;
+    while (i < num && !state.halted)
+    {
+        if (lc3_checkpoint_due(state))
+            lc3_save_checkpoint(state);
+
+        // Executing the TVT/IVT warns, let lc3_step handle it.
+        if (state.pc >= 0x200)
+        {
+            const lc3_block& block = lc3_fetch_block(state, state.pc);
+            const unsigned int limit = lc3_checkpoint_limit(state, num - i);
+            unsigned int executed = 0;
+            if (block.ops.size() > limit)
+                executed = lc3_execute_block(state, block, limit);
+            else if (!block.ops.empty())
+            {
+                lc3_jit_function function = state.jit.cache->Get(state, block);
+                executed = function != nullptr ? lc3_jit_execute(state, function, limit) : lc3_execute_block(state, block, limit);
+            }
+
+            if (executed != 0)
+            {
+                i += executed;
+                continue;
+            }
+        }
+
+        // JSR, RTI, TRAP, plugin instructions and anything needing a warning take the long way.
+        lc3_step(state);
+        i++;
+        if (!lc3_can_run_fast(state))
+            break;
+    }
+
+    return i;
+}
+
+bool lc3_jit_supported()
+{
+    return true;
+}
+
+#else
+
+class lc3_jit_cache
+{
+};
+
+static unsigned int lc3_jit_run_fast(lc3_state& state, unsigned int num)
+{
+    return lc3_run_fast(state, num);
+}
+
+bool lc3_jit_supported()
+{
+    return false;
+}
+
+#endif
+
+void lc3_run_jit(lc3_state& state, unsigned int num)
+{
+    unsigned int i = 0;
+    while (i < num && !state.halted)
+    {
+        if (lc3_can_run_fast(state))
+        {
+            i += lc3_jit_run_fast(state, num - i);
+            continue;
+        }
+        lc3_step(state);
+        i++;
+    }
+
+    lc3_flush_output(state);
+}
+
+void lc3_jit_reset(lc3_state& state)
+{
+    state.jit.cache.reset();
+}
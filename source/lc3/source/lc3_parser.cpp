@@ -38,6 +38,29 @@ void remove_comments(std::string& line, std::string& comment)
     line.resize(word ? width : 0);
 }
 
+/** split_comment
+  *
+  * Returns the code on a line, the same as remove_comments leaves, and points comment at the rest.
+  */
+std::string_view split_comment(std::string_view line, std::string_view& comment)
+{
+    size_t width = 0;
+    bool word = false;
+    for (const auto& c : line)
+    {
+        if (c == ';' || c == '\n' || c == '\r')
+            break;
+        if (isalpha(c))
+            word = true;
+        width++;
+    }
+
+    size_t comment_begin = line.find(';');
+    if (comment_begin != std::string_view::npos)
+        comment = line.substr(comment_begin);
+    return line.substr(0, word ? width : 0);
+}
+
 /** trim
   *
   * Removes all whitespace from beginning and end.
@@ -53,6 +76,20 @@ void trim(std::string& line)
         line = line.substr(start, end - start + 1);
 }
 
+/** trim_view
+  *
+  * Returns the view without whitespace at the beginning and end.
+  */
+std::string_view trim_view(std::string_view line)
+{
+    size_t start = line.find_first_not_of("\t ");
+    size_t end = line.find_last_not_of("\t ");
+
+    if (start == std::string_view::npos)
+        return line.substr(0, 0);
+    return line.substr(start, end - start + 1);
+}
+
 std::string process_str(const std::string& str, const LC3AssembleContext& context)
 {
     if (str[0] != '"' && str[0] != '\'')
@@ -425,14 +462,14 @@ int16_t check_value(int64_t value, int bits, bool is_num, bool signed_check, con
         if (!value) value++;
         // Calculate number of bits remember this calculation is for 2's complement
         gbitstr << static_cast<int>(log2(std::abs(value)) + 2);
-        params.push_back(context.tokens[context.tokens.size() - 1]);
+        params.emplace_back(context.tokens[context.tokens.size() - 1]);
         params.push_back(ebitstr.str());
         params.push_back(gbitstr.str());
         THROW(LC3AssembleException(context.line, params, is_num ? NUMBER_OVERFLOW : OFFSET_OVERFLOW, context.lineno));
     }
     else if (!signed_check && value < 0)
     {
-        THROW(LC3AssembleException(context.line, context.tokens[context.tokens.size() - 1], INVALID_NUMBER, context.lineno));
+        THROW(LC3AssembleException(context.line, std::string(context.tokens[context.tokens.size() - 1]), INVALID_NUMBER, context.lineno));
     }
     else if (!signed_check && (value > (max + 1) << 1))
     {
@@ -445,7 +482,7 @@ int16_t check_value(int64_t value, int bits, bool is_num, bool signed_check, con
         if (!value) value++;
 
         gbitstr << static_cast<int>(log2(std::abs(value)) + 1);
-        params.push_back(context.tokens[context.tokens.size() - 1]);
+        params.emplace_back(context.tokens[context.tokens.size() - 1]);
         params.push_back(ebitstr.str());
         params.push_back(gbitstr.str());
         THROW(LC3AssembleException(context.line, params, is_num ? NUMBER_OVERFLOW : OFFSET_OVERFLOW, context.lineno));
@@ -649,6 +686,23 @@ void tokenize(const std::string& str, std::vector<std::string>& tokens, const st
     }
 }
 
+/** tokenize
+  *
+  * Tokenizes a string the same way into views of it, the string must outlive the tokens.
+  */
+void tokenize(std::string_view str, std::vector<std::string_view>& tokens, std::string_view delimiters)
+{
+    size_t lastPos = str.find_first_not_of(delimiters, 0);
+    size_t pos = str.find_first_of(delimiters, lastPos);
+
+    while (std::string_view::npos != pos || std::string_view::npos != lastPos)
+    {
+        tokens.push_back(str.substr(lastPos, pos - lastPos));
+        lastPos = str.find_first_not_of(delimiters, pos);
+        pos = str.find_first_of(delimiters, lastPos);
+    }
+}
+
 bool is_hex(const std::string& str)
 {
     if (str.size() < 2 || str[0] != 'x')
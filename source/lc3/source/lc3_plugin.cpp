@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <dlfcn.h>
+#include <functional>
+#include <limits>
 #include <sstream>
 
 // Ugh macros that expand to gnu_dev_major/minor.  Undefined!
@@ -57,6 +59,36 @@ void Plugin::BindInterrupt(unsigned char int_vector)
     interrupts.insert(int_vector);
 }
 
+void Plugin::ScheduleEvery(uint64_t instructions, unsigned int _hooks)
+{
+    hooks = _hooks;
+    interval = std::max<uint64_t>(instructions, 1);
+}
+
+void Plugin::ScheduleAt(uint64_t executions, unsigned int _hooks)
+{
+    hooks = _hooks;
+    interval = 0;
+    deadline = executions;
+}
+
+void Plugin::ScheduleNever()
+{
+    hooks = PLUGIN_HOOK_NONE;
+}
+
+uint64_t Plugin::NextRun(uint64_t executions)
+{
+    generation++;
+    if (hooks == PLUGIN_HOOK_NONE)
+        return std::numeric_limits<uint64_t>::max();
+    // One shot, already ran or was scheduled in the past.
+    if (interval == 0)
+        return deadline >= executions ? deadline : std::numeric_limits<uint64_t>::max();
+    deadline = executions + interval - 1;
+    return deadline;
+}
+
 TrapFunctionPlugin::TrapFunctionPlugin(unsigned int _major, unsigned int _minor, const std::string& desc, unsigned char _vector) :
     Plugin(_major, _minor, LC3_TRAP, desc), vector(_vector)
 {
@@ -154,6 +186,7 @@ void lc3_install_plugin(lc3_state& state, const std::string& filename, const std
         }
         state.address_plugins[address] = plugin;
     }
+    lc3_index_address_plugins(state);
 
     TrapFunctionPlugin* tfplugin;
 
@@ -193,6 +226,7 @@ void lc3_install_plugin(lc3_state& state, const std::string& filename, const std
     }
     // Register
     state.filePlugin[filename] = infos;
+    lc3_schedule_plugin(state, plugin);
 }
 
 bool lc3_uninstall_plugin(lc3_state& state, const std::string& filename)
@@ -222,12 +256,56 @@ bool lc3_uninstall_plugin(lc3_state& state, const std::string& filename)
 
     for (const auto& address : infos.plugin->GetBoundAddresses())
         state.address_plugins.erase(address);
+    lc3_index_address_plugins(state);
 
     infos.destroy(infos.plugin);
 
     dlclose(infos.handle);
 
     state.filePlugin.erase(filename);
+    lc3_schedule_plugins(state);
 
     return true;
 }
+
+void lc3_index_address_plugins(lc3_state& state)
+{
+    state.device_plugins.fill(nullptr);
+    state.address_plugin_pages.fill(0);
+
+    // Reserved addresses are nullptr, those are handled by lc3_mem_read / lc3_mem_write.
+    for (const auto& address_plugin : state.address_plugins)
+    {
+        if (address_plugin.second == nullptr)
+            continue;
+        const uint16_t address = address_plugin.first;
+        if (address >= 0xFE00U)
+            state.device_plugins[address - 0xFE00U] = address_plugin.second;
+        state.address_plugin_pages[address >> 14] |= 1ULL << ((address >> 8) & 63);
+    }
+}
+
+void lc3_schedule_plugins(lc3_state& state)
+{
+    state.plugin_schedule.clear();
+    state.plugins_due.clear();
+    state.plugin_schedule_executions = state.executions;
+
+    if (state.instructionPlugin != nullptr)
+        lc3_schedule_plugin(state, state.instructionPlugin);
+    for (const auto& vector_plugin : state.trapPlugins)
+        if (vector_plugin.second != nullptr)
+            lc3_schedule_plugin(state, vector_plugin.second);
+    for (auto* plugin : state.plugins)
+        lc3_schedule_plugin(state, plugin);
+}
+
+void lc3_schedule_plugin(lc3_state& state, Plugin* plugin)
+{
+    // Any entry already in the heap becomes stale.
+    const uint64_t executions = plugin->NextRun(state.executions);
+    if (executions == std::numeric_limits<uint64_t>::max())
+        return;
+    state.plugin_schedule.push_back(lc3_plugin_deadline{executions, plugin->GetScheduleGeneration(), plugin});
+    std::push_heap(state.plugin_schedule.begin(), state.plugin_schedule.end(), std::greater<lc3_plugin_deadline>());
+}
@@ -0,0 +1,69 @@
+#include "lc3/lc3_profile.hpp"
+
+#include <algorithm>
+
+void lc3_set_memory_profiling(lc3_state& state, bool enable)
+{
+    if (enable && state.memory_ops.empty())
+        state.memory_ops.resize(0x10000);
+    state.memory_profiling = enable;
+}
+
+void lc3_reset_memory_profile(lc3_state& state)
+{
+    std::fill(state.memory_ops.begin(), state.memory_ops.end(), lc3_memory_stats());
+    state.total_reads = 0;
+    state.total_writes = 0;
+}
+
+std::vector<lc3_memory_range> lc3_memory_heatmap(const lc3_state& state, uint32_t range_size)
+{
+    std::vector<lc3_memory_range> ranges;
+    if (range_size == 0)
+        return ranges;
+
+    for (uint32_t start = 0; start < state.memory_ops.size(); start += range_size)
+    {
+        const uint32_t end = std::min<uint32_t>(start + range_size, state.memory_ops.size());
+        lc3_memory_range range;
+        range.start = static_cast<uint16_t>(start);
+        range.end = static_cast<uint16_t>(end - 1);
+        for (uint32_t addr = start; addr < end; addr++)
+        {
+            range.reads += state.memory_ops[addr].reads;
+            range.writes += state.memory_ops[addr].writes;
+        }
+        if (range.reads != 0 || range.writes != 0)
+            ranges.push_back(range);
+    }
+
+    return ranges;
+}
+
+std::vector<lc3_memory_range> lc3_memory_hotspots(const lc3_state& state, size_t count)
+{
+    std::vector<lc3_memory_range> addresses;
+    for (uint32_t addr = 0; addr < state.memory_ops.size(); addr++)
+    {
+        const lc3_memory_stats& stats = state.memory_ops[addr];
+        if (stats.reads == 0 && stats.writes == 0)
+            continue;
+        lc3_memory_range range;
+        range.start = range.end = static_cast<uint16_t>(addr);
+        range.reads = stats.reads;
+        range.writes = stats.writes;
+        addresses.push_back(range);
+    }
+
+    count = std::min(count, addresses.size());
+    // Ties are broken by address so results are reproducible.
+    std::partial_sort(addresses.begin(), addresses.begin() + count, addresses.end(),
+        [](const lc3_memory_range& a, const lc3_memory_range& b)
+        {
+            const uint64_t a_total = a.reads + a.writes;
+            const uint64_t b_total = b.reads + b.writes;
+            return a_total != b_total ? a_total > b_total : a.start < b.start;
+        });
+    addresses.resize(count);
+    return addresses;
+}
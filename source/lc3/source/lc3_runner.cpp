@@ -6,10 +6,14 @@
 #include <iostream>
 #include <istream>
 
+#include "lc3/lc3_block.hpp"
+#include "lc3/lc3_checkpoint.hpp"
 #include "lc3/lc3_debug.hpp"
+#include "lc3/lc3_event.hpp"
 #include "lc3/lc3_execute.hpp"
 #include "lc3/lc3_os.hpp"
 #include "lc3/lc3_plugin.hpp"
+#include "lc3/lc3_trace.hpp"
 
 void lc3_run(lc3_state& state, unsigned int num)
 {
@@ -17,11 +21,68 @@ void lc3_run(lc3_state& state, unsigned int num)
     // Do this num times or until halted.
     while (i < num && !state.halted)
     {
+        // Nothing is watching each individual step, so run as many instructions as we can in one go.
+        if (lc3_can_run_fast(state))
+        {
+            i += lc3_run_fast(state, num - i);
+            continue;
+        }
         // Step one instruction
         lc3_step(state);
         // Increment instruction count
         i++;
     }
+
+    lc3_flush_output(state);
+}
+
+bool lc3_can_run_fast(const lc3_state& state)
+{
+    if (state.trace != nullptr || state.binary_trace != nullptr || state.max_stack_size != 0 || state.interrupt_enabled)
+        return false;
+    if (!state.breakpoints.empty() || !state.mem_watchpoints.empty() || !state.reg_watchpoints.empty())
+        return false;
+    // Plugins that don't want OnTick/OnTock called aren't in the schedule.
+    if (state.instructionPlugin != nullptr || !state.plugin_schedule.empty())
+        return false;
+    // Reserved slots are filled with nullptr by lc3_remove_plugins.
+    for (const auto& vector_plugin : state.trapPlugins)
+        if (vector_plugin.second != nullptr)
+            return false;
+    for (const auto page_bits : state.address_plugin_pages)
+        if (page_bits != 0)
+            return false;
+    return true;
+}
+
+unsigned int lc3_run_fast(lc3_state& state, unsigned int num)
+{
+    unsigned int i = 0;
+    while (i < num && !state.halted)
+    {
+        if (lc3_checkpoint_due(state))
+            lc3_save_checkpoint(state);
+
+        // Executing the TVT/IVT warns, let lc3_step handle it.
+        if (state.pc >= 0x200)
+        {
+            const lc3_block& block = lc3_fetch_block(state, state.pc);
+            unsigned int executed = lc3_execute_block(state, block, lc3_checkpoint_limit(state, num - i));
+            if (executed != 0)
+            {
+                i += executed;
+                continue;
+            }
+        }
+
+        // JSR, RTI, TRAP, plugin instructions and anything needing a warning take the long way.
+        lc3_step(state);
+        i++;
+        if (!lc3_can_run_fast(state))
+            break;
+    }
+
+    return i;
 }
 
 void lc3_step(lc3_state& state)
@@ -29,13 +90,19 @@ void lc3_step(lc3_state& state)
     // If we are halted then don't step.
     if (state.halted) return;
 
+    // Checkpoints are taken between instructions, after any interrupt was processed.
+    if (lc3_checkpoint_due(state))
+        lc3_save_checkpoint(state);
+
     if (state.trace != nullptr)
         lc3_trace(state);
+    if (state.binary_trace != nullptr)
+        state.binary_trace->begin_step(state);
 
     // Tick all plugins
     lc3_tick_plugins(state);
     // Fetch Instruction
-    uint16_t data = state.mem[state.pc];
+    const lc3_decoded_instruction instruction = lc3_fetch(state, state.pc);
 
     // Warn if executing TVT/IVT
     if (state.pc <= 0xFF)
@@ -46,26 +113,26 @@ void lc3_step(lc3_state& state)
     // Increment PC
     state.pc++;
     // Execute Instruction
-    const lc3_state_change change = lc3_execute(state, data);
+    const lc3_state_change change = lc3_execute(state, instruction);
 
     // Increment executions
     state.executions++;
 
+    if (state.binary_trace != nullptr)
+        state.binary_trace->end_step(state, change);
+
     if (state.max_stack_size != 0)
     {
         // If the change is INTERRUPT END
         if (change.changes == LC3_INTERRUPT_END)
         {
             // After you've scrubbed all of the floors in hyrule (remove all instructions that have been added except the LC3_INTERRUPT change.
-            lc3_state_change* hmm = &state.undo_stack.back();
-            while (hmm->changes != LC3_INTERRUPT_BEGIN)
-            {
+            // The LC3_INTERRUPT_BEGIN change itself may have been discarded if the undo stack ran out of memory.
+            while (!state.undo_stack.empty() && state.undo_stack.back().changes != LC3_INTERRUPT_BEGIN)
                 state.undo_stack.pop_back();
-                hmm = &state.undo_stack.back();
-            }
             // Please sire have mercy (Change LC3_INTERRUPT_BEGIN to LC3_INTERRUPT to signal a completed interrupt)
-            lc3_state_change& lib = state.undo_stack.back();
-            lib.changes = LC3_INTERRUPT;
+            if (!state.undo_stack.empty())
+                state.undo_stack.set_back_changes(LC3_INTERRUPT);
         }
         else
         {
@@ -82,7 +149,11 @@ void lc3_step(lc3_state& state)
     lc3_tock_plugins(state);
 
     // If we hit an error or a halt instruction return. no need to do any breakpoint tests.
-    if (state.halted) return;
+    if (state.halted)
+    {
+        lc3_flush_output(state);
+        return;
+    }
     // Breakpoint test
     lc3_break_test(state, &change);
 
@@ -112,7 +183,7 @@ void lc3_back(lc3_state& state)
     // If there are no changes in the stack we are done
     if (state.undo_stack.empty()) return;
     // Pop Changes from state
-    lc3_state_change& changes = state.undo_stack.back();
+    const lc3_state_change changes = state.undo_stack.back();
     // Will not allow to backstep out of running interrupt.
     if (changes.changes == LC3_INTERRUPT_BEGIN) return;
 
@@ -191,6 +262,10 @@ void lc3_back(lc3_state& state)
         state.executions = changes.executions;
 
     state.undo_stack.pop_back();
+
+    // Checkpoints after this point may no longer match.
+    if (!state.checkpoints.empty() && state.checkpoints.back().executions > state.executions)
+        lc3_discard_checkpoints(state);
 }
 
 void lc3_rewind(lc3_state& state, unsigned int num)
@@ -199,8 +274,7 @@ void lc3_rewind(lc3_state& state, unsigned int num)
     // Do this num times or until no more changes or until we aren't able.
     while (!state.undo_stack.empty() && num > 0 && !interrupt_begin)
     {
-        lc3_state_change& last = state.undo_stack.back();
-        interrupt_begin = (last.changes == LC3_INTERRUPT_BEGIN);
+        interrupt_begin = (state.undo_stack.back().changes == LC3_INTERRUPT_BEGIN);
         // Backstep
         lc3_back(state);
         num--;
@@ -232,7 +306,7 @@ int lc3_next_line(lc3_state& state, unsigned int num, int depth)
         lc3_step(state);
 
         // If we got interrupted
-        if (state.interrupt_enabled && state.undo_stack.back().changes == LC3_INTERRUPT_BEGIN)
+        if (state.interrupt_enabled && !state.undo_stack.empty() && state.undo_stack.back().changes == LC3_INTERRUPT_BEGIN)
             depth++;
 
         if (i >= num && depth != 0)
@@ -252,17 +326,13 @@ int lc3_prev_line(lc3_state& state, unsigned int num, int depth)
 
         if (!state.undo_stack.empty())
         {
-            lc3_state_change& last = state.undo_stack.back();
             // Can't backstep through interrupt
-            if (last.changes == LC3_INTERRUPT_BEGIN)
+            if (state.undo_stack.back().changes == LC3_INTERRUPT_BEGIN)
                 return -1;
 
             // Get rid of all processed interrupts.
-            while (last.changes == LC3_INTERRUPT && !state.undo_stack.empty())
-            {
+            while (!state.undo_stack.empty() && state.undo_stack.back().changes == LC3_INTERRUPT)
                 lc3_back(state);
-                last = state.undo_stack.back();
-            }
         }
 
         // Execute (Have to do this first you can't assume mem[pc - 1] was the last
@@ -297,8 +367,9 @@ void lc3_do_interrupt(lc3_state& state, int priority, int vector)
     // push PSR&PC to STACK
     int psr = lc3_psr(state);
     state.regs[6] -= 2;
-    state.mem[state.regs[6] + 1] = static_cast<int16_t>(psr);
-    state.mem[state.regs[6]] = static_cast<int16_t>(state.pc);
+    state.mem[static_cast<uint16_t>(state.regs[6] + 1)] = static_cast<int16_t>(psr);
+    state.mem[static_cast<uint16_t>(state.regs[6])] = static_cast<int16_t>(state.pc);
+    lc3_emit<lc3_event_id::INTERRUPT>(state, static_cast<uint8_t>(vector));
 
     // Set up new PSR
     state.privilege = 0;
@@ -316,38 +387,42 @@ void lc3_do_interrupt(lc3_state& state, int priority, int vector)
 
 bool lc3_interrupt(lc3_state& state)
 {
+    lc3_interrupt_set& interrupts = state.interrupts;
     // No interrupts? return.
-    if (state.interrupts.empty()) return false;
-
-    int my_priority = state.priority;
-    int max_priority = -1;
-    int max_vector = -1;
+    if (interrupts.empty()) return false;
 
-    // Try to find a interrupt with higher priority
-    auto max_pos = state.interrupts.begin();
-    for (auto i = state.interrupts.begin(); i != state.interrupts.end(); ++i)
+    const int my_priority = state.priority;
+    int priority = 7;
+    int word = 0;
+    // Anything with a higher priority interrupts, the highest wins.
+    if (interrupts.priorities >> (my_priority + 1))
     {
-        const lc3_interrupt_req& inter = *i;
-        // We will be interrupted
-        // second case is if we generated an exception.
-        if (my_priority < inter.priority || (my_priority == inter.priority && inter.vector < 0x80))
-        {
-            // You will interrupt the guy interrupting
-            if (max_priority < inter.priority)
-            {
-                max_priority = inter.priority;
-                max_vector = inter.vector;
-                max_pos = i;
-            }
-        }
+        while (!((interrupts.priorities >> priority) & 1))
+            priority--;
+        while (interrupts.pending[priority][word] == 0)
+            word++;
+    }
+    // Exceptions (vectors < x80) also interrupt at the same priority.
+    else if ((interrupts.pending[my_priority][0] | interrupts.pending[my_priority][1]) != 0)
+    {
+        priority = my_priority;
+        word = interrupts.pending[priority][0] != 0 ? 0 : 1;
+    }
+    else
+    {
+        return false;
     }
 
-    if (max_priority == -1) return false;
+    // Lowest vector first.
+    const uint64_t bits = interrupts.pending[priority][word];
+    int vector = word << 6;
+    while (!((bits >> (vector & 63)) & 1))
+        vector++;
 
     // Interrupt acknowledged.
-    state.interrupts.erase(max_pos);
+    interrupts.reset(static_cast<uint8_t>(priority), static_cast<uint8_t>(vector));
 
-    lc3_do_interrupt(state, max_priority, max_vector);
+    lc3_do_interrupt(state, priority, vector);
 
     return true;
 }
@@ -359,7 +434,7 @@ void lc3_keyboard_interrupt(lc3_state& state)
 
 void lc3_signal_interrupt(lc3_state& state, int priority, int vector)
 {
-    state.interrupts.push_back(lc3_interrupt_req{static_cast<unsigned char>(vector), static_cast<unsigned char>(priority)});
+    state.interrupts.set(static_cast<uint8_t>(priority & 7), static_cast<uint8_t>(vector));
 }
 
 void lc3_check_keyboard_interrupt(lc3_state& state)
@@ -383,12 +458,8 @@ void lc3_check_keyboard_interrupt(lc3_state& state)
 
 bool lc3_signal_interrupt_once(lc3_state& state, int priority, int vector)
 {
-    // Try to find this interrupt
-    for (const auto& inter : state.interrupts)
-    {
-        if (inter.priority == priority && inter.vector == vector)
-            return false;
-    }
+    if (state.interrupts.test(static_cast<uint8_t>(priority & 7), static_cast<uint8_t>(vector)))
+        return false;
     lc3_signal_interrupt(state, priority, vector);
     return true;
 }
@@ -400,22 +471,36 @@ void lc3_signal_exception(lc3_state& state, int vector)
 
 void lc3_tick_plugins(lc3_state& state)
 {
-    if (state.instructionPlugin != nullptr)
-        state.instructionPlugin->OnTick(state);
-    for (auto& vector_plugin : state.trapPlugins)
-        if (vector_plugin.second != nullptr)
-            vector_plugin.second->OnTick(state);
-    for (auto* plugin : state.plugins)
-        plugin->OnTick(state);
+    // Deadlines are execution counts, start over if the user stepped back.
+    if (state.executions < state.plugin_schedule_executions)
+        lc3_schedule_plugins(state);
+    state.plugin_schedule_executions = state.executions;
+
+    auto& schedule = state.plugin_schedule;
+    while (!schedule.empty() && schedule.front().executions <= state.executions)
+    {
+        const lc3_plugin_deadline entry = schedule.front();
+        std::pop_heap(schedule.begin(), schedule.end(), std::greater<lc3_plugin_deadline>());
+        schedule.pop_back();
+        if (entry.generation == entry.plugin->GetScheduleGeneration())
+            state.plugins_due.push_back(entry.plugin);
+    }
+
+    for (auto* plugin : state.plugins_due)
+        if (plugin->GetScheduledHooks() & PLUGIN_HOOK_TICK)
+            plugin->OnTick(state);
 }
 
 void lc3_tock_plugins(lc3_state& state)
 {
-    if (state.instructionPlugin != nullptr)
-        state.instructionPlugin->OnTock(state);
-    for (auto i = state.trapPlugins.begin(); i != state.trapPlugins.end(); ++i)
-        if (i->second != nullptr)
-            i->second->OnTock(state);
-    for (unsigned int i = 0; i < state.plugins.size(); i++)
-        state.plugins[i]->OnTock(state);
+    if (state.plugins_due.empty())
+        return;
+
+    // Plugins may have rescheduled themselves during this instruction.
+    for (auto* plugin : state.plugins_due)
+        if (plugin->GetScheduledHooks() & PLUGIN_HOOK_TOCK)
+            plugin->OnTock(state);
+    for (auto* plugin : state.plugins_due)
+        lc3_schedule_plugin(state, plugin);
+    state.plugins_due.clear();
 }
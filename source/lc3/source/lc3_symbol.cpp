@@ -31,6 +31,7 @@ int lc3_load_sym(lc3_state& state, std::istream& file)
 
         state.symbols[sym_name] = location;
         state.rev_symbols[location] = sym_name;
+        state.symbol_generation++;
         if (!file.good()) return -1;
         getline(file, line);
     }
@@ -61,6 +62,7 @@ bool lc3_sym_add(lc3_state& state, const std::string& symbol, uint16_t addr)
     bool ret = (state.symbols.find(symbol) == state.symbols.end());
     state.symbols[symbol] = addr;
     state.rev_symbols[addr] = symbol;
+    state.symbol_generation++;
     return ret;
 }
 
@@ -82,10 +84,12 @@ void lc3_sym_delete(lc3_state& state, uint16_t addr)
 
     state.symbols.erase(symbol);
     state.rev_symbols.erase(addr);
+    state.symbol_generation++;
 }
 
 void lc3_sym_clear(lc3_state& state)
 {
     state.symbols.clear();
     state.rev_symbols.clear();
+    state.symbol_generation++;
 }
@@ -0,0 +1,539 @@
+#include "lc3/lc3_trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+/* File layout, all fields are little endian.
+ *
+ * Header
+ *  0 char[4]  "LC3T"
+ *  4 uint8_t  format version
+ *  5 uint8_t  lc3_version
+ *  6 uint8_t  privilege | n << 1 | z << 2 | p << 3
+ *  7 uint8_t  reserved
+ *  8 uint32_t executions
+ * 12 int16_t  regs[8]
+ *
+ * Followed by blocks until the end of the file
+ *  0 uint32_t size of the records in the block
+ *  4 uint32_t size of the stored data, if equal to the above the records are stored as is otherwise they are compressed
+ *  8 Stored data
+ *
+ * Record
+ *  0 uint8_t  type | (privilege | n << 1 | z << 2 | p << 3) << 2 | has_memory << 6, condition codes are after the change
+ *  1 uint8_t  register written or 0xFF if none
+ *  2 uint16_t pc, for SYNC records bytes 2-5 hold a uint32_t execution count instead
+ *  4 uint16_t instruction
+ *  6 int16_t  register value
+ *  8 uint16_t memory address written if has_memory
+ * 10 int16_t  memory value
+ *
+ * A STEP record is written for each executed instruction followed by CHANGE records if it wrote more than one register or address.
+ * SYNC records are written for changes made outside of an instruction (interrupts, plugins, the debugger or lc3_seek).
+ */
+#define TRACE_MAGIC "LC3T"
+#define TRACE_FORMAT_VERSION 1
+#define TRACE_HEADER_SIZE 28
+#define TRACE_BLOCK_HEADER_SIZE 8
+#define TRACE_RECORD_SIZE 12
+
+// Block compression is a byte oriented LZ77 scheme in the style of LZ4, see trace_compress.
+#define TRACE_MIN_MATCH 4
+#define TRACE_MAX_OFFSET 0xFFFF
+#define TRACE_HASH_BITS 12
+
+namespace
+{
+
+enum
+{
+    TRACE_STEP = 0,
+    TRACE_CHANGE = 1,
+    TRACE_SYNC = 2,
+};
+
+void trace_put16(uint8_t* out, uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+void trace_put32(uint8_t* out, uint32_t value)
+{
+    trace_put16(out, value & 0xFFFF);
+    trace_put16(out + 2, value >> 16);
+}
+
+uint16_t trace_get16(const uint8_t* in)
+{
+    return static_cast<uint16_t>(in[0] | in[1] << 8);
+}
+
+uint32_t trace_get32(const uint8_t* in)
+{
+    return trace_get16(in) | static_cast<uint32_t>(trace_get16(in + 2)) << 16;
+}
+
+uint8_t trace_flags(const lc3_state& state)
+{
+    return static_cast<uint8_t>(state.privilege | state.n << 1 | state.z << 2 | state.p << 3);
+}
+
+void trace_set_flags(lc3_trace_step& step, uint8_t flags)
+{
+    step.privilege = flags & 1;
+    step.n = (flags >> 1) & 1;
+    step.z = (flags >> 2) & 1;
+    step.p = (flags >> 3) & 1;
+}
+
+void trace_put_length(std::vector<uint8_t>& out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+/** Each sequence is a token byte (literal count << 4 | match length - 4), extra length bytes if the literal count is 15,
+  * the literals, then a 16 bit offset back to the match and extra length bytes if the match length nibble is 15.
+  * The last sequence only has literals. Since a loop writes nearly the same records each iteration matches are long.
+  */
+void trace_compress(const std::vector<uint8_t>& in, std::vector<uint8_t>& out)
+{
+    out.clear();
+    // Positions are stored + 1 so 0 means empty.
+    std::vector<uint32_t> table(1 << TRACE_HASH_BITS, 0);
+    const size_t size = in.size();
+    size_t anchor = 0;
+    size_t i = 0;
+
+    auto emit = [&](size_t literals_end, size_t offset, size_t length)
+    {
+        const size_t literals = literals_end - anchor;
+        const size_t extra = length >= TRACE_MIN_MATCH ? length - TRACE_MIN_MATCH : 0;
+        out.push_back(static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4 | std::min<size_t>(extra, 15)));
+        if (literals >= 15)
+            trace_put_length(out, literals - 15);
+        out.insert(out.end(), in.begin() + anchor, in.begin() + literals_end);
+        if (length == 0)
+            return;
+        out.push_back(offset & 0xFF);
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if (extra >= 15)
+            trace_put_length(out, extra - 15);
+    };
+
+    while (i + TRACE_MIN_MATCH <= size)
+    {
+        uint32_t sequence;
+        std::memcpy(&sequence, &in[i], sizeof(sequence));
+        const uint32_t hash = (sequence * 2654435761U) >> (32 - TRACE_HASH_BITS);
+        const size_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(i + 1);
+
+        if (candidate != 0 && i - (candidate - 1) <= TRACE_MAX_OFFSET && std::memcmp(&in[candidate - 1], &in[i], TRACE_MIN_MATCH) == 0)
+        {
+            const size_t match = candidate - 1;
+            size_t length = TRACE_MIN_MATCH;
+            while (i + length < size && in[match + length] == in[i + length])
+                length++;
+            emit(i, i - match, length);
+            i += length;
+            anchor = i;
+            continue;
+        }
+        i++;
+    }
+
+    emit(size, 0, 0);
+}
+
+bool trace_read_length(const uint8_t*& in, const uint8_t* end, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (in == end)
+            return false;
+        byte = *in++;
+        length += byte;
+    }
+    while (byte == 255);
+    return true;
+}
+
+bool trace_decompress(const std::vector<uint8_t>& packed, std::vector<uint8_t>& out, size_t size)
+{
+    out.clear();
+    const uint8_t* in = packed.data();
+    const uint8_t* end = in + packed.size();
+    while (in != end)
+    {
+        const uint8_t token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !trace_read_length(in, end, literals))
+            return false;
+        if (static_cast<size_t>(end - in) < literals || out.size() + literals > size)
+            return false;
+        out.insert(out.end(), in, in + literals);
+        in += literals;
+        if (in == end)
+            break;
+
+        if (end - in < 2)
+            return false;
+        const size_t offset = in[0] | in[1] << 8;
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && !trace_read_length(in, end, length))
+            return false;
+        length += TRACE_MIN_MATCH;
+        if (offset == 0 || offset > out.size() || out.size() + length > size)
+            return false;
+        // Byte at a time since the match may overlap what it is producing.
+        size_t from = out.size() - offset;
+        for (size_t i = 0; i < length; i++)
+            out.push_back(out[from + i]);
+    }
+    return out.size() == size;
+}
+
+}
+
+lc3_trace_writer::~lc3_trace_writer()
+{
+    flush();
+}
+
+void lc3_trace_writer::begin_step(const lc3_state& state)
+{
+    if (!started)
+    {
+        write_header(state);
+        started = true;
+    }
+    else
+    {
+        bool synced = false;
+        for (int i = 0; i < 8; i++)
+        {
+            if (regs[i] != state.regs[i])
+            {
+                add_record(TRACE_SYNC, state, 0, 0, i, false, 0);
+                synced = true;
+            }
+        }
+        if (!synced && (flags != trace_flags(state) || executions != state.executions))
+            add_record(TRACE_SYNC, state, 0, 0, -1, false, 0);
+    }
+
+    step_pc = state.pc;
+    step_instruction = static_cast<uint16_t>(state.mem[state.pc]);
+}
+
+void lc3_trace_writer::end_step(const lc3_state& state, const lc3_state_change& change)
+{
+    written.clear();
+    if (change.changes == LC3_MEMORY_CHANGE)
+    {
+        written.push_back(change.location);
+    }
+    else if (change.changes == LC3_MULTI_CHANGE)
+    {
+        for (const auto& info : change.info)
+            if (!info.is_reg)
+                written.push_back(info.location);
+    }
+
+    auto next_reg = [&](int from)
+    {
+        while (from < 8 && regs[from] == state.regs[from])
+            from++;
+        return from;
+    };
+
+    int reg = next_reg(0);
+    size_t memory = 0;
+    uint8_t type = TRACE_STEP;
+    do
+    {
+        const bool has_memory = memory < written.size();
+        add_record(type, state, step_pc, step_instruction, reg < 8 ? reg : -1, has_memory, has_memory ? written[memory] : 0);
+        if (has_memory)
+            memory++;
+        if (reg < 8)
+            reg = next_reg(reg + 1);
+        type = TRACE_CHANGE;
+    }
+    while (reg < 8 || memory < written.size());
+}
+
+void lc3_trace_writer::flush()
+{
+    if (buffer.empty())
+        return;
+
+    const std::vector<uint8_t>* data = &buffer;
+    if (compress)
+    {
+        trace_compress(buffer, packed);
+        if (packed.size() < buffer.size())
+            data = &packed;
+    }
+
+    uint8_t header[TRACE_BLOCK_HEADER_SIZE];
+    trace_put32(header, static_cast<uint32_t>(buffer.size()));
+    trace_put32(header + 4, static_cast<uint32_t>(data->size()));
+    stream.write(reinterpret_cast<const char*>(header), TRACE_BLOCK_HEADER_SIZE);
+    stream.write(reinterpret_cast<const char*>(data->data()), static_cast<std::streamsize>(data->size()));
+    stream.flush();
+    buffer.clear();
+}
+
+void lc3_trace_writer::write_header(const lc3_state& state)
+{
+    uint8_t header[TRACE_HEADER_SIZE] = {0};
+    std::memcpy(header, TRACE_MAGIC, 4);
+    header[4] = TRACE_FORMAT_VERSION;
+    header[5] = static_cast<uint8_t>(state.lc3_version);
+    header[6] = trace_flags(state);
+    trace_put32(header + 8, state.executions);
+    for (int i = 0; i < 8; i++)
+        trace_put16(header + 12 + 2 * i, static_cast<uint16_t>(state.regs[i]));
+    stream.write(reinterpret_cast<const char*>(header), TRACE_HEADER_SIZE);
+
+    std::memcpy(regs, state.regs, sizeof(regs));
+    flags = header[6];
+    executions = state.executions;
+    buffer.reserve(LC3_TRACE_BLOCK_SIZE);
+}
+
+void lc3_trace_writer::add_record(uint8_t type, const lc3_state& state, uint16_t pc, uint16_t instruction, int reg, bool has_memory, uint16_t address)
+{
+    flags = trace_flags(state);
+
+    uint8_t record[TRACE_RECORD_SIZE];
+    record[0] = static_cast<uint8_t>(type | flags << 2 | has_memory << 6);
+    record[1] = reg < 0 ? 0xFF : static_cast<uint8_t>(reg);
+    if (type == TRACE_SYNC)
+    {
+        trace_put32(record + 2, state.executions);
+    }
+    else
+    {
+        trace_put16(record + 2, pc);
+        trace_put16(record + 4, instruction);
+    }
+    trace_put16(record + 6, reg < 0 ? 0 : static_cast<uint16_t>(state.regs[reg]));
+    trace_put16(record + 8, address);
+    trace_put16(record + 10, has_memory ? static_cast<uint16_t>(state.mem[address]) : 0);
+
+    if (reg >= 0)
+        regs[reg] = state.regs[reg];
+    if (type == TRACE_SYNC)
+        executions = state.executions;
+    else if (type == TRACE_STEP)
+        executions++;
+
+    if (buffer.size() + TRACE_RECORD_SIZE > LC3_TRACE_BLOCK_SIZE)
+        flush();
+    buffer.insert(buffer.end(), record, record + TRACE_RECORD_SIZE);
+}
+
+lc3_trace_reader::lc3_trace_reader(std::istream& in) : stream(in)
+{
+    uint8_t header[TRACE_HEADER_SIZE];
+    if (!stream.read(reinterpret_cast<char*>(header), TRACE_HEADER_SIZE) || std::memcmp(header, TRACE_MAGIC, 4) != 0)
+    {
+        failure = "Not an lc3 trace file";
+        return;
+    }
+    if (header[4] != TRACE_FORMAT_VERSION)
+    {
+        failure = "Unsupported trace format version " + std::to_string(header[4]);
+        return;
+    }
+
+    lc3_version = header[5];
+    trace_set_flags(view, header[6]);
+    view.executions = trace_get32(header + 8);
+    for (int i = 0; i < 8; i++)
+        view.regs[i] = static_cast<int16_t>(trace_get16(header + 12 + 2 * i));
+}
+
+bool lc3_trace_reader::next(lc3_trace_step& step)
+{
+    if (!failure.empty())
+        return false;
+
+    const uint8_t* record;
+    auto apply = [&](const uint8_t* change)
+    {
+        trace_set_flags(view, (change[0] >> 2) & 0xF);
+        if (change[1] < 8)
+        {
+            const uint16_t value = trace_get16(change + 6);
+            view.regs[change[1]] = static_cast<int16_t>(value);
+            step.changes.push_back(lc3_change_info{true, change[1], value});
+        }
+        if ((change[0] >> 6) & 1)
+            step.changes.push_back(lc3_change_info{false, trace_get16(change + 8), trace_get16(change + 10)});
+    };
+
+    for (;;)
+    {
+        if (!read_record(record))
+            return false;
+        const uint8_t type = record[0] & 3;
+        if (type == TRACE_STEP)
+            break;
+        if (type != TRACE_SYNC)
+        {
+            failure = "Change record without an instruction";
+            return false;
+        }
+        apply(record);
+        view.executions = trace_get32(record + 2);
+    }
+
+    step.executions = view.executions;
+    step.pc = trace_get16(record + 2);
+    step.instruction = trace_get16(record + 4);
+    step.regs = view.regs;
+    step.n = view.n;
+    step.z = view.z;
+    step.p = view.p;
+    step.privilege = view.privilege;
+    step.changes.clear();
+
+    apply(record);
+    view.executions++;
+    while ((position < block.size() || fill()) && (block[position] & 3) == TRACE_CHANGE)
+    {
+        apply(&block[position]);
+        position += TRACE_RECORD_SIZE;
+    }
+    // Changes within the instruction were read fine even if the next block is malformed.
+    return true;
+}
+
+bool lc3_trace_reader::read_record(const uint8_t*& record)
+{
+    if (position == block.size() && !fill())
+        return false;
+    record = &block[position];
+    position += TRACE_RECORD_SIZE;
+    return true;
+}
+
+bool lc3_trace_reader::fill()
+{
+    if (!failure.empty())
+        return false;
+
+    uint8_t header[TRACE_BLOCK_HEADER_SIZE];
+    stream.read(reinterpret_cast<char*>(header), TRACE_BLOCK_HEADER_SIZE);
+    if (stream.gcount() == 0)
+        return false;
+    if (stream.gcount() != TRACE_BLOCK_HEADER_SIZE)
+    {
+        failure = "Truncated block header";
+        return false;
+    }
+
+    const uint32_t size = trace_get32(header);
+    const uint32_t stored = trace_get32(header + 4);
+    if (size == 0 || size > LC3_TRACE_BLOCK_SIZE || size % TRACE_RECORD_SIZE != 0 || stored > size)
+    {
+        failure = "Malformed block header";
+        return false;
+    }
+
+    std::vector<uint8_t>& data = stored == size ? block : packed;
+    data.resize(stored);
+    if (!stream.read(reinterpret_cast<char*>(data.data()), stored))
+    {
+        failure = "Truncated block";
+        return false;
+    }
+    if (stored != size && !trace_decompress(packed, block, size))
+    {
+        failure = "Corrupt compressed block";
+        return false;
+    }
+
+    position = 0;
+    return true;
+}
+
+void lc3_write_trace_text(lc3_state& state, std::ostream& stream, uint16_t pc, uint16_t instruction, const int16_t* regs, bool n, bool z)
+{
+    char buf[128];
+
+    snprintf(buf, 128, "PC x%04x\n", pc);
+    stream << buf;
+
+    snprintf(buf, 128, "instr: %s", lc3_disassemble(state, instruction, pc, 1).c_str());
+    stream << buf;
+
+    snprintf(buf, 128, " (%04x)\n", instruction);
+    stream << buf;
+
+    snprintf(buf, 128, "R0 %6d|x%04x\tR1 %6d|x%04x\tR2 %6d|x%04x\tR3 %6d|x%04x\n",
+             regs[0], static_cast<uint16_t>(regs[0]),
+             regs[1], static_cast<uint16_t>(regs[1]),
+             regs[2], static_cast<uint16_t>(regs[2]),
+             regs[3], static_cast<uint16_t>(regs[3]));
+    stream << buf;
+
+
+    snprintf(buf, 128, "R4 %6d|x%04x\tR5 %6d|x%04x\tR6 %6d|x%04x\tR7 %6d|x%04x\n",
+             regs[4], static_cast<uint16_t>(regs[4]),
+             regs[5], static_cast<uint16_t>(regs[5]),
+             regs[6], static_cast<uint16_t>(regs[6]),
+             regs[7], static_cast<uint16_t>(regs[7]));
+    stream << buf;
+
+    snprintf(buf, 128, "CC: %s\n\n", (n ? "N" : (z ? "Z" : "P")));
+    stream << buf;
+}
+
+void lc3_write_trace_csv_header(std::ostream& stream)
+{
+    stream << "executions,pc,instruction,disassembly,r0,r1,r2,r3,r4,r5,r6,r7,cc,privilege,changes\n";
+}
+
+void lc3_write_trace_csv(lc3_state& state, std::ostream& stream, const lc3_trace_step& step)
+{
+    char buf[128];
+
+    snprintf(buf, 128, "%u,x%04x,x%04x,\"", step.executions, step.pc, step.instruction);
+    stream << buf;
+    for (const auto& c : lc3_disassemble(state, step.instruction, step.pc, 1))
+    {
+        if (c == '"')
+            stream << '"';
+        stream << c;
+    }
+    stream << '"';
+
+    for (const auto& reg : step.regs)
+        stream << ',' << reg;
+    stream << ',' << (step.n ? 'N' : (step.z ? 'Z' : 'P')) << ',' << (step.privilege ? "user" : "supervisor") << ',';
+
+    // Space separated register or address = new value.
+    for (size_t i = 0; i < step.changes.size(); i++)
+    {
+        const auto& change = step.changes[i];
+        if (change.is_reg)
+            snprintf(buf, 128, "%sR%d=x%04x", i ? " " : "", change.location, change.value);
+        else
+            snprintf(buf, 128, "%sx%04x=x%04x", i ? " " : "", change.location, change.value);
+        stream << buf;
+    }
+    stream << '\n';
+}
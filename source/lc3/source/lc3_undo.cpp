@@ -0,0 +1,255 @@
+#include "lc3/lc3.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+/* Record layout, all fields are stored in native byte order.
+ *
+ *  0 uint8_t  changes
+ *  1 uint8_t  privilege | n << 1 | z << 2 | p << 3 | halted << 4
+ *  2 uint16_t pc
+ *  4 int16_t  r7
+ *  6 uint16_t location
+ *  8 uint16_t value
+ * 10 uint16_t savedusp
+ * 12 uint16_t savedssp
+ * 14 uint32_t warnings
+ * 18 Extra data by type of change
+ *      LC3_INTERRUPT(_BEGIN) uint32_t executions
+ *      LC3_SUBROUTINE_*      uint16_t address, uint16_t r6, uint8_t is_trap
+ *      LC3_MULTI_CHANGE      uint32_t count, count * (uint8_t is_reg, uint16_t location, uint16_t value)
+ *  N uint32_t size of the record, so the newest record can be found from the end.
+ */
+#define UNDO_HEADER_SIZE 18
+#define UNDO_TRAILER_SIZE 4
+#define UNDO_INFO_SIZE 5
+#define UNDO_MIN_CAPACITY 4096
+
+namespace
+{
+
+size_t undo_extra_size(uint8_t changes, uint32_t info_count)
+{
+    switch(changes)
+    {
+        case LC3_INTERRUPT_BEGIN:
+        case LC3_INTERRUPT:
+            return sizeof(uint32_t);
+        case LC3_SUBROUTINE_BEGIN:
+        case LC3_SUBROUTINE_END:
+            return 5;
+        case LC3_MULTI_CHANGE:
+            return sizeof(uint32_t) + info_count * UNDO_INFO_SIZE;
+        default:
+            return 0;
+    }
+}
+
+template <typename T>
+void undo_put(uint8_t*& out, T value)
+{
+    std::memcpy(out, &value, sizeof(T));
+    out += sizeof(T);
+}
+
+}
+
+void lc3_undo_journal::set_budget(size_t bytes)
+{
+    limit = bytes;
+    while (used > limit)
+        pop_front();
+    if (buffer.size() > limit)
+        reallocate(limit);
+}
+
+void lc3_undo_journal::clear()
+{
+    buffer = std::vector<uint8_t>();
+    scratch = std::vector<uint8_t>();
+    head = tail = used = count = 0;
+}
+
+lc3_state_change lc3_undo_journal::back() const
+{
+    uint32_t size;
+    read((tail + buffer.size() - UNDO_TRAILER_SIZE) % buffer.size(), &size, sizeof(size));
+
+    // Decoded in place, read handles a record that wraps around the end of the buffer.
+    size_t position = (tail + buffer.size() - size) % buffer.size();
+    auto get = [this, &position](auto value)
+    {
+        read(position, &value, sizeof(value));
+        position = (position + sizeof(value)) % buffer.size();
+        return value;
+    };
+
+    lc3_state_change change;
+    change.changes = get(uint8_t{});
+    const auto flags = get(uint8_t{});
+    change.privilege = flags & 1;
+    change.n = (flags >> 1) & 1;
+    change.z = (flags >> 2) & 1;
+    change.p = (flags >> 3) & 1;
+    change.halted = (flags >> 4) & 1;
+    change.pc = get(uint16_t{});
+    change.r7 = get(int16_t{});
+    change.location = get(uint16_t{});
+    change.value = get(uint16_t{});
+    change.savedusp = get(uint16_t{});
+    change.savedssp = get(uint16_t{});
+    change.warnings = get(uint32_t{});
+    change.executions = 0;
+    change.subroutine = lc3_subroutine_call{0, 0, false};
+
+    switch(change.changes)
+    {
+        case LC3_INTERRUPT_BEGIN:
+        case LC3_INTERRUPT:
+            change.executions = get(uint32_t{});
+            break;
+        case LC3_SUBROUTINE_BEGIN:
+        case LC3_SUBROUTINE_END:
+            change.subroutine.address = get(uint16_t{});
+            change.subroutine.r6 = get(uint16_t{});
+            change.subroutine.is_trap = get(uint8_t{}) != 0;
+            break;
+        case LC3_MULTI_CHANGE:
+            change.info.resize(get(uint32_t{}));
+            for (auto& info : change.info)
+            {
+                info.is_reg = get(uint8_t{}) != 0;
+                info.location = get(uint16_t{});
+                info.value = get(uint16_t{});
+            }
+            break;
+        default:
+            break;
+    }
+
+    return change;
+}
+
+void lc3_undo_journal::set_back_changes(uint8_t changes)
+{
+    uint32_t size;
+    read((tail + buffer.size() - UNDO_TRAILER_SIZE) % buffer.size(), &size, sizeof(size));
+    write((tail + buffer.size() - size) % buffer.size(), &changes, sizeof(changes));
+}
+
+void lc3_undo_journal::push_back(const lc3_state_change& change)
+{
+    const uint8_t changes = change.changes;
+    const size_t size = UNDO_HEADER_SIZE + undo_extra_size(changes, change.info.size()) + UNDO_TRAILER_SIZE;
+
+    // Too big to ever fit, the history before it is no longer consistent.
+    if (size > limit)
+    {
+        while (!empty())
+            pop_front();
+        return;
+    }
+
+    scratch.resize(size);
+    uint8_t* out = scratch.data();
+    undo_put<uint8_t>(out, changes);
+    undo_put<uint8_t>(out, change.privilege | (change.n << 1) | (change.z << 2) | (change.p << 3) | (change.halted << 4));
+    undo_put<uint16_t>(out, change.pc);
+    undo_put<int16_t>(out, change.r7);
+    undo_put<uint16_t>(out, change.location);
+    undo_put<uint16_t>(out, change.value);
+    undo_put<uint16_t>(out, change.savedusp);
+    undo_put<uint16_t>(out, change.savedssp);
+    undo_put<uint32_t>(out, change.warnings);
+
+    switch(changes)
+    {
+        case LC3_INTERRUPT_BEGIN:
+        case LC3_INTERRUPT:
+            undo_put<uint32_t>(out, change.executions);
+            break;
+        case LC3_SUBROUTINE_BEGIN:
+        case LC3_SUBROUTINE_END:
+            undo_put<uint16_t>(out, change.subroutine.address);
+            undo_put<uint16_t>(out, change.subroutine.r6);
+            undo_put<uint8_t>(out, change.subroutine.is_trap);
+            break;
+        case LC3_MULTI_CHANGE:
+            undo_put<uint32_t>(out, static_cast<uint32_t>(change.info.size()));
+            for (const auto& info : change.info)
+            {
+                undo_put<uint8_t>(out, info.is_reg);
+                undo_put<uint16_t>(out, info.location);
+                undo_put<uint16_t>(out, info.value);
+            }
+            break;
+        default:
+            break;
+    }
+    undo_put<uint32_t>(out, static_cast<uint32_t>(size));
+
+    while (buffer.size() - used < size)
+    {
+        if (buffer.size() < limit)
+            reallocate(std::min(limit, std::max({buffer.size() * 2, used + size, static_cast<size_t>(UNDO_MIN_CAPACITY)})));
+        else
+            pop_front();
+    }
+
+    write(tail, scratch.data(), size);
+    tail = (tail + size) % buffer.size();
+    used += size;
+    count++;
+}
+
+void lc3_undo_journal::pop_back()
+{
+    uint32_t size;
+    read((tail + buffer.size() - UNDO_TRAILER_SIZE) % buffer.size(), &size, sizeof(size));
+    tail = (tail + buffer.size() - size) % buffer.size();
+    used -= size;
+    count--;
+}
+
+void lc3_undo_journal::pop_front()
+{
+    const size_t size = record_size(head);
+    head = (head + size) % buffer.size();
+    used -= size;
+    count--;
+}
+
+size_t lc3_undo_journal::record_size(size_t position) const
+{
+    uint8_t changes;
+    uint32_t info_count = 0;
+    read(position, &changes, sizeof(changes));
+    if (changes == LC3_MULTI_CHANGE)
+        read((position + UNDO_HEADER_SIZE) % buffer.size(), &info_count, sizeof(info_count));
+    return UNDO_HEADER_SIZE + undo_extra_size(changes, info_count) + UNDO_TRAILER_SIZE;
+}
+
+void lc3_undo_journal::read(size_t position, void* data, size_t length) const
+{
+    const size_t first = std::min(length, buffer.size() - position);
+    std::memcpy(data, buffer.data() + position, first);
+    std::memcpy(static_cast<uint8_t*>(data) + first, buffer.data(), length - first);
+}
+
+void lc3_undo_journal::write(size_t position, const void* data, size_t length)
+{
+    const size_t first = std::min(length, buffer.size() - position);
+    std::memcpy(buffer.data() + position, data, first);
+    std::memcpy(buffer.data(), static_cast<const uint8_t*>(data) + first, length - first);
+}
+
+void lc3_undo_journal::reallocate(size_t capacity)
+{
+    // Records are laid out from the start of the new buffer.
+    std::vector<uint8_t> resized(capacity);
+    if (used != 0)
+        read(head, resized.data(), used);
+    buffer.swap(resized);
+    head = 0;
+    tail = capacity != 0 ? used % capacity : 0;
+}
@@ -0,0 +1,150 @@
+#ifndef BINARY_SPAN_READER_HPP
+#define BINARY_SPAN_READER_HPP
+
+#include <lc3_replay/BinaryStreamReader.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/** View of an array of int16s inside a buffer, the data isn't necessarily aligned. */
+class int16_view
+{
+public:
+    int16_view() = default;
+    int16_view(const char* _data, uint32_t _size) : data(_data), length(_size) {}
+    int16_t operator[](uint32_t index) const
+    {
+        int16_t val;
+        memcpy(&val, data + index * sizeof(int16_t), sizeof(int16_t));
+        return val;
+    }
+    uint32_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    std::vector<int16_t> to_vector() const
+    {
+        std::vector<int16_t> vec(length);
+        if (length)
+            memcpy(vec.data(), data, length * sizeof(int16_t));
+        return vec;
+    }
+private:
+    const char* data = nullptr;
+    uint32_t length = 0;
+};
+
+/** Reads the same format as BinaryStreamReader directly out of a buffer without copying it.
+  * The buffer must outlive the reader and any views it hands out.
+  */
+class BinarySpanReader
+{
+public:
+    BinarySpanReader(const char* _data, size_t _size, uint32_t _flags = READ_SIZES) : data(_data), size(_size), flags(_flags) {}
+    explicit BinarySpanReader(std::string_view buffer, uint32_t _flags = READ_SIZES) : BinarySpanReader(buffer.data(), buffer.size(), _flags) {}
+    BinarySpanReader& operator>>(bool& val) { return Read(val); }
+    BinarySpanReader& operator>>(char& val) { return Read(val); }
+    BinarySpanReader& operator>>(unsigned char& val) { return Read(val); }
+    BinarySpanReader& operator>>(int16_t& val) { return Read(val); }
+    BinarySpanReader& operator>>(uint16_t& val) { return Read(val); }
+    BinarySpanReader& operator>>(int& val) { return Read(val); }
+    BinarySpanReader& operator>>(unsigned int& val) { return Read(val); }
+    BinarySpanReader& operator>>(float& val) { return Read(val); }
+    BinarySpanReader& operator>>(std::string& val);
+    BinarySpanReader& operator>>(std::string_view& val);
+    BinarySpanReader& operator>>(int16_view& val);
+    BinarySpanReader& operator>>(BinarySpanReader& (*pf)(BinarySpanReader&)) { return pf(*this); }
+    void SetFlags(uint32_t _flags) { flags = _flags; }
+    void SetWidth(uint32_t _width) { width = _width; }
+    uint32_t Flags() const { return flags; }
+    uint32_t Width() const { return width; }
+    void SetMaxStringSize(uint32_t _size) { max_string_size = _size; }
+    uint32_t GetMaxStringSize() const { return max_string_size; }
+    void SetMaxVectorSize(uint32_t _size) { max_vector_size = _size; }
+    uint32_t GetMaxVectorSize() const { return max_vector_size; }
+    void Fail() { failed = true; }
+    bool Ok() const { return !failed; }
+    uint32_t TellG() const { return failed ? -1 : static_cast<uint32_t>(offset); }
+    size_t Remaining() const { return size - offset; }
+    /** Claims the next count bytes, or fails if there aren't that many.
+      * @return Start of the claimed bytes, nullptr on failure.
+      */
+    const char* Take(size_t count)
+    {
+        if (failed || count > size - offset)
+        {
+            failed = true;
+            return nullptr;
+        }
+        const char* start = data + offset;
+        offset += count;
+        return start;
+    }
+    /** Reads the size of a vector, failing if it is over the maximum.
+      * @return True if the size is valid.
+      */
+    bool ReadVectorSize(uint32_t& count);
+    enum
+    {
+        NO_READ_STRING_SIZES = 0,
+        NO_READ_VECTOR_SIZES = 0,
+        NO_READ_SIZES = 0,
+        READ_STRING_SIZES = 1,
+        READ_VECTOR_SIZES = 2,
+        READ_SIZES = 3,
+    };
+
+private:
+    template<typename T>
+    BinarySpanReader& Read(T& val)
+    {
+        const char* start = Take(sizeof(T));
+        if (start)
+            memcpy(&val, start, sizeof(T));
+        return *this;
+    }
+    bool ReadStringSize(uint32_t& count);
+
+    const char* data;
+    size_t size;
+    size_t offset = 0;
+    uint32_t flags;
+    uint32_t width = 0;
+    uint32_t max_string_size = -1;
+    uint32_t max_vector_size = -1;
+    bool failed = false;
+};
+
+template<typename VecType>
+BinarySpanReader& operator>>(BinarySpanReader& cs, std::vector<VecType>& vec)
+{
+    uint32_t count = vec.size();
+    if (!cs.ReadVectorSize(count))
+        return cs;
+
+    // Plain values are copied in one go after checking the whole vector is there.
+    if constexpr (std::is_arithmetic<VecType>::value && !std::is_same<VecType, bool>::value)
+    {
+        const char* start = cs.Take(count * sizeof(VecType));
+        if (!start)
+            return cs;
+        vec.resize(count);
+        if (count)
+            memcpy(vec.data(), start, count * sizeof(VecType));
+    }
+    else
+    {
+        vec.resize(count);
+        for (uint32_t i = 0; i < count && cs.Ok(); i++)
+            cs >> vec[i];
+    }
+
+    return cs;
+}
+
+BinarySpanReader& operator>>(BinarySpanReader& cs, const set_width& width);
+BinarySpanReader& operator>>(BinarySpanReader& cs, const set_flags& flags);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef LC3_BATCH_HPP
+#define LC3_BATCH_HPP
+
+#include <lc3.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#define DEFAULT_BATCH_BUDGET 10000000
+
+/** A program to run, @see lc3_run_batch */
+struct lc3_batch_job
+{
+    std::string filename;       // .asm file, or an .obj/.hex file if there is no replay string.
+    std::string replay;         // Replay string to set up the machine with, empty if none.
+    std::string input;          // Console input, replay strings bring their own.
+    uint32_t budget = DEFAULT_BATCH_BUDGET;     // Maximum number of instructions to execute.
+};
+
+/** Outcome of a job, @see lc3_run_batch */
+struct lc3_batch_result
+{
+    size_t job = 0;             // Index of the job.
+    bool halted = false;
+    bool timeout = false;       // Ran out of budget before halting.
+    uint32_t executions = 0;
+    bool fast = false;          // Started in the fast run mode, @see lc3_can_run_fast.
+    uint32_t warnings = 0;
+    uint64_t output_digest = 0; // FNV-1a hash of the output.
+    uint64_t output_size = 0;
+    std::string error;          // Set if the job could not be set up, nothing else is valid.
+};
+
+/** lc3_run_batch
+  *
+  * Runs jobs on a work stealing thread pool, one machine per job.
+  * Each distinct file is assembled or loaded once and jobs without a replay string start from a clone of it,
+  * jobs with one start from a clone of the file assembled for the replay's environment, @see lc3_apply_replay.
+  * Plugins are process wide, so jobs for programs that load plugins run one at a time.
+  * @param jobs Jobs to run.
+  * @param threads Number of threads, 0 for one per core.
+  * @param on_result Called as each job finishes (from one thread at a time), may be empty.
+  * @return Results indexed by job.
+  */
+std::vector<lc3_batch_result> lc3_run_batch(const std::vector<lc3_batch_job>& jobs, unsigned int threads = 0,
+                                            const std::function<void(const lc3_batch_result&)>& on_result = {});
+/** lc3_format_batch_result
+  *
+  * Formats a result as a line of JSON (without the newline).
+  * @param job Job the result is for.
+  * @param result Result to format.
+  * @return JSON object.
+  */
+std::string lc3_format_batch_result(const lc3_batch_job& job, const lc3_batch_result& result);
+
+#endif
@@ -3,9 +3,12 @@
 
 #include <lc3.hpp>
 
+#include <array>
 #include <exception>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 /** Exception class for replay string errors */
 class LC3ReplayStringException : public std::exception
@@ -23,10 +26,152 @@ private:
 };
 
 
+/** Environment a replay string sets the machine up with. */
+struct lc3_replay_environment
+{
+    bool true_traps = false;
+    bool interrupts = false;
+    bool plugins = true;
+    bool strict_execution = true;
+    char memory_strategy = 0;
+    unsigned int memory_strategy_value = 0;
+    unsigned int break_address = -1;
+    int version = 1;
+};
+
+/** A single precondition from a replay string. */
+struct lc3_replay_precondition
+{
+    unsigned char id = 0;
+    std::string label;
+    std::vector<int16_t> params;
+    uint16_t address = 0;       // For preconditions on a direct address, labels are looked up when applied.
+};
+
+/** A decoded replay string, immutable once parsed so it can be shared between threads. */
+struct ReplayPlan
+{
+    std::string replay_string;
+    std::string filename;
+    lc3_replay_environment environment;
+    std::vector<lc3_replay_precondition> preconditions;
+};
+
 void lc3_setup_replay(lc3_state& state, const std::string& filename, const std::string& replay_string, std::stringstream& newinput);
+/** lc3_parse_replay
+  *
+  * Decodes and validates a replay string once.
+  * Plans are cached by the contents of the string, so parsing the same string again is a lookup.
+  * @param replay_string Replay string.
+  * @return The parsed replay string.
+  */
+std::shared_ptr<const ReplayPlan> lc3_parse_replay(const std::string& replay_string);
+/** lc3_apply_replay
+  *
+  * Sets up state as lc3_setup_replay does from an already parsed replay string.
+  * The file is assembled once for each environment it is replayed in and state starts from a clone of that machine,
+  * unless it loads plugins.
+  * @param state LC3State object.
+  * @param plan Parsed replay string.
+  * @param filename Name of the file, must match the one in the replay string.
+  * @param file Program source.
+  * @param newinput Receives the console input.
+  */
+void lc3_apply_replay(lc3_state& state, const ReplayPlan& plan, const std::string& filename, std::istream& file, std::stringstream& newinput);
 std::string lc3_describe_replay(const std::string& replay_string);
 
-void lc3_run_verification(lc3_state& state, const std::string& verification_string);
+// Number of words on top of the stack recorded for each subroutine call, unless a plan needs more.
+#define VERIFICATION_STACK_WORDS 16
+
+/** A single postcondition from a verification string. */
+struct lc3_replay_postcondition
+{
+    unsigned char id = 0;
+    std::string label;
+    std::vector<int16_t> params;
+    uint16_t address = 0;       // For postconditions on a direct address, labels are looked up when run.
+};
+
+/** A decoded verification string, immutable once parsed so it can be shared between threads. */
+struct VerificationPlan
+{
+    std::string verification_string;
+    std::string filename;
+    std::vector<lc3_replay_postcondition> postconditions;
+};
+
+/** A subroutine or trap called during a run. */
+struct lc3_verification_call
+{
+    uint16_t address;           // Address of the subroutine, or the trap vector.
+    bool trap;
+    std::array<int16_t, 8> regs;
+    std::vector<int16_t> stack;         // Top of the stack at the time of the call, lc3_verification_context::stack_words long.
+};
+
+/** What postconditions need to know about a run besides the final state, @see lc3_begin_verification */
+struct lc3_verification_context
+{
+    std::array<int16_t, 8> regs;
+    uint16_t pc = 0;
+    std::string output;
+    std::vector<lc3_verification_call> calls;
+    size_t stack_words = VERIFICATION_STACK_WORDS;      // Words of the stack recorded for each call.
+    std::vector<lc3_subscription> subscriptions;        // Event functions recording into this context.
+};
+
+/** Outcome of a single postcondition. */
+struct lc3_verification_check
+{
+    unsigned char id = 0;
+    std::string label;
+    bool passed = false;
+    std::string expected;
+    std::string actual;
+};
+
+/** Outcome of all postconditions in a verification string. */
+struct lc3_verification_result
+{
+    bool passed = true;
+    std::vector<lc3_verification_check> checks;
+};
+
+/** lc3_parse_verification
+  *
+  * Decodes and validates a verification string once, cached like lc3_parse_replay.
+  * @param verification_string Verification string.
+  * @return The parsed verification string.
+  */
+std::shared_ptr<const VerificationPlan> lc3_parse_verification(const std::string& verification_string);
+/** lc3_begin_verification
+  *
+  * Records the initial registers and starts recording output and calls into context.
+  * Call after the machine is set up and before it runs, lc3_end_verification must be called before context goes away.
+  * Only the functions added for context are removed later, anything else listening to the events is left alone.
+  * @param state LC3State object.
+  * @param context Context to record the run into.
+  * @param plan If given, enough of the stack is recorded for its longest SUBROUTINE_CALL.
+  */
+void lc3_begin_verification(lc3_state& state, lc3_verification_context& context);
+void lc3_begin_verification(lc3_state& state, lc3_verification_context& context, const VerificationPlan& plan);
+/** lc3_end_verification
+  *
+  * Stops recording into context, the recorded run is kept for lc3_run_verification.
+  * @param state LC3State object.
+  * @param context Context given to lc3_begin_verification.
+  */
+void lc3_end_verification(lc3_state& state, lc3_verification_context& context);
+/** lc3_run_verification
+  *
+  * Checks every postcondition in a verification string against the final state, labels are looked up once.
+  * @param state LC3State object.
+  * @param verification_string Verification string.
+  * @param context Context recorded for the run.
+  * @return Result of each check.
+  */
+lc3_verification_result lc3_run_verification(lc3_state& state, const std::string& verification_string, const lc3_verification_context& context);
+lc3_verification_result lc3_run_verification(lc3_state& state, const VerificationPlan& plan, const lc3_verification_context& context);
 std::string lc3_describe_verification(const std::string& verification_string);
 
 #endif
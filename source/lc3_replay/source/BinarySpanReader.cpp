@@ -0,0 +1,68 @@
+#include <lc3_replay/BinarySpanReader.hpp>
+
+bool BinarySpanReader::ReadStringSize(uint32_t& count)
+{
+    count = width;
+    if ((flags & BinarySpanReader::READ_STRING_SIZES) && width == 0)
+        (*this) >> count;
+    width = 0;
+
+    if (!failed && count > max_string_size)
+        failed = true;
+    return !failed;
+}
+
+bool BinarySpanReader::ReadVectorSize(uint32_t& count)
+{
+    if (flags & BinarySpanReader::READ_VECTOR_SIZES)
+        (*this) >> count;
+
+    if (!failed && count > max_vector_size)
+        failed = true;
+    return !failed;
+}
+
+BinarySpanReader& BinarySpanReader::operator>>(std::string& val)
+{
+    std::string_view view;
+    (*this) >> view;
+    if (!failed)
+        val.assign(view.data(), view.size());
+    return *this;
+}
+
+BinarySpanReader& BinarySpanReader::operator>>(std::string_view& val)
+{
+    uint32_t count;
+    if (!ReadStringSize(count))
+        return *this;
+
+    const char* start = Take(count);
+    if (start)
+        val = std::string_view(start, count);
+    return *this;
+}
+
+BinarySpanReader& BinarySpanReader::operator>>(int16_view& val)
+{
+    uint32_t count = val.size();
+    if (!ReadVectorSize(count))
+        return *this;
+
+    const char* start = Take(count * sizeof(int16_t));
+    if (start)
+        val = int16_view(start, count);
+    return *this;
+}
+
+BinarySpanReader& operator>>(BinarySpanReader& cs, const set_width& width)
+{
+    cs.SetWidth(width.get_width());
+    return cs;
+}
+
+BinarySpanReader& operator>>(BinarySpanReader& cs, const set_flags& flags)
+{
+    cs.SetFlags(flags.get_flags());
+    return cs;
+}
@@ -0,0 +1,327 @@
+#include <lc3_replay/lc3_batch.hpp>
+#include <lc3_replay/lc3_replay.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+void lc3_setup_replay(lc3_state& state, const std::string& filename, std::istream& file, const std::string& replay_string, std::stringstream& newinput);
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+// Plugins are singletons owned by whichever state installed them last, so only one state may have them at a time.
+static std::mutex plugin_mutex;
+
+/** A file shared by all jobs that run it. */
+struct lc3_batch_image
+{
+    std::string source;
+    bool plugins = false;           // Loads plugins, jobs set up their own machine instead of cloning.
+    std::unique_ptr<lc3_state> machine;
+    std::string error;
+};
+
+/** Runs task(item, thread) for every item in [0, count).
+  * Each thread works through its own share of the items, then steals from the back of the others' shares.
+  */
+static void lc3_parallel_for(size_t count, unsigned int threads, const std::function<void(size_t, unsigned int)>& task)
+{
+    struct work_queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    std::vector<work_queue> queues(threads);
+    for (size_t i = 0; i < count; i++)
+        queues[i % threads].items.push_back(i);
+
+    auto worker = [&queues, &task, threads](unsigned int self)
+    {
+        while (true)
+        {
+            size_t item = 0;
+            bool found = false;
+            for (unsigned int i = 0; i < threads && !found; i++)
+            {
+                work_queue& queue = queues[(self + i) % threads];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.items.empty())
+                    continue;
+                if (i == 0)
+                {
+                    item = queue.items.front();
+                    queue.items.pop_front();
+                }
+                else
+                {
+                    item = queue.items.back();
+                    queue.items.pop_back();
+                }
+                found = true;
+            }
+            // Nothing is added after starting, so all queues being empty means we are done.
+            if (!found)
+                return;
+            task(item, self);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++)
+        pool.emplace_back(worker, i);
+    worker(0);
+    for (auto& thread : pool)
+        thread.join();
+}
+
+static bool lc3_has_extension(const std::string& filename, const std::string& extension)
+{
+    return filename.size() >= extension.size() && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+/** Loads a file into state, it must be initialized. */
+static void lc3_batch_load(lc3_state& state, const std::string& filename, const std::string& source)
+{
+    std::istringstream file(source);
+    if (lc3_has_extension(filename, ".obj"))
+    {
+        lc3_load(state, file, lc3_reader_obj);
+    }
+    else if (lc3_has_extension(filename, ".hex"))
+    {
+        lc3_load(state, file, lc3_reader_hex);
+    }
+    else
+    {
+        LC3AssembleOptions options;
+        options.multiple_errors = false;
+        options.warnings_as_errors = false;
+        options.process_debug_comments = false;
+        options.enable_warnings = false;
+        lc3_assemble(state, file, options);
+    }
+}
+
+static void lc3_prepare_image(const std::string& filename, lc3_batch_image& image)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.good())
+    {
+        image.error = "Could not open " + filename + " for reading";
+        return;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    image.source = contents.str();
+    // Don't bother keeping a machine for programs that load plugins.
+    image.plugins = image.source.find("@plugin") != std::string::npos;
+    if (image.plugins)
+        return;
+
+    image.machine = std::make_unique<lc3_state>();
+    lc3_state& state = *image.machine;
+    lc3_init(state, false, false);
+    state.warning = nullptr;
+    try
+    {
+        lc3_batch_load(state, filename, image.source);
+    }
+    catch (const LC3AssembleException& e)
+    {
+        image.error = e.what();
+    }
+}
+
+static void lc3_run_batch_job(const lc3_batch_job& job, const lc3_batch_image& image, lc3_state& state, lc3_batch_result& result)
+{
+    if (!image.error.empty())
+    {
+        result.error = image.error;
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(plugin_mutex, std::defer_lock);
+    if (image.plugins)
+        lock.lock();
+
+    std::stringstream input;
+    try
+    {
+        if (!job.replay.empty())
+        {
+            // Replay strings only know the file's name.
+            std::istringstream file(image.source);
+            lc3_setup_replay(state, job.filename.substr(job.filename.find_last_of("/\\") + 1), file, job.replay, input);
+        }
+        else if (image.plugins)
+        {
+            lc3_init(state, false, false);
+            lc3_batch_load(state, job.filename, image.source);
+            input.str(job.input);
+        }
+        else
+        {
+            lc3_clone(state, *image.machine);
+            input.str(job.input);
+        }
+    }
+    catch (const LC3AssembleException& e)
+    {
+        result.error = e.what();
+    }
+    catch (const LC3ReplayStringException& e)
+    {
+        result.error = e.what();
+    }
+    catch (const std::exception& e)
+    {
+        result.error = e.what();
+    }
+
+    if (result.error.empty())
+    {
+        std::ostream discard(nullptr);
+        result.output_digest = FNV_OFFSET;
+        state.input = &input;
+        state.output = &discard;
+        state.writer = [&result](lc3_state&, std::ostream&, int32_t chr)
+        {
+            result.output_digest = (result.output_digest ^ static_cast<uint8_t>(chr)) * FNV_PRIME;
+            result.output_size++;
+            return 0;
+        };
+        lc3_set_output_flush(state, LC3_FLUSH_INPUT);
+        state.warning = nullptr;
+        // Nothing steps back through a job, recording undo history would keep it off the fast run mode.
+        lc3_set_undo(state, false);
+        result.fast = lc3_can_run_fast(state);
+
+        lc3_run(state, job.budget);
+
+        result.halted = state.halted;
+        result.timeout = !state.halted;
+        result.executions = state.executions;
+        result.warnings = state.warnings;
+        state.input = nullptr;
+        state.output = nullptr;
+    }
+
+    if (image.plugins)
+        lc3_remove_plugins(state);
+}
+
+std::vector<lc3_batch_result> lc3_run_batch(const std::vector<lc3_batch_job>& jobs, unsigned int threads, const std::function<void(const lc3_batch_result&)>& on_result)
+{
+    if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+
+    std::vector<lc3_batch_result> results(jobs.size());
+    if (jobs.empty())
+        return results;
+
+    // Load each file once.
+    std::unordered_map<std::string, size_t> image_index;
+    std::vector<std::string> filenames;
+    std::vector<size_t> job_image(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        auto it = image_index.emplace(jobs[i].filename, filenames.size()).first;
+        if (it->second == filenames.size())
+            filenames.push_back(jobs[i].filename);
+        job_image[i] = it->second;
+    }
+
+    std::vector<lc3_batch_image> images(filenames.size());
+    lc3_parallel_for(images.size(), static_cast<unsigned int>(std::min<size_t>(threads, images.size())), [&](size_t i, unsigned int)
+    {
+        lc3_prepare_image(filenames[i], images[i]);
+    });
+
+    // One machine per thread, reused so cloning into it can reuse its allocations.
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, jobs.size()));
+    std::vector<std::unique_ptr<lc3_state>> machines(threads);
+    for (auto& machine : machines)
+        machine = std::make_unique<lc3_state>();
+
+    std::mutex result_mutex;
+    lc3_parallel_for(jobs.size(), threads, [&](size_t i, unsigned int thread)
+    {
+        lc3_batch_result& result = results[i];
+        result.job = i;
+        lc3_run_batch_job(jobs[i], images[job_image[i]], *machines[thread], result);
+        if (on_result)
+        {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            on_result(result);
+        }
+    });
+
+    return results;
+}
+
+static void lc3_write_json_string(std::ostream& out, const std::string& str)
+{
+    out << '"';
+    for (const char c : str)
+    {
+        switch (c)
+        {
+            case '"':
+                out << "\\\"";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            case '\n':
+                out << "\\n";
+                break;
+            case '\t':
+                out << "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out << escaped;
+                }
+                else
+                {
+                    out << c;
+                }
+                break;
+        }
+    }
+    out << '"';
+}
+
+std::string lc3_format_batch_result(const lc3_batch_job& job, const lc3_batch_result& result)
+{
+    std::stringstream out;
+    out << "{\"job\":" << result.job << ",\"file\":";
+    lc3_write_json_string(out, job.filename);
+    if (!result.error.empty())
+    {
+        out << ",\"status\":\"error\",\"error\":";
+        lc3_write_json_string(out, result.error);
+        out << "}";
+        return out.str();
+    }
+
+    char digest[17];
+    snprintf(digest, sizeof(digest), "%016llx", static_cast<unsigned long long>(result.output_digest));
+    out << ",\"status\":\"" << (result.halted ? "halted" : "timeout") << "\""
+        << ",\"executions\":" << result.executions
+        << ",\"warnings\":" << result.warnings
+        << ",\"output_size\":" << result.output_size
+        << ",\"output_digest\":\"" << digest << "\"}";
+    return out.str();
+}
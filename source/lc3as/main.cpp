@@ -1,10 +1,146 @@
 #include <lc3.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+/** A file to assemble in batch mode. */
+struct batch_file
+{
+    std::string filename;
+    std::string prefix;
+    std::string error;      // Empty if the file was assembled and written.
+};
+
+// Manifests have one file per line with an optional output prefix, blank lines and lines starting with # are ignored.
+// asmfile [output_file_prefix]
+static bool read_manifest(const std::string& manifest, std::vector<batch_file>& files)
+{
+    std::ifstream file(manifest);
+    if (!file.good())
+    {
+        printf("Could not open %s.\n", manifest.c_str());
+        return false;
+    }
+
+    std::string line;
+    for (unsigned int line_number = 1; std::getline(file, line); line_number++)
+    {
+        std::istringstream fields(line);
+        batch_file entry;
+        if (!(fields >> entry.filename) || entry.filename[0] == '#')
+            continue;
+        fields >> entry.prefix;
+        std::string extra;
+        if (fields >> extra)
+        {
+            printf("%s:%u: Extra input found %s\n", manifest.c_str(), line_number, extra.c_str());
+            return false;
+        }
+        files.push_back(entry);
+    }
+    return true;
+}
+
+// Files with the same @plugin lines load the same plugins.
+static std::string plugin_lines(const std::string& source)
+{
+    std::string lines;
+    for (size_t found = source.find("@plugin"); found != std::string::npos; found = source.find("@plugin", found + 1))
+    {
+        size_t start = source.rfind('\n', found);
+        start = start == std::string::npos ? 0 : start + 1;
+        size_t end = source.find('\n', found);
+        end = end == std::string::npos ? source.size() : end;
+        lines.append(source, start, end - start).append("\n");
+        found = end;
+    }
+    return lines;
+}
+
+/** Assembles files on a thread pool, recording why each one failed if it did. */
+static void assemble_batch(std::vector<batch_file>& files, unsigned int threads, LC3AssembleOptions options)
+{
+    // Files are already spread over the threads, so each one is assembled on a single thread.
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, files.size()));
+    if (threads > 1)
+        options.threads = 1;
+
+    // Every file starts from a copy of the machine lc3_assemble would set up for it, so the output is the same.
+    auto base = std::make_unique<lc3_state>();
+    lc3_init(*base);
+
+    // Plugins are singletons owned by whichever state installed them last, so files that load plugins take turns on one
+    // machine which keeps the last set it loaded for the next file that wants the same ones.
+    std::mutex plugin_mutex;
+    auto plugin_machine = std::make_unique<lc3_state>();
+    std::string loaded_plugins;
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        auto machine = std::make_unique<lc3_state>();
+        for (size_t i = next++; i < files.size(); i = next++)
+        {
+            batch_file& file = files[i];
+            try
+            {
+                std::ifstream stream(file.filename.c_str());
+                if (!stream.good())
+                    throw LC3AssembleException("", file.filename, FILE_ERROR);
+                std::stringstream contents;
+                contents << stream.rdbuf();
+                const std::string source = contents.str();
+                const std::string plugins = options.disable_plugins ? "" : plugin_lines(source);
+
+                std::istringstream code(source);
+                std::vector<code_range> ranges;
+                bool written;
+                if (plugins.empty())
+                {
+                    lc3_clone(*machine, *base);
+                    lc3_assemble(*machine, code, ranges, options);
+                    written = lc3_assemble_write(file.prefix, *machine, ranges, options);
+                }
+                else
+                {
+                    std::lock_guard<std::mutex> lock(plugin_mutex);
+                    const bool cached = plugins == loaded_plugins;
+                    LC3AssembleOptions plugin_options = options;
+                    plugin_options.disable_plugins = cached;
+                    lc3_clone(*plugin_machine, *base, cached);
+                    // Only some of them may be loaded if this fails.
+                    loaded_plugins = cached ? plugins : "";
+                    lc3_assemble(*plugin_machine, code, ranges, plugin_options);
+                    loaded_plugins = plugins;
+                    written = lc3_assemble_write(file.prefix, *plugin_machine, ranges, options);
+                }
+
+                if (!written)
+                    file.error = "Could not write output files for " + file.prefix;
+            }
+            catch (const LC3AssembleException& e)
+            {
+                file.error = e.what();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& thread : pool)
+        thread.join();
+}
+
 int main(int argc, char** argv)
 {
     // Typical
@@ -12,6 +148,7 @@ int main(int argc, char** argv)
     {
 usage:
         printf("Usage: lc3as [-all_errors] [-disable_plugins] [-hex|-bin|-full] [asmfile] [output_file_prefix]\n");
+        printf("       lc3as -batch [-threads N] [-manifest file] [-all_errors] [-disable_plugins] [-hex|-bin|-full] [asmfile...]\n");
         return EXIT_FAILURE;
     }
 
@@ -19,6 +156,9 @@ usage:
     std::string outfile_prefix;
     LC3AssembleOptions options;
     std::vector<std::string> params;
+    bool batch = false;
+    unsigned int threads = 0;
+    std::string manifest;
 
     for (int i = 1; i < argc; i++)
     {
@@ -33,6 +173,12 @@ usage:
             options.output_mode = LC3AssembleOptions::OutputMode::BINARY_FILE;
         else if (arg == "-full")
             options.output_mode = LC3AssembleOptions::OutputMode::FULL_REPRESENTATION_FILE;
+        else if (arg == "-batch")
+            batch = true;
+        else if (arg == "-threads" && i + 1 < argc)
+            threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-manifest" && i + 1 < argc)
+            manifest = argv[++i];
         else if (arg[0] == '-') {
             printf("Invalid option %s given.\n", argv[i]);
             goto usage;
@@ -41,6 +187,45 @@ usage:
             params.emplace_back(argv[i]);
     }
 
+    if (batch)
+    {
+        std::vector<batch_file> files;
+        if (!manifest.empty() && !read_manifest(manifest, files))
+            return EXIT_FAILURE;
+        for (const auto& param : params)
+            files.push_back({param, "", ""});
+        if (files.empty())
+        {
+            printf("No asm files given.\n");
+            goto usage;
+        }
+        for (auto& file : files)
+        {
+            if (file.prefix.empty())
+                file.prefix = file.filename.substr(0, file.filename.rfind('.'));
+        }
+
+        if (threads == 0)
+            threads = std::max(1U, std::thread::hardware_concurrency());
+        assemble_batch(files, threads, options);
+
+        size_t failed = 0;
+        for (const auto& file : files)
+        {
+            if (file.error.empty())
+                continue;
+            printf("%s: %s\n", file.filename.c_str(), file.error.c_str());
+            failed++;
+        }
+        printf("Assembled %zu of %zu files.\n", files.size() - failed, files.size());
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    else if (!manifest.empty())
+    {
+        printf("-manifest is only valid with -batch.\n");
+        goto usage;
+    }
+
     if (params.empty())
     {
         printf("No asm file given.\n");
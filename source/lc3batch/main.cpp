@@ -0,0 +1,141 @@
+#include <lc3_replay/lc3_batch.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Job files have one job per line of space separated key=value pairs, blank lines and lines starting with # are ignored.
+// file=program.asm [replay=replay_string] [input_file=input.txt] [budget=instructions]
+static bool parse_job(const std::string& line, lc3_batch_job& job, std::string& error)
+{
+    std::istringstream fields(line);
+    std::string field;
+    while (fields >> field)
+    {
+        const size_t equals = field.find('=');
+        if (equals == std::string::npos)
+        {
+            error = "Expected key=value, got " + field;
+            return false;
+        }
+        const std::string key = field.substr(0, equals);
+        const std::string value = field.substr(equals + 1);
+        if (key == "file")
+        {
+            job.filename = value;
+        }
+        else if (key == "replay")
+        {
+            job.replay = value;
+        }
+        else if (key == "input_file")
+        {
+            std::ifstream input(value, std::ios::binary);
+            if (!input.good())
+            {
+                error = "Could not open " + value;
+                return false;
+            }
+            std::stringstream contents;
+            contents << input.rdbuf();
+            job.input = contents.str();
+        }
+        else if (key == "budget")
+        {
+            try
+            {
+                job.budget = static_cast<uint32_t>(std::stoul(value));
+            }
+            catch (const std::exception&)
+            {
+                error = "Invalid budget " + value;
+                return false;
+            }
+        }
+        else
+        {
+            error = "Unknown key " + key;
+            return false;
+        }
+    }
+
+    if (job.filename.empty())
+    {
+        error = "No file given";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+usage:
+        printf("Usage: lc3batch [-threads N] jobfile\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned int threads = 0;
+    std::vector<std::string> params;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string& arg = argv[i];
+        if (arg == "-threads" && i + 1 < argc)
+            threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg[0] == '-') {
+            printf("Invalid option %s given.\n", argv[i]);
+            goto usage;
+        }
+        else
+            params.emplace_back(argv[i]);
+    }
+
+    if (params.empty())
+    {
+        printf("No job file given.\n");
+        goto usage;
+    }
+    else if (params.size() > 1)
+    {
+        printf("Too many parameters given.\n");
+        goto usage;
+    }
+
+    std::ifstream file(params[0]);
+    if (!file.good())
+    {
+        printf("Could not open %s.\n", params[0].c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<lc3_batch_job> jobs;
+    std::string line;
+    for (unsigned int line_number = 1; std::getline(file, line); line_number++)
+    {
+        if (line.find_first_not_of(" \t\r") == std::string::npos || line[line.find_first_not_of(" \t")] == '#')
+            continue;
+
+        lc3_batch_job job;
+        std::string error;
+        if (!parse_job(line, job, error))
+        {
+            printf("%s:%u: %s\n", params[0].c_str(), line_number, error.c_str());
+            return EXIT_FAILURE;
+        }
+        jobs.push_back(job);
+    }
+
+    // Results are printed as jobs finish, each line says which job it is for.
+    bool failed = false;
+    lc3_run_batch(jobs, threads, [&](const lc3_batch_result& result)
+    {
+        failed = failed || !result.error.empty() || result.timeout;
+        std::cout << lc3_format_batch_result(jobs[result.job], result) << std::endl;
+    });
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+#include <lc3.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+usage:
+        printf("Usage: lc3trace [-csv] [-sym symbol_file] [tracefile]\n");
+        return EXIT_FAILURE;
+    }
+
+    bool csv = false;
+    std::string symbol_file;
+    std::vector<std::string> params;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string& arg = argv[i];
+        if (arg == "-csv")
+            csv = true;
+        else if (arg == "-sym" && i + 1 < argc)
+            symbol_file = argv[++i];
+        else if (arg[0] == '-') {
+            printf("Invalid option %s given.\n", argv[i]);
+            goto usage;
+        }
+        else
+            params.emplace_back(argv[i]);
+    }
+
+    if (params.empty())
+    {
+        printf("No trace file given.\n");
+        goto usage;
+    }
+    else if (params.size() > 1)
+    {
+        printf("Too many parameters given.\n");
+        goto usage;
+    }
+
+    std::ifstream file(params[0], std::ios::binary);
+    if (!file.good())
+    {
+        printf("Could not open %s.\n", params[0].c_str());
+        return EXIT_FAILURE;
+    }
+
+    lc3_trace_reader reader(file);
+    if (!reader.error().empty())
+    {
+        printf("%s: %s\n", params[0].c_str(), reader.error().c_str());
+        return EXIT_FAILURE;
+    }
+
+    // Only used for disassembling.
+    lc3_state state;
+    lc3_init(state, false, false);
+    lc3_set_version(state, reader.version());
+    if (!symbol_file.empty())
+    {
+        std::ifstream symbols(symbol_file);
+        if (!symbols.good() || lc3_load_sym(state, symbols))
+        {
+            printf("Could not load symbols from %s.\n", symbol_file.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (csv)
+        lc3_write_trace_csv_header(std::cout);
+
+    lc3_trace_step step;
+    while (reader.next(step))
+    {
+        if (csv)
+            lc3_write_trace_csv(state, std::cout, step);
+        else
+            lc3_write_trace_text(state, std::cout, step.pc, step.instruction, step.regs.data(), step.n, step.z);
+    }
+    std::cout.flush();
+
+    if (!reader.error().empty())
+    {
+        fprintf(stderr, "%s: %s\n", params[0].c_str(), reader.error().c_str());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
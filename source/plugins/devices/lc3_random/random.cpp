@@ -38,6 +38,7 @@ RandomPlugin::RandomPlugin(uint16_t address, unsigned int seed) :
     distribution(-32768, 32767)
 {
     BindAddress(address);
+    ScheduleNever();
 }
 
 int16_t RandomPlugin::OnRead(lc3_state& state, uint16_t addr)
@@ -6,8 +6,8 @@
 
 #include <random>
 
-#define RANDOM_MAJOR_VERSION 1
-#define RANDOM_MINOR_VERSION 6
+#define RANDOM_MAJOR_VERSION 2
+#define RANDOM_MINOR_VERSION 0
 
 class LC3_RANDOM_API RandomPlugin : public Plugin
 {
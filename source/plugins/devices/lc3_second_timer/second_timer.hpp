@@ -4,8 +4,8 @@
 #include <lc3.hpp>
 #include <lc3_second_timer/lc3_second_timer_api.h>
 
-#define SECOND_TIMER_MAJOR_VERSION 1
-#define SECOND_TIMER_MINOR_VERSION 6
+#define SECOND_TIMER_MAJOR_VERSION 2
+#define SECOND_TIMER_MINOR_VERSION 0
 
 ///TODO complete this plugin
 class LC3_SECOND_TIMER_API SecondTimerPlugin : public Plugin
@@ -6,8 +6,8 @@
 #include <lc3.hpp>
 #include <lc3_timer/lc3_timer_api.h>
 
-#define TIMER_MAJOR_VERSION 1
-#define TIMER_MINOR_VERSION 6
+#define TIMER_MAJOR_VERSION 2
+#define TIMER_MINOR_VERSION 0
 
 ///TODO complete this plugin
 class LC3_TIMER_API TimerPlugin : public Plugin
@@ -4,13 +4,13 @@
 #include <lc3.hpp>
 #include <lc3_multiply/lc3_multiply_api.h>
 
-#define MULTIPLY_MAJOR_VERSION 1
-#define MULTIPLY_MINOR_VERSION 6
+#define MULTIPLY_MAJOR_VERSION 2
+#define MULTIPLY_MINOR_VERSION 0
 
 class LC3_MULTIPLY_API MultiplyPlugin : public InstructionPlugin
 {
 public:
-    MultiplyPlugin() : InstructionPlugin(MULTIPLY_MAJOR_VERSION, MULTIPLY_MINOR_VERSION, "Multiplication Plugin") {}
+    MultiplyPlugin() : InstructionPlugin(MULTIPLY_MAJOR_VERSION, MULTIPLY_MINOR_VERSION, "Multiplication Plugin") {ScheduleNever();}
     std::string GetOpcode() const override;
     uint16_t DoAssembleOne(lc3_state& state, LC3AssembleContext& context) override;
     void OnExecute(lc3_state& state, const lc3_instruction& instruction, lc3_state_change& changes) override;
@@ -43,6 +43,7 @@ BWLCDPlugin::BWLCDPlugin(uint16_t _width, uint16_t _height, uint16_t _initaddr,
 {
     BindAddress(initaddr);
     BindNAddresses(startaddr, width * height);
+    ScheduleNever();
 }
 
 void BWLCDPlugin::OnWrite(lc3_state& state, uint16_t address, int16_t value)
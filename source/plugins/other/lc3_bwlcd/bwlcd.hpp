@@ -10,8 +10,8 @@
 
 #include "bwlcdgui.h"
 
-#define BWLCD_MAJOR_VERSION 1
-#define BWLCD_MINOR_VERSION 6
+#define BWLCD_MAJOR_VERSION 2
+#define BWLCD_MINOR_VERSION 0
 
 class BWLCD : public BWLCDGUI
 {
@@ -39,6 +39,7 @@ ColorLCDPlugin::ColorLCDPlugin(uint16_t _width, uint16_t _height, uint16_t _init
 {
     BindAddress(initaddr);
     BindNAddresses(startaddr, width * height);
+    ScheduleNever();
 }
 
 void ColorLCDPlugin::OnWrite(lc3_state& state, uint16_t address, int16_t value)
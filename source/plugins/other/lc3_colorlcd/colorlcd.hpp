@@ -11,8 +11,8 @@
 
 #include "colorlcdgui.h"
 
-#define COLORLCD_MAJOR_VERSION 1
-#define COLORLCD_MINOR_VERSION 6
+#define COLORLCD_MAJOR_VERSION 2
+#define COLORLCD_MINOR_VERSION 0
 
 class ColorLCD : public COLORLCDGUI
 {
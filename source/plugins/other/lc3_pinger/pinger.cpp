@@ -28,18 +28,15 @@ void destroy_plugin(Plugin* ptr)
 }
 
 PingerPlugin::PingerPlugin(uint16_t ping_interval, unsigned int prio, unsigned char vec) :
-        Plugin(PINGER_MAJOR_VERSION, PINGER_MINOR_VERSION, LC3_OTHER, "Pinger plugin"), interval(ping_interval), priority(prio), ticks(0), int_vector(vec)
+        Plugin(PINGER_MAJOR_VERSION, PINGER_MINOR_VERSION, LC3_OTHER, "Pinger plugin"), interval(ping_interval), priority(prio), int_vector(vec)
 {
     BindInterrupt(vec);
+    // Pings on every interval + 1th instruction.
+    ScheduleEvery(interval + 1U, PLUGIN_HOOK_TICK);
 }
 
 
 void PingerPlugin::OnTick(lc3_state& state)
 {
-    ticks++;
-    if (ticks > interval)
-    {
-        ticks = 0;
-        lc3_signal_interrupt_once(state, priority, int_vector);
-    }
+    lc3_signal_interrupt_once(state, priority, int_vector);
 }
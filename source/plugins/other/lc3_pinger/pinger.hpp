@@ -4,8 +4,8 @@
 #include <lc3.hpp>
 #include <lc3_pinger/lc3_pinger_api.h>
 
-#define PINGER_MAJOR_VERSION 1
-#define PINGER_MINOR_VERSION 6
+#define PINGER_MAJOR_VERSION 2
+#define PINGER_MINOR_VERSION 0
 
 class LC3_PINGER_API PingerPlugin : public Plugin
 {
@@ -15,7 +15,6 @@ public:
 private:
     unsigned int interval;
     unsigned int priority;
-    unsigned int ticks;
     unsigned char int_vector;
 };
 
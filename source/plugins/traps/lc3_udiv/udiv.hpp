@@ -4,13 +4,13 @@
 #include <lc3.hpp>
 #include <lc3_udiv/lc3_udiv_api.h>
 
-#define UDIV_MAJOR_VERSION 1
-#define UDIV_MINOR_VERSION 6
+#define UDIV_MAJOR_VERSION 2
+#define UDIV_MINOR_VERSION 0
 
 class LC3_UDIV_API UdivPlugin : public TrapFunctionPlugin
 {
 public:
-    explicit UdivPlugin(unsigned char vector) : TrapFunctionPlugin(UDIV_MAJOR_VERSION, UDIV_MINOR_VERSION, "Division and Modulus Trap", vector) {}
+    explicit UdivPlugin(unsigned char vector) : TrapFunctionPlugin(UDIV_MAJOR_VERSION, UDIV_MINOR_VERSION, "Division and Modulus Trap", vector) {ScheduleNever();}
     std::string GetTrapName() const override {return "UDIV";}
     void OnExecute(lc3_state& state, lc3_state_change& changes) override;
 };
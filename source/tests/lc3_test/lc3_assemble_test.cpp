@@ -2,6 +2,7 @@
 #include <fstream>
 #include <iostream>
 #include <istream>
+#include <memory>
 #include <sstream>
 #include <vector>
 #include <lc3.hpp>
@@ -219,6 +220,149 @@ BOOST_FIXTURE_TEST_CASE(InvalidSymbolTest, LC3AssembleTest)
     BOOST_CHECK_EXCEPTION(lc3_assemble(state, invalid_sym, options), LC3AssembleException, IS_EXCEPTION(INVALID_SYMBOL));
 }
 
+BOOST_FIXTURE_TEST_CASE(CrlfTest, LC3AssembleTest)
+{
+    std::istringstream file(
+        ".orig x3000\r\n"
+        "ADD R0, R0, 1 ; comment\r\n"
+        "LABEL .stringz \"hi\"\r\n"
+        ".end\r\n"
+    );
+    lc3_assemble(state, file, options);
+
+    BOOST_CHECK_EQUAL(state.mem[0x3000], 0x1021);
+    BOOST_CHECK_EQUAL(state.mem[0x3001], 'h');
+    BOOST_CHECK_EQUAL(state.mem[0x3002], 'i');
+    BOOST_CHECK_EQUAL(state.mem[0x3003], 0);
+    BOOST_CHECK_EQUAL(lc3_sym_lookup(state, "LABEL"), 0x3001);
+}
+
+BOOST_FIXTURE_TEST_CASE(MissingEndTest, LC3AssembleTest)
+{
+    std::istringstream file(
+        ".orig x3000\n"
+        "ADD R0, R0, 1\n"
+    );
+    BOOST_CHECK_EXCEPTION(lc3_assemble(state, file, options), LC3AssembleException, IS_EXCEPTION(ORIG_MATCHUP));
+}
+
+BOOST_FIXTURE_TEST_CASE(StraySymbolTest, LC3AssembleTest)
+{
+    // A label on its own line labels the next instruction.
+    std::istringstream label(
+        ".orig x3000\n"
+        "FOO\n"
+        "ADD R0, R0, 1\n"
+        ".end\n"
+    );
+    lc3_assemble(state, label, options);
+    BOOST_CHECK_EQUAL(state.mem[0x3000], 0x1021);
+    BOOST_CHECK_EQUAL(lc3_sym_lookup(state, "FOO"), 0x3000);
+
+    std::istringstream after_instruction(
+        ".orig x3000\n"
+        "ADD R0, R0, 1 FOO\n"
+        ".end\n"
+    );
+    BOOST_CHECK_EXCEPTION(lc3_assemble(state, after_instruction, options), LC3AssembleException, IS_EXCEPTION(SYNTAX_ERROR));
+
+    std::istringstream after_end(
+        ".orig x3000\n"
+        "ADD R0, R0, 1\n"
+        ".end\n"
+        "FOO\n"
+    );
+    BOOST_CHECK_EXCEPTION(lc3_assemble(state, after_end, options), LC3AssembleException, IS_EXCEPTION(STRAY_DATA));
+}
+
+BOOST_FIXTURE_TEST_CASE(MultipleErrorsTest, LC3AssembleTest)
+{
+    const std::string code =
+        ".orig x3000\n"
+        "ADD R9, R0, 1\n"
+        "LD R0, NOPE\n"
+        "ADD R0, R0, 99\n"
+        ".end\n";
+
+    std::istringstream first(code);
+    BOOST_CHECK_EXCEPTION(lc3_assemble(state, first, options), LC3AssembleException, IS_EXCEPTION(INVALID_REGISTER));
+
+    // Every error is reported in order, same as lc3as -all_errors.
+    options.multiple_errors = true;
+    std::istringstream all(code);
+    try
+    {
+        lc3_assemble(state, all, options);
+        BOOST_FAIL("Expected an exception");
+    }
+    catch (const LC3AssembleException& e)
+    {
+        BOOST_CHECK_EQUAL(e.get_id(), MULTIPLE_ERRORS);
+        BOOST_CHECK_EQUAL(std::string(e.what()),
+            "E027: Failed due to multiple errors. Reasons below.\n"
+            "-----\n"
+            "E010: Invalid register R9 on line 1\n"
+            "E006: Undefined symbol NOPE on line 2\n"
+            "E017: 99is too big for an immediate value. Expected 5 bits got 8 bits on line 3\n");
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(AssembleWriteTest, LC3AssembleTest)
+{
+    const std::string asm_file = "lc3_assemble_write_test.asm";
+    {
+        std::ofstream file(asm_file);
+        file << ".orig x3000\n"
+                "START LEA R0, MSG\n"
+                "   PUTS\n"
+                "   HALT\n"
+                "MSG .stringz \"hi\"\n"
+                ".end\n"
+                ".orig x4000\n"
+                "DATA .fill 7\n"
+                ".end\n";
+    }
+    auto read_file = [](const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    };
+
+    // Assembling into a clone of an initialized machine and writing it gives the same files as lc3_assemble does.
+    for (const auto mode : {LC3AssembleOptions::OutputMode::OBJECT_FILE, LC3AssembleOptions::OutputMode::HEXADECIMAL_FILE})
+    {
+        options.output_mode = mode;
+        const std::string extension = mode == LC3AssembleOptions::OutputMode::OBJECT_FILE ? ".obj" : ".hex";
+        BOOST_REQUIRE(lc3_assemble(asm_file, "lc3_assemble_write_test_single", options));
+
+        auto base = std::make_unique<lc3_state>();
+        lc3_init(*base);
+        auto machine = std::make_unique<lc3_state>();
+        lc3_clone(*machine, *base);
+        std::ifstream file(asm_file);
+        std::vector<code_range> ranges;
+        options.threads = 1;
+        lc3_assemble(*machine, file, ranges, options);
+        BOOST_REQUIRE_EQUAL(ranges.size(), 2);
+        BOOST_REQUIRE(lc3_assemble_write("lc3_assemble_write_test_clone", *machine, ranges, options));
+
+        const std::string single = read_file("lc3_assemble_write_test_single" + extension);
+        BOOST_CHECK(!single.empty());
+        BOOST_CHECK(single == read_file("lc3_assemble_write_test_clone" + extension));
+        BOOST_CHECK_EQUAL(read_file("lc3_assemble_write_test_single.sym"), read_file("lc3_assemble_write_test_clone.sym"));
+        std::remove(("lc3_assemble_write_test_single" + extension).c_str());
+        std::remove(("lc3_assemble_write_test_clone" + extension).c_str());
+
+        BOOST_CHECK(!lc3_assemble_write("lc3_assemble_write_test_missing/out", *machine, ranges, options));
+    }
+
+    std::remove("lc3_assemble_write_test_single.sym");
+    std::remove("lc3_assemble_write_test_clone.sym");
+    std::remove(asm_file.c_str());
+}
+
 BOOST_FIXTURE_TEST_CASE(BinaryLiteralTest, LC3AssembleTest)
 {
     std::istringstream file(
@@ -373,3 +517,82 @@ BOOST_FIXTURE_TEST_CASE(InvalidImmediateOffsetTest, LC3AssembleTest)
     );
     BOOST_CHECK_EXCEPTION(lc3_assemble(state, file, options), LC3AssembleException, IS_EXCEPTION(OFFSET_OVERFLOW));
 }
+
+BOOST_FIXTURE_TEST_CASE(OperandSeparatorTest, LC3AssembleTest)
+{
+    // Operands are separated by commas, whitespace around them doesn't matter.
+    BOOST_CHECK_EQUAL(lc3_assemble_one(state, 0x3000, "ADD R0 ,R1 ,\tR2"), 0x1042);
+    BOOST_CHECK_EQUAL(lc3_assemble_one(state, 0x3000, "ADD R0,,R1,R2"), 0x1042);
+    BOOST_CHECK_EQUAL(lc3_assemble_one(state, 0x3000, "ADD R0, R1, R2,"), 0x1042);
+    BOOST_CHECK_EXCEPTION(lc3_assemble_one(state, 0x3000, "ADD R0, R1 R2", -1, options), LC3AssembleException, IS_EXCEPTION(SYNTAX_ERROR));
+    BOOST_CHECK_EXCEPTION(lc3_assemble_one(state, 0x3000, "ADD R0, , R1, R2", -1, options), LC3AssembleException, IS_EXCEPTION(EXTRA_INPUT));
+    BOOST_CHECK_EXCEPTION(lc3_assemble_one(state, 0x3000, "ADD R0, , R1", -1, options), LC3AssembleException, IS_EXCEPTION(INVALID_REGISTER));
+
+    // Same after a label.
+    std::istringstream file(
+        ".orig x3000\n"
+        "A B ADD R0 ,R1 ,\tR2\n"
+        "C NOT R3, R4 ; R5\n"
+        ".end"
+    );
+    lc3_assemble(state, file, options);
+    BOOST_CHECK_EQUAL(state.mem[0x3000], 0x1042);
+    BOOST_CHECK_EQUAL(state.mem[0x3001], static_cast<int16_t>(0x973F));
+
+    file.clear();
+    file.str(
+        ".orig x3000\n"
+        "D NOT R3 R4\n"
+        ".end"
+    );
+    BOOST_CHECK_EXCEPTION(lc3_assemble(state, file, options), LC3AssembleException, IS_EXCEPTION(SYNTAX_ERROR));
+}
+
+BOOST_FIXTURE_TEST_CASE(LargeFileTest, LC3AssembleTest)
+{
+    // Big enough that the second pass is split up on machines with more than one core.
+    std::stringstream source;
+    source << ".orig x3000\n";
+    for (int i = 0; i < 6000; i++)
+        source << "L" << i << " ADD R0, R0, #" << (i % 16) << "\n";
+    source << "LEA R0, MSG\n"
+              "BRnzp L5999\n"
+              "MSG .stringz \"done\"\n"
+              ".end\n"
+              ".orig x5000\n"
+              "DATA .fill L0\n";
+    for (int i = 0; i < 6000; i++)
+        source << ".fill #" << i << "\n";
+    source << ".end\n";
+
+    std::istringstream file(source.str());
+    lc3_assemble(state, file, options);
+    BOOST_CHECK_EQUAL(state.mem[0x3000], 0x1020);
+    BOOST_CHECK_EQUAL(state.mem[0x3000 + 5999], 0x102F);
+    BOOST_CHECK_EQUAL(state.mem[0x3000 + 6000], static_cast<int16_t>(0xE001));
+    BOOST_CHECK_EQUAL(state.mem[0x3000 + 6001], static_cast<int16_t>(0x0FFD));
+    BOOST_CHECK_EQUAL(state.mem[0x3000 + 6002], 'd');
+    BOOST_CHECK_EQUAL(state.mem[0x3000 + 6006], 0);
+    BOOST_CHECK_EQUAL(state.mem[0x5000], 0x3000);
+    BOOST_CHECK_EQUAL(state.mem[0x5000 + 6000], 5999);
+
+    // Errors come out in line order no matter where the file was split.
+    std::string text = source.str();
+    text.replace(text.find("L10 ADD R0, R0, #10"), 19, "L10 ADD R8, R0, #10");
+    text.replace(text.find(".fill #5998"), 11, ".fill #99999");
+    options.multiple_errors = true;
+    file.clear();
+    file.str(text);
+    try
+    {
+        lc3_assemble(state, file, options);
+        BOOST_ERROR("Expected an exception");
+    }
+    catch (const LC3AssembleException& e)
+    {
+        const std::string message = e.what();
+        BOOST_REQUIRE_NE(message.find("on line 11\n"), std::string::npos);
+        BOOST_REQUIRE_NE(message.find("on line 12005\n"), std::string::npos);
+        BOOST_CHECK_LT(message.find("on line 11\n"), message.find("on line 12005\n"));
+    }
+}
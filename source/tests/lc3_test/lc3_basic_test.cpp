@@ -4,6 +4,10 @@
 #include <istream>
 #include <fstream>
 #include <vector>
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <thread>
 #include <lc3.hpp>
 #include <lc3/ExpressionEvaluator.hpp>
 
@@ -637,6 +641,30 @@ BOOST_FIXTURE_TEST_CASE(TestMemoryInstructions, LC3BasicTest)
     BOOST_CHECK_EQUAL(state.p, 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(TestSelfModifyingCode, LC3BasicTest)
+{
+    // ADD R0, R0, #1
+    // ST R1, #-2
+    // BR #-3
+    state.pc = 0x3000;
+    state.regs[0] = 0;
+    state.regs[1] = 0x1022;
+    state.mem[0x3000] = 0x1021;
+    state.mem[0x3001] = 0x33FE;
+    state.mem[0x3002] = 0x0FFD;
+
+    lc3_run(state, 4);
+    // The store replaced the ADD with ADD R0, R0, #2
+    BOOST_CHECK_EQUAL(state.regs[0], 3);
+    BOOST_CHECK_EQUAL(state.pc, 0x3001);
+
+    // Edits made directly to memory are picked up as well.
+    state.pc = 0x3000;
+    state.mem[0x3000] = 0x1023;
+    lc3_step(state);
+    BOOST_CHECK_EQUAL(state.regs[0], 6);
+}
+
 BOOST_FIXTURE_TEST_CASE(TestLoadObj, LC3BasicTest)
 {
     std::stringstream file(std::string(reinterpret_cast<char*>(simple), simple_len));
@@ -744,6 +772,215 @@ BOOST_FIXTURE_TEST_CASE(TestRun, LC3BasicTest)
     BOOST_CHECK_EQUAL(state.undo_stack.size(), 4U);
 }
 
+BOOST_FIXTURE_TEST_CASE(TestRunFast, LC3BasicTest)
+{
+    std::stringstream file(std::string(reinterpret_cast<char*>(simple), simple_len));
+    lc3_load(state, file, lc3_reader_obj);
+
+    // Undo stack is enabled by default.
+    BOOST_CHECK(!lc3_can_run_fast(state));
+    lc3_set_undo(state, true);
+    BOOST_CHECK(!lc3_can_run_fast(state));
+    lc3_set_undo(state, false);
+    BOOST_CHECK(lc3_can_run_fast(state));
+    state.breakpoints[0x3002] = lc3_debug_info();
+    BOOST_CHECK(!lc3_can_run_fast(state));
+    state.breakpoints.clear();
+
+    BOOST_CHECK_EQUAL(lc3_run_fast(state, 2), 2U);
+    BOOST_CHECK_EQUAL(state.pc, 0x3002U);
+    BOOST_CHECK_EQUAL(state.executions, 2U);
+
+    lc3_run(state);
+
+    BOOST_CHECK_EQUAL(state.pc, 0x3003U);
+    BOOST_CHECK_EQUAL(state.regs[0], 60);
+    BOOST_CHECK_EQUAL(state.regs[1], 6);
+    BOOST_CHECK_EQUAL(state.regs[2], 66);
+    BOOST_CHECK_EQUAL(state.n, 0);
+    BOOST_CHECK_EQUAL(state.z, 0);
+    BOOST_CHECK_EQUAL(state.p, 1);
+    BOOST_CHECK_EQUAL(state.halted, 1);
+    BOOST_CHECK_EQUAL(state.executions, 4U);
+    BOOST_CHECK_EQUAL(state.undo_stack.size(), 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestTranslateBlock, LC3BasicTest)
+{
+    std::stringstream file(std::string(reinterpret_cast<char*>(simple), simple_len));
+    lc3_load(state, file, lc3_reader_obj);
+
+    // LD, LD, ADD then HALT ends the block.
+    const lc3_block& block = lc3_fetch_block(state, 0x3000);
+    BOOST_CHECK_EQUAL(block.ops.size(), 3U);
+    BOOST_CHECK_EQUAL(block.words.size(), 4U);
+    BOOST_CHECK_EQUAL(&lc3_fetch_block(state, 0x3000), &block);
+
+    // Changing memory causes it to be retranslated.
+    state.mem[0x3003] = 0x0FFC;
+    BOOST_CHECK_EQUAL(lc3_fetch_block(state, 0x3000).ops.size(), 4U);
+
+    BOOST_CHECK_EQUAL(lc3_execute_block(state, lc3_fetch_block(state, 0x3000), 2), 2U);
+    BOOST_CHECK_EQUAL(state.pc, 0x3002U);
+    BOOST_CHECK_EQUAL(state.regs[0], 60);
+    BOOST_CHECK_EQUAL(state.regs[1], 6);
+    BOOST_CHECK_EQUAL(state.executions, 2U);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestRunFastSelfModifyingCode, LC3BasicTest)
+{
+    // ADD R0, R0, #1
+    // ST R1, #-2
+    // ADD R0, R0, #1
+    // BR #-4
+    state.pc = 0x3000;
+    state.max_stack_size = 0;
+    state.regs[0] = 0;
+    state.regs[1] = 0x1024;
+    state.mem[0x3000] = 0x1021;
+    state.mem[0x3001] = 0x33FE;
+    state.mem[0x3002] = 0x1021;
+    state.mem[0x3003] = 0x0FFC;
+
+    lc3_run(state, 5);
+    // The store replaced the first ADD with ADD R0, R0, #4
+    BOOST_CHECK_EQUAL(state.regs[0], 6);
+    BOOST_CHECK_EQUAL(state.pc, 0x3001U);
+    BOOST_CHECK_EQUAL(state.executions, 5U);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestRunJit, LC3BasicTest)
+{
+    // ADD R0, R0, #1
+    // ADD R1, R1, #-1
+    // BRp #-3
+    // HALT
+    state.pc = 0x3000;
+    state.max_stack_size = 0;
+    state.regs[0] = 0;
+    state.regs[1] = 1000;
+    state.mem[0x3000] = 0x1021;
+    state.mem[0x3001] = 0x127F;
+    state.mem[0x3002] = 0x03FD;
+    state.mem[0x3003] = static_cast<int16_t>(0xF025);
+
+    // Stops in the middle of the loop.
+    lc3_run_jit(state, 100);
+    BOOST_CHECK_EQUAL(state.regs[0], 34);
+    BOOST_CHECK_EQUAL(state.regs[1], 967);
+    BOOST_CHECK_EQUAL(state.pc, 0x3001U);
+    BOOST_CHECK_EQUAL(state.executions, 100U);
+
+    lc3_run_jit(state);
+    BOOST_CHECK_EQUAL(state.regs[0], 1000);
+    BOOST_CHECK_EQUAL(state.regs[1], 0);
+    BOOST_CHECK_EQUAL(state.n, 0);
+    BOOST_CHECK_EQUAL(state.z, 1);
+    BOOST_CHECK_EQUAL(state.p, 0);
+    BOOST_CHECK_EQUAL(state.halted, 1);
+    BOOST_CHECK_EQUAL(state.executions, 3001U);
+
+    // Changing the loop retranslates it, so it is compiled again.
+    // ADD R0, R0, #2
+    const uint32_t generation = state.block_cache[0x3000].generation;
+    state.mem[0x3000] = 0x1022;
+    state.pc = 0x3000;
+    state.halted = 0;
+    state.regs[0] = 0;
+    state.regs[1] = 1000;
+    lc3_run_jit(state);
+    BOOST_CHECK_NE(state.block_cache[0x3000].generation, generation);
+    BOOST_CHECK_EQUAL(state.regs[0], 2000);
+    BOOST_CHECK_EQUAL(state.regs[1], 0);
+
+    // Same as TestRunFastSelfModifyingCode.
+    lc3_init(state, false, false);
+    state.pc = 0x3000;
+    state.max_stack_size = 0;
+    state.regs[0] = 0;
+    state.regs[1] = 0x1024;
+    state.mem[0x3000] = 0x1021;
+    state.mem[0x3001] = 0x33FE;
+    state.mem[0x3002] = 0x1021;
+    state.mem[0x3003] = 0x0FFC;
+
+    lc3_run_jit(state, 5);
+    BOOST_CHECK_EQUAL(state.regs[0], 6);
+    BOOST_CHECK_EQUAL(state.pc, 0x3001U);
+    BOOST_CHECK_EQUAL(state.executions, 5U);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestRunJitFlush, LC3BasicTest)
+{
+    struct FlushCounter : std::stringbuf
+    {
+        int flushes = 0;
+        int sync() override
+        {
+            flushes++;
+            return std::stringbuf::sync();
+        }
+    };
+
+    // LEA R0, #2
+    // PUTS
+    // HALT
+    // .stringz "ab"
+    const int16_t program[] = {static_cast<int16_t>(0xE002), static_cast<int16_t>(0xF022), static_cast<int16_t>(0xF025), 'a', 'b', 0};
+    std::copy(std::begin(program), std::end(program), &state.mem[0x3000]);
+    state.pc = 0x3000;
+
+    FlushCounter counter;
+    std::ostream output(&counter);
+    state.output = &output;
+    lc3_set_output_flush(state, LC3_FLUSH_INPUT);
+
+    // Buffered output is flushed when it returns, even if the lc3 didn't halt.
+    lc3_run_jit(state, 2);
+    BOOST_CHECK(!state.halted);
+    BOOST_CHECK_EQUAL(counter.str(), "ab");
+    BOOST_CHECK_EQUAL(counter.flushes, 1);
+    BOOST_CHECK_EQUAL(state.output_pending, 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestMemoryProfiling, LC3BasicTest)
+{
+    std::stringstream file(std::string(reinterpret_cast<char*>(simple), simple_len));
+    lc3_load(state, file, lc3_reader_obj);
+
+    // Off by default.
+    lc3_mem_read(state, 0x3004);
+    BOOST_CHECK(state.memory_ops.empty());
+    BOOST_CHECK_EQUAL(state.total_reads, 0U);
+
+    lc3_set_memory_profiling(state, true);
+    lc3_mem_write(state, 0x4000, 1);
+    lc3_run(state);
+
+    BOOST_CHECK_EQUAL(state.total_reads, 2U);
+    BOOST_CHECK_EQUAL(state.total_writes, 1U);
+    BOOST_CHECK_EQUAL(state.memory_ops[0x3004].reads, 1U);
+    BOOST_CHECK_EQUAL(state.memory_ops[0x4000].writes, 1U);
+
+    const auto heatmap = lc3_memory_heatmap(state, 0x100);
+    BOOST_REQUIRE_EQUAL(heatmap.size(), 2U);
+    BOOST_CHECK_EQUAL(heatmap[0].start, 0x3000U);
+    BOOST_CHECK_EQUAL(heatmap[0].end, 0x30FFU);
+    BOOST_CHECK_EQUAL(heatmap[0].reads, 2U);
+    BOOST_CHECK_EQUAL(heatmap[1].start, 0x4000U);
+    BOOST_CHECK_EQUAL(heatmap[1].writes, 1U);
+
+    lc3_mem_read(state, 0x3005);
+    const auto hotspots = lc3_memory_hotspots(state, 2);
+    BOOST_REQUIRE_EQUAL(hotspots.size(), 2U);
+    BOOST_CHECK_EQUAL(hotspots[0].start, 0x3005U);
+    BOOST_CHECK_EQUAL(hotspots[0].reads, 2U);
+    BOOST_CHECK_EQUAL(hotspots[1].start, 0x3004U);
+
+    lc3_reset_memory_profile(state);
+    BOOST_CHECK(lc3_memory_hotspots(state).empty());
+}
+
 BOOST_FIXTURE_TEST_CASE(TestBack, LC3BasicTest)
 {
     std::stringstream file(std::string(reinterpret_cast<char*>(simple), simple_len));
@@ -966,6 +1203,579 @@ BOOST_FIXTURE_TEST_CASE(TestUndoStack, LC3BasicTest)
 
 }
 
+BOOST_FIXTURE_TEST_CASE(TestWarningRecords, LC3BasicTest)
+{
+    state.pc = 0x3001;
+    state.mem[0x3000] = static_cast<int16_t>(0xF021);
+    state.warn_limits[LC3_INVALID_CHARACTER_WRITE] = 3;
+    for (int i = 0; i < 5; i++)
+        lc3_warning(state, LC3_INVALID_CHARACTER_WRITE, i);
+
+    BOOST_CHECK_EQUAL(state.warnings, 5U);
+    BOOST_CHECK_EQUAL(state.warn_stats[LC3_INVALID_CHARACTER_WRITE], 5U);
+
+    // Only up to the limit is printed, followed by a notice.
+    std::string line;
+    std::vector<std::string> lines;
+    while (std::getline(warnings, line))
+        lines.push_back(line);
+    BOOST_REQUIRE_EQUAL(lines.size(), 4U);
+    BOOST_CHECK_EQUAL(lines[2], "Warning at x3000 (instruction - OUT): W007: Trying to write invalid character x0002.");
+    BOOST_CHECK(lines[3].find("Limit for previous warning") != std::string::npos);
+
+    // But everything is recorded.
+    auto records = lc3_recent_warnings(state);
+    BOOST_REQUIRE_EQUAL(records.size(), 5U);
+    BOOST_CHECK_EQUAL(records[4].arg1, 4);
+    BOOST_CHECK_EQUAL(lc3_format_warning(state, records[4]), "Warning at x3000 (instruction - OUT): W007: Trying to write invalid character x0004.");
+
+    // Without a stream nothing is formatted, older records are dropped.
+    state.warning = nullptr;
+    for (int i = 0; i < LC3_WARNING_LOG_SIZE + 10; i++)
+        lc3_warning(state, LC3_DISPLAY_NOT_READY, i);
+    records = lc3_recent_warnings(state);
+    BOOST_REQUIRE_EQUAL(records.size(), static_cast<size_t>(LC3_WARNING_LOG_SIZE));
+    BOOST_CHECK_EQUAL(records.front().arg1, 10);
+    BOOST_CHECK_EQUAL(records.back().id, static_cast<uint32_t>(LC3_DISPLAY_NOT_READY));
+    BOOST_CHECK_EQUAL(state.warnings, 5U + LC3_WARNING_LOG_SIZE + 10);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestUndoBudget, LC3BasicTest)
+{
+    // ADD R0, R0, #1
+    // BR #-2
+    state.pc = 0x3000;
+    state.regs[0] = 0;
+    state.mem[0x3000] = 0x1021;
+    state.mem[0x3001] = 0x0FFE;
+
+    state.undo_stack.set_budget(1024);
+    lc3_run(state, 1000);
+
+    BOOST_CHECK_LE(state.undo_stack.bytes(), 1024U);
+    BOOST_CHECK_GT(state.undo_stack.size(), 0U);
+    BOOST_CHECK_LT(state.undo_stack.size(), 1000U);
+
+    // The most recent instructions can still be undone.
+    const size_t undoable = state.undo_stack.size();
+    lc3_rewind(state);
+    BOOST_CHECK_EQUAL(state.executions, 1000U - undoable);
+    BOOST_CHECK_EQUAL(state.regs[0], static_cast<int16_t>((1000 - undoable + 1) / 2));
+    BOOST_CHECK(state.undo_stack.empty());
+
+    // Shrinking the budget discards the oldest records.
+    lc3_run(state, 10);
+    lc3_state_change newest = state.undo_stack.back();
+    state.undo_stack.set_budget(state.undo_stack.bytes() / 2);
+    BOOST_CHECK_EQUAL(state.undo_stack.size(), 5U);
+    BOOST_CHECK_EQUAL(state.undo_stack.back().pc, newest.pc);
+}
+
+BOOST_AUTO_TEST_CASE(TestUndoJournalWrap)
+{
+    // Records of different sizes in a small budget end up split across the end of the buffer.
+    lc3_undo_journal journal;
+    journal.set_budget(4096);
+    std::vector<lc3_state_change> pushed;
+    for (unsigned int i = 0; i < 500; i++)
+    {
+        lc3_state_change change{};
+        change.changes = (i % 3 == 0) ? LC3_MULTI_CHANGE : LC3_REGISTER_CHANGE;
+        change.pc = static_cast<uint16_t>(0x3000 + i);
+        change.location = static_cast<uint16_t>(i % 8);
+        change.value = static_cast<uint16_t>(i * 7);
+        change.warnings = i;
+        if (change.changes == LC3_MULTI_CHANGE)
+        {
+            for (unsigned int j = 0; j < i % 5 + 1; j++)
+                change.info.push_back(lc3_change_info{j % 2 == 0, static_cast<uint16_t>(0x4000 + j), static_cast<uint16_t>(i + j)});
+        }
+        journal.push_back(change);
+        pushed.push_back(change);
+    }
+
+    BOOST_REQUIRE_LT(journal.size(), pushed.size());
+    while (!journal.empty())
+    {
+        const lc3_state_change expected = pushed.back();
+        pushed.pop_back();
+        const lc3_state_change change = journal.back();
+        BOOST_REQUIRE_EQUAL(change.changes, expected.changes);
+        BOOST_CHECK_EQUAL(change.pc, expected.pc);
+        BOOST_CHECK_EQUAL(change.location, expected.location);
+        BOOST_CHECK_EQUAL(change.value, expected.value);
+        BOOST_CHECK_EQUAL(change.warnings, expected.warnings);
+        BOOST_REQUIRE_EQUAL(change.info.size(), expected.info.size());
+        for (size_t i = 0; i < change.info.size(); i++)
+        {
+            BOOST_CHECK_EQUAL(change.info[i].is_reg, expected.info[i].is_reg);
+            BOOST_CHECK_EQUAL(change.info[i].location, expected.info[i].location);
+            BOOST_CHECK_EQUAL(change.info[i].value, expected.info[i].value);
+        }
+        journal.pop_back();
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(TestSeek, LC3BasicTest)
+{
+    // ADD R0, R0, #1
+    // STR R0, R1, #0
+    // ADD R1, R1, #1
+    // BR #-4
+    state.pc = 0x3000;
+    state.regs[0] = 0;
+    state.regs[1] = 0x4000;
+    state.mem[0x3000] = 0x1021;
+    state.mem[0x3001] = 0x7040;
+    state.mem[0x3002] = 0x1261;
+    state.mem[0x3003] = 0x0FFC;
+
+    // Few checkpoints so older ones get thinned out.
+    lc3_set_checkpoints(state, 100, 0, 4);
+    lc3_run(state, 537);
+    const uint16_t pc = state.pc;
+    const int16_t r0 = state.regs[0];
+    const int16_t r1 = state.regs[1];
+
+    lc3_run(state, 463);
+    BOOST_REQUIRE_EQUAL(state.executions, 1000U);
+    BOOST_CHECK_LE(state.checkpoints.size(), 4U);
+    BOOST_CHECK_EQUAL(state.checkpoints.front().executions, 0U);
+
+    BOOST_REQUIRE(lc3_seek(state, 537));
+    BOOST_CHECK_EQUAL(state.executions, 537U);
+    BOOST_CHECK_EQUAL(state.pc, pc);
+    BOOST_CHECK_EQUAL(state.regs[0], r0);
+    BOOST_CHECK_EQUAL(state.regs[1], r1);
+    // Memory written after the target is rolled back, the STR for r0 has not executed yet.
+    BOOST_CHECK_EQUAL(state.mem[r1 - 1], r0 - 1);
+    BOOST_CHECK_EQUAL(state.mem[r1], 0);
+
+    BOOST_REQUIRE(lc3_seek(state, 1000));
+    BOOST_CHECK_EQUAL(state.executions, 1000U);
+    BOOST_CHECK_EQUAL(state.regs[0], 250);
+
+    // Without checkpoints seeking back falls back to the undo stack.
+    lc3_set_checkpoints(state, 0);
+    BOOST_REQUIRE(lc3_seek(state, 990));
+    BOOST_CHECK_EQUAL(state.executions, 990U);
+    BOOST_CHECK_EQUAL(state.regs[0], 248);
+    state.undo_stack.clear();
+    BOOST_CHECK(!lc3_seek(state, 0));
+    BOOST_CHECK_EQUAL(state.executions, 990U);
+
+    // Output replayed on the way back from a checkpoint goes nowhere, even through a custom writer.
+    // OUT
+    // BR #-2
+    unsigned int written = 0;
+    state.writer = [&written](lc3_state&, std::ostream&, int32_t) -> int32_t { written++; return 0; };
+    state.pc = 0x3000;
+    state.regs[0] = 'a';
+    state.mem[0x3000] = static_cast<int16_t>(0xF021);
+    state.mem[0x3001] = 0x0FFE;
+    lc3_set_checkpoints(state, 100, 0, 4);
+    lc3_run(state, 300);
+    const unsigned int outputs = written;
+    BOOST_REQUIRE(lc3_seek(state, state.executions - 51));
+    BOOST_CHECK_EQUAL(written, outputs);
+    lc3_run(state, 2);
+    BOOST_CHECK_EQUAL(written, outputs + 1);
+
+    // Output buffered before seeking back is flushed to the real stream first.
+    struct FlushCounter : std::stringbuf
+    {
+        int flushes = 0;
+        int sync() override
+        {
+            flushes++;
+            return std::stringbuf::sync();
+        }
+    };
+    FlushCounter counter;
+    std::ostream output(&counter);
+    state.writer = lc3_do_write_char;
+    state.output = &output;
+    lc3_set_output_flush(state, LC3_FLUSH_INPUT);
+    for (int i = 0; i < 4; i++)
+        lc3_step(state);
+    BOOST_CHECK_EQUAL(counter.str(), "aa");
+    BOOST_CHECK_EQUAL(counter.flushes, 0);
+    BOOST_REQUIRE(lc3_seek(state, state.executions - 51));
+    BOOST_CHECK_EQUAL(counter.flushes, 1);
+    BOOST_CHECK_EQUAL(counter.str(), "aa");
+    BOOST_CHECK_EQUAL(state.output, &output);
+    BOOST_CHECK_EQUAL(state.output_pending, 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestCheckpointDirtyPages, LC3BasicTest)
+{
+    // ADD R0, R0, #1
+    // STR R0, R1, #0
+    // ADD R1, R1, #1
+    // BR #-4
+    state.pc = 0x3000;
+    state.regs[0] = 0;
+    state.regs[1] = 0x4000;
+    state.mem[0x3000] = 0x1021;
+    state.mem[0x3001] = 0x7040;
+    state.mem[0x3002] = 0x1261;
+    state.mem[0x3003] = 0x0FFC;
+
+    // Pages written to aren't tracked if they can't trigger a checkpoint.
+    lc3_set_checkpoints(state, 100000, 0, 4);
+    lc3_run(state, 1100);
+    BOOST_CHECK_EQUAL(state.dirty_page_count, 0U);
+    BOOST_CHECK_EQUAL(state.checkpoints.size(), 1U);
+
+    // The 257th write is to a second page.
+    lc3_set_checkpoints(state, 100000, 2, 4);
+    lc3_run(state, 4 * 257);
+    BOOST_CHECK_EQUAL(state.checkpoints.size(), 2U);
+    BOOST_CHECK_LT(state.dirty_page_count, 2U);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestBinaryTrace, LC3BasicTest)
+{
+    // AND R1, R1, #0
+    // ADD R1, R1, #5
+    // ADD R0, R0, #1
+    // STR R0, R2, #0
+    // ADD R1, R1, #-1
+    // BRp #-4
+    // HALT
+    const int16_t program[] = {0x5260, 0x1265, 0x1021, 0x7080, 0x127F, 0x03FC, static_cast<int16_t>(0xF025)};
+    state.pc = 0x3000;
+    state.regs[2] = 0x4000;
+    std::copy(std::begin(program), std::end(program), &state.mem[0x3000]);
+
+    std::stringstream text;
+    std::stringstream binary;
+    lc3_trace_writer writer(binary);
+    state.trace = &text;
+    state.binary_trace = &writer;
+    lc3_run(state, 5);
+    // Changes made between instructions are also recorded.
+    state.regs[3] = 42;
+    lc3_run(state);
+    writer.flush();
+    BOOST_REQUIRE(state.halted);
+
+    // Decoding gives the same output as lc3_trace.
+    std::stringstream decoded;
+    std::stringstream csv;
+    lc3_trace_reader reader(binary);
+    BOOST_REQUIRE_EQUAL(reader.error(), "");
+    lc3_trace_step step;
+    std::vector<lc3_trace_step> steps;
+    while (reader.next(step))
+    {
+        lc3_write_trace_text(state, decoded, step.pc, step.instruction, step.regs.data(), step.n, step.z);
+        lc3_write_trace_csv(state, csv, step);
+        steps.push_back(step);
+    }
+    BOOST_CHECK_EQUAL(reader.error(), "");
+    BOOST_CHECK_EQUAL(decoded.str(), text.str());
+    BOOST_REQUIRE_EQUAL(steps.size(), state.executions);
+
+    BOOST_CHECK_EQUAL(steps[3].executions, 3U);
+    BOOST_CHECK_EQUAL(steps[3].pc, 0x3003);
+    BOOST_REQUIRE_EQUAL(steps[3].changes.size(), 1U);
+    BOOST_CHECK(!steps[3].changes[0].is_reg);
+    BOOST_CHECK_EQUAL(steps[3].changes[0].location, 0x4000);
+    BOOST_CHECK_EQUAL(steps[3].changes[0].value, 1);
+    BOOST_CHECK_EQUAL(steps[5].regs[3], 42);
+
+    std::string line;
+    std::getline(csv, line);
+    // R1 was already 0 so nothing changed.
+    BOOST_CHECK_EQUAL(line, "0,x3000,x5260,\"AND R1, R1, #0\",0,0,16384,0,0,0,0,0,Z,user,");
+    std::getline(csv, line);
+    BOOST_CHECK_EQUAL(line, "1,x3001,x1265,\"ADD R1, R1, #5\",0,0,16384,0,0,0,0,0,Z,user,R1=x0005");
+
+    // A loop writes nearly the same records each iteration so they compress well.
+    std::stringstream raw;
+    std::stringstream packed;
+    {
+        lc3_trace_writer raw_writer(raw, false);
+        lc3_trace_writer packed_writer(packed);
+        for (int i = 0; i < 2; i++)
+        {
+            // BR #-7 instead of HALT
+            lc3_init(state, false, false);
+            state.pc = 0x3000;
+            state.regs[2] = 0x4000;
+            std::copy(std::begin(program), std::end(program), &state.mem[0x3000]);
+            state.mem[0x3006] = 0x0FF9;
+            state.binary_trace = i == 0 ? &raw_writer : &packed_writer;
+            lc3_run(state, 10000);
+        }
+    }
+    BOOST_CHECK_LT(packed.str().size() * 3, raw.str().size());
+
+    lc3_trace_reader packed_reader(packed);
+    size_t count = 0;
+    while (packed_reader.next(step))
+        count++;
+    BOOST_CHECK_EQUAL(packed_reader.error(), "");
+    BOOST_CHECK_EQUAL(count, 10000U);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestOutputFlush, LC3BasicTest)
+{
+    struct FlushCounter : std::stringbuf
+    {
+        int flushes = 0;
+        int sync() override
+        {
+            flushes++;
+            return std::stringbuf::sync();
+        }
+    };
+
+    // LEA R0, #3
+    // PUTS
+    // PUTS
+    // HALT
+    // .stringz "ab\ncd"
+    const int16_t program[] = {static_cast<int16_t>(0xE003), static_cast<int16_t>(0xF022), static_cast<int16_t>(0xF022), static_cast<int16_t>(0xF025), 'a', 'b', '\n', 'c', 'd', 0};
+    const std::pair<lc3_flush_policy, int> policies[] = {
+        {LC3_FLUSH_ALWAYS, 2},
+        {LC3_FLUSH_NEWLINE, 2},
+        {LC3_FLUSH_SIZE, 1},
+        {LC3_FLUSH_INPUT, 1},
+    };
+
+    for (const auto& policy : policies)
+    {
+        FlushCounter counter;
+        std::ostream output(&counter);
+        lc3_init(state, false, false);
+        std::copy(std::begin(program), std::end(program), &state.mem[0x3000]);
+        state.pc = 0x3000;
+        state.output = &output;
+        lc3_set_output_flush(state, policy.first, 8);
+        lc3_run(state);
+
+        BOOST_CHECK(state.halted);
+        BOOST_CHECK_EQUAL(counter.str(), "ab\ncdab\ncd");
+        BOOST_CHECK_EQUAL(counter.flushes, policy.second);
+        BOOST_CHECK_EQUAL(state.output_pending, 0U);
+    }
+
+    // Custom writers still see every character.
+    std::stringstream output;
+    std::string seen;
+    lc3_init(state, false, false);
+    std::copy(std::begin(program), std::end(program), &state.mem[0x3000]);
+    state.pc = 0x3000;
+    state.output = &output;
+    state.writer = [&seen](lc3_state&, std::ostream&, int32_t chr) { seen += static_cast<char>(chr); return 0; };
+    lc3_run(state);
+    BOOST_CHECK_EQUAL(seen, "ab\ncdab\ncd");
+    BOOST_CHECK_EQUAL(output.str(), "");
+
+    // Warnings come out where the bad character is.
+    // LEA R0, #4
+    // PUTS
+    // LEA R0, #8
+    // PUTSP
+    // HALT
+    // .stringz "ab\x01cd"
+    // .fill x6665 .fill x6700 .fill x0068 .fill 0 ("ef", a NUL, then "gh")
+    const int16_t bad_program[] = {static_cast<int16_t>(0xE004), static_cast<int16_t>(0xF022), static_cast<int16_t>(0xE008), static_cast<int16_t>(0xF024),
+                                   static_cast<int16_t>(0xF025), 'a', 'b', 1, 'c', 'd', 0, 0x6665, 0x6700, 0x0068, 0};
+    std::stringstream console;
+    lc3_init(state, false, false);
+    std::copy(std::begin(bad_program), std::end(bad_program), &state.mem[0x3000]);
+    state.pc = 0x3000;
+    state.output = &console;
+    state.warning = &console;
+    lc3_run(state);
+    const std::string text = console.str();
+    const size_t invalid = text.find("W007");
+    const size_t nul = text.find("W013");
+    BOOST_REQUIRE(invalid != std::string::npos);
+    BOOST_REQUIRE(nul != std::string::npos);
+    BOOST_CHECK_EQUAL(text.find("ab"), 0);
+    BOOST_CHECK_GT(text.find("\x01" "cdef"), invalid);
+    BOOST_CHECK_LT(text.find("\x01" "cdef"), nul);
+    BOOST_CHECK_GT(text.find("gh"), nul);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestEvents, LC3BasicTest)
+{
+    // JSR #2
+    // HALT
+    // .fill 0
+    // ST R7, #2
+    // RET
+    const int16_t program[] = {0x4802, static_cast<int16_t>(0xF025), 0, 0x3E02, static_cast<int16_t>(0xC1C0), 0, 0};
+    std::copy(std::begin(program), std::end(program), &state.mem[0x3000]);
+    state.pc = 0x3000;
+
+    std::vector<std::string> events;
+    char buffer[32];
+    lc3_subscribe<lc3_event_id::SUBROUTINE>(state, [&](lc3_state&, uint16_t address) {
+        snprintf(buffer, sizeof(buffer), "call x%04x", address);
+        events.emplace_back(buffer);
+    });
+    lc3_subscribe<lc3_event_id::EXIT_SUBROUTINE>(state, [&](lc3_state&, uint16_t address) {
+        snprintf(buffer, sizeof(buffer), "ret x%04x", address);
+        events.emplace_back(buffer);
+    });
+    lc3_subscribe<lc3_event_id::MEMORY_WRITE>(state, [&](lc3_state&, uint16_t address, int16_t value) {
+        snprintf(buffer, sizeof(buffer), "x%04x=x%04x", address, static_cast<uint16_t>(value));
+        events.emplace_back(buffer);
+    });
+    lc3_subscribe<lc3_event_id::TRAP>(state, [&](lc3_state&, uint8_t vector) {
+        snprintf(buffer, sizeof(buffer), "trap x%02x", vector);
+        events.emplace_back(buffer);
+    });
+    // Removed by its handle without touching the other TRAP function.
+    auto extra = lc3_subscribe<lc3_event_id::TRAP>(state, [&](lc3_state&, uint8_t) { events.emplace_back("extra"); });
+    lc3_unsubscribe(state, extra);
+    lc3_unsubscribe(state, extra);
+
+    BOOST_CHECK(lc3_is_subscribed(state, lc3_event_id::SUBROUTINE));
+    BOOST_CHECK(!lc3_is_subscribed(state, lc3_event_id::MEMORY_READ));
+
+    lc3_run(state);
+    BOOST_CHECK(state.halted);
+    const std::vector<std::string> expected = {"call x3003", "x3006=x3001", "ret x3001", "trap x25"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(events.begin(), events.end(), expected.begin(), expected.end());
+
+    // Nothing fires once unsubscribed.
+    for (auto id : {lc3_event_id::SUBROUTINE, lc3_event_id::EXIT_SUBROUTINE, lc3_event_id::MEMORY_WRITE, lc3_event_id::TRAP})
+        lc3_unsubscribe(state, id);
+    BOOST_CHECK_EQUAL(state.event_subscriptions, 0U);
+
+    events.clear();
+    state.halted = 0;
+    state.pc = 0x3000;
+    lc3_run(state);
+    BOOST_CHECK(events.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(TestPluginSchedule, LC3BasicTest)
+{
+    class SchedulePlugin : public Plugin
+    {
+    public:
+        SchedulePlugin() : Plugin(LC3_MAJOR_VERSION, LC3_MINOR_VERSION, LC3_OTHER, "Schedule test") {ScheduleEvery(3, PLUGIN_HOOK_TICK);}
+        void OnTick(lc3_state& state) override {ticks.push_back(state.executions);}
+        void OnTock(lc3_state& state) override {tocks.push_back(state.executions);}
+        using Plugin::ScheduleAt;
+        using Plugin::ScheduleNever;
+        std::vector<uint32_t> ticks;
+        std::vector<uint32_t> tocks;
+    };
+
+    // AND R0, R0, #0
+    std::fill(&state.mem[0x3000], &state.mem[0x3020], 0x5020);
+    state.pc = 0x3000;
+    SchedulePlugin plugin;
+    state.plugins.push_back(&plugin);
+    lc3_schedule_plugins(state);
+
+    lc3_run(state, 10);
+    BOOST_CHECK_EQUAL(state.executions, 10U);
+    const std::vector<uint32_t> every = {2, 5, 8};
+    BOOST_CHECK_EQUAL_COLLECTIONS(plugin.ticks.begin(), plugin.ticks.end(), every.begin(), every.end());
+    BOOST_CHECK(plugin.tocks.empty());
+
+    // Once, with OnTock seeing the execution count after the instruction.
+    plugin.ticks.clear();
+    plugin.ScheduleAt(12);
+    lc3_schedule_plugin(state, &plugin);
+    lc3_run(state, 10);
+    const std::vector<uint32_t> once = {12};
+    BOOST_CHECK_EQUAL_COLLECTIONS(plugin.ticks.begin(), plugin.ticks.end(), once.begin(), once.end());
+    const std::vector<uint32_t> once_tock = {13};
+    BOOST_CHECK_EQUAL_COLLECTIONS(plugin.tocks.begin(), plugin.tocks.end(), once_tock.begin(), once_tock.end());
+    BOOST_CHECK(state.plugin_schedule.empty());
+
+    plugin.ticks.clear();
+    plugin.tocks.clear();
+    plugin.ScheduleNever();
+    lc3_schedule_plugin(state, &plugin);
+    lc3_run(state, 10);
+    BOOST_CHECK(plugin.ticks.empty());
+    BOOST_CHECK(plugin.tocks.empty());
+
+    state.plugins.clear();
+    lc3_schedule_plugins(state);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestInterruptPriority, LC3BasicTest)
+{
+    state.mem[0x0102] = 0x2000;
+    state.mem[0x0180] = 0x4000;
+    state.mem[0x0181] = 0x5000;
+    state.pc = 0x3000;
+    state.regs[6] = static_cast<int16_t>(0xF000);
+
+    BOOST_CHECK(!lc3_interrupt(state));
+    BOOST_CHECK(lc3_signal_interrupt_once(state, 4, 0x80));
+    BOOST_CHECK(!lc3_signal_interrupt_once(state, 4, 0x80));
+    lc3_signal_interrupt(state, 6, 0x81);
+    BOOST_CHECK(state.interrupts.test(4, 0x80));
+    BOOST_CHECK(state.interrupts.test(6, 0x81));
+    // Not stored with the priority and vector swapped.
+    BOOST_CHECK(!state.interrupts.test(0x80 & 7, 4));
+
+    // Highest priority first.
+    BOOST_REQUIRE(lc3_interrupt(state));
+    BOOST_CHECK_EQUAL(state.pc, 0x5000);
+    BOOST_CHECK_EQUAL(state.priority, 6);
+    BOOST_CHECK_EQUAL(state.interrupt_vector, 0x81);
+
+    // Priority 4 can't interrupt a priority 6 handler, an exception at the same priority can.
+    BOOST_CHECK(!lc3_interrupt(state));
+    lc3_signal_interrupt(state, 6, 0x02);
+    BOOST_REQUIRE(lc3_interrupt(state));
+    BOOST_CHECK_EQUAL(state.pc, 0x2000);
+    BOOST_CHECK_EQUAL(state.interrupt_vector, 0x02);
+
+    state.priority = 0;
+    BOOST_REQUIRE(lc3_interrupt(state));
+    BOOST_CHECK_EQUAL(state.pc, 0x4000);
+    BOOST_CHECK_EQUAL(state.priority, 4);
+    BOOST_CHECK(state.interrupts.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(TestClone, LC3BasicTest)
+{
+    // ADD R0, R0, #1
+    // ST R0, #1
+    // HALT
+    // .fill 0
+    const int16_t program[] = {0x1021, 0x3001, static_cast<int16_t>(0xF025), 0};
+    std::copy(std::begin(program), std::end(program), &state.mem[0x3000]);
+    state.pc = 0x3000;
+    state.symbols["RESULT"] = 0x3003;
+    state.rev_symbols[0x3003] = "RESULT";
+    lc3_add_breakpoint(state, 0x3002);
+
+    lc3_state clone;
+    for (int16_t i = 0; i < 3; i++)
+    {
+        state.regs[0] = i;
+        lc3_clone(clone, state);
+        std::stringstream output;
+        clone.output = &output;
+        lc3_run(clone);
+        BOOST_CHECK_EQUAL(clone.mem[0x3003], i + 1);
+        BOOST_CHECK_EQUAL(clone.executions, 2U);
+        BOOST_CHECK_EQUAL(lc3_sym_lookup(clone, "RESULT"), 0x3003);
+        BOOST_CHECK(lc3_has_breakpoint(clone, 0x3002));
+    }
+
+    // The original is untouched.
+    BOOST_CHECK_EQUAL(state.pc, 0x3000);
+    BOOST_CHECK_EQUAL(state.mem[0x3003], 0);
+    BOOST_CHECK_EQUAL(state.executions, 0U);
+}
+
 BOOST_FIXTURE_TEST_CASE(TestTrapInstructions, LC3BasicTest)
 {
     const unsigned char traps[] = {
@@ -1319,6 +2129,23 @@ BOOST_FIXTURE_TEST_CASE(TestSymbolTable, LC3BasicTest)
     BOOST_CHECK_EQUAL(lc3_sym_rev_lookup(state, 0x3000), "");
 }
 
+BOOST_FIXTURE_TEST_CASE(TestCalculateOperators, LC3BasicTest)
+{
+    const std::vector<std::pair<std::string, int>> expressions = {
+        {"6 * 7", 42}, {"43 / 5", 8}, {"43 % 5", 3}, {"3 << 2", 12}, {"-16 >> 2", -4}, {"5 - 7", -2}, {"5 + 7", 12},
+        {"6 ^ 3", 5}, {"6 & 3", 2}, {"6 | 3", 7}, {"2 && 0", 0}, {"2 || 0", 1},
+        {"3 == 3", 1}, {"2 < 3", 1}, {"2 > 3", 0}, {"3 >= 3", 1}, {"4 <= 3", 0},
+        {"2147483647 + 1", INT_MIN}, {"-1 << 31", INT_MIN},
+    };
+    for (const auto& expr : expressions)
+        BOOST_CHECK_MESSAGE(lc3_calculate(state, expr.first) == expr.second, expr.first);
+
+    // Results that don't fit in an int and shifts past its width are errors.
+    auto evaluation_error = [](const LC3CalculateException& e) {return e.get_id() == ExpressionEvaluator::eval_evalerr;};
+    for (const auto& expr : {"1 / 0", "1 % 0", "(0 - 2147483647 - 1) / -1", "(0 - 2147483647 - 1) % -1", "1 << 32", "1 >> (0 - 1)", "1 << (0 - 1)"})
+        BOOST_CHECK_EXCEPTION(lc3_calculate(state, expr), LC3CalculateException, evaluation_error);
+}
+
 BOOST_FIXTURE_TEST_CASE(TestBreakpoints, LC3BasicTest)
 {
     state.strict_execution = 0;
@@ -1365,8 +2192,126 @@ BOOST_FIXTURE_TEST_CASE(TestBreakpointMessages, LC3BasicTest)
     auto& breakpoint = state.breakpoints[0x3001];
     BOOST_REQUIRE_EQUAL(breakpoint.hit_count, 1);
     BOOST_CHECK_EQUAL(out.str(), "12289 R0 is 3 ok 0\n");
+
+    // Symbols changed after the breakpoint was added are seen by its condition and message.
+    lc3_sym_add(state, "LIMIT", 7);
+    lc3_add_breakpoint(state, 0x3002, "", "limit {{LIMIT}}", "R0 == LIMIT");
+    lc3_sym_delete(state, "LIMIT");
+    lc3_sym_add(state, "LIMIT", 3);
+    out.str("");
+    state.halted = 0;
+    lc3_run(state, 10);
+
+    BOOST_CHECK_EQUAL(state.pc, 0x3002);
+    BOOST_CHECK_EQUAL(out.str(), "limit 3\n");
 }
 
+BOOST_FIXTURE_TEST_CASE(TestCompiledExpressions, LC3BasicTest)
+{
+    lc3_sym_add(state, "DATA", 0x4000);
+    state.regs[0] = 5;
+    state.regs[1] = -2;
+    state.pc = 0x3000;
+    state.mem[0x3000] = 7;
+    state.mem[0x4001] = 11;
+
+    const std::vector<std::string> expressions = {
+        "R0 == 5", "r1 * (R0 + 3)", "-R1", "MEM[x3000] + PC", "PC[0]", "DATA[R0 - 4] << 1", "DATA", "0x10 | 010", "R0 > 3 && R1 < 0", "4 - -2"
+    };
+    for (const auto& expr : expressions)
+    {
+        lc3_expression program;
+        BOOST_REQUIRE_EQUAL(lc3_compile_expression(state, expr, program), 0);
+        BOOST_CHECK_EQUAL(lc3_evaluate(state, program), lc3_calculate(state, expr));
+    }
+
+    // Registers are read when evaluated, symbols when compiled.
+    lc3_expression program;
+    lc3_compile_expression(state, "R0 * 2", program);
+    state.regs[0] = 21;
+    BOOST_CHECK_EQUAL(lc3_evaluate(state, program), 42);
+
+    BOOST_CHECK_EQUAL(lc3_compile_expression(state, "NOTHERE + 1", program), ExpressionEvaluator::eval_undefinedsymbol);
+    BOOST_CHECK_THROW(lc3_evaluate(state, program), LC3CalculateException);
+    BOOST_CHECK_EQUAL(lc3_compile_expression(state, "(R0 + 1", program), ExpressionEvaluator::eval_unbalanced);
+
+    BOOST_REQUIRE_EQUAL(lc3_compile_expression(state, "R0 / (R1 + 2)", program), 0);
+    BOOST_CHECK_THROW(lc3_evaluate(state, program), LC3CalculateException);
+}
+
+BOOST_AUTO_TEST_CASE(TestCalculateThreads)
+{
+    const int num_states = 4;
+    std::vector<std::unique_ptr<lc3_state>> states;
+    for (int i = 0; i < num_states; i++)
+    {
+        states.emplace_back(new lc3_state());
+        lc3_init(*states.back(), false, false);
+        states.back()->regs[0] = i;
+        states.back()->mem[0x3000 + i] = 100 * i;
+        lc3_sym_add(*states.back(), "VALUE", 0x3000 + i);
+    }
+
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_states; i++)
+    {
+        threads.emplace_back([&, i]()
+        {
+            for (int j = 0; j < 2000; j++)
+            {
+                if (lc3_calculate(*states[i], "R0 * 10 + VALUE[0] + MEM[VALUE]") != i * 10 + 200 * i)
+                    mismatches++;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    BOOST_CHECK_EQUAL(mismatches.load(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(TestWatchpoints, LC3BasicTest)
+{
+    state.strict_execution = 0;
+    // ADD R1, R1, #1
+    // ST R1, #4
+    // ADD R2, R2, #1
+    state.mem[0x3000] = 0x1261;
+    state.mem[0x3001] = 0x3204;
+    state.mem[0x3002] = 0x14A1;
+    state.mem[0x3010] = (short)0xF025;
+
+    BOOST_CHECK(!lc3_add_watchpoint(state, false, 0x3006, "1"));
+    BOOST_CHECK(!lc3_add_watchpoint(state, true, 2, "1"));
+    BOOST_CHECK(!lc3_add_watchpoint(state, true, 3, "1"));
+    BOOST_CHECK(lc3_add_watchpoint(state, true, 3, "1"));
+    BOOST_CHECK(lc3_has_watchpoint(state, false, 0x3006));
+    BOOST_CHECK(!lc3_has_watchpoint(state, false, 0x3007));
+    BOOST_CHECK(lc3_has_watchpoint(state, true, 3));
+    BOOST_CHECK(!lc3_remove_watchpoint(state, true, 3));
+    BOOST_CHECK(!lc3_has_watchpoint(state, true, 3));
+    BOOST_CHECK(lc3_remove_watchpoint(state, true, 3));
+
+    lc3_run(state);
+    BOOST_CHECK_EQUAL(state.pc, 0x3002);
+    BOOST_CHECK_EQUAL(state.mem[0x3006], 1);
+
+    state.halted = 0;
+    lc3_run(state);
+    BOOST_CHECK_EQUAL(state.pc, 0x3003);
+    BOOST_CHECK_EQUAL(state.regs[2], 1);
+
+    // Removed breakpoints no longer trigger.
+    lc3_add_breakpoint(state, 0x3008);
+    BOOST_CHECK(lc3_has_breakpoint(state, 0x3008));
+    BOOST_CHECK(!lc3_remove_breakpoint(state, 0x3008));
+    BOOST_CHECK(!lc3_has_breakpoint(state, 0x3008));
+    state.halted = 0;
+    lc3_run(state);
+    BOOST_CHECK_EQUAL(state.pc, 0x3010);
+}
+
 BOOST_FIXTURE_TEST_CASE(InstructionBasicAssembleTest, LC3BasicTest)
 {
     const std::vector<std::string> instruct = {
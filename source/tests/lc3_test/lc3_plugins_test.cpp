@@ -3,6 +3,7 @@
 #include <iostream>
 #include <istream>
 #include <fstream>
+#include <memory>
 #include <vector>
 
 struct LC3PluginTest
@@ -62,6 +63,43 @@ BOOST_FIXTURE_TEST_CASE(TestInstructionPlugin, LC3PluginTest)
     BOOST_CHECK_EQUAL(state.regs[3], 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(TestCloneKeepPlugins, LC3PluginTest)
+{
+    const std::string asm_file =
+    ";@plugin filename=lc3_multiply\n"
+    ".orig x3000\n"
+    "    LD R0, OTF\n"
+    "    MUL R2, R0, 8\n"
+    "    HALT\n"
+    "OTF .fill 125\n"
+    ".end";
+
+    auto base = std::make_unique<lc3_state>();
+    lc3_init(*base, false, false);
+
+    std::stringstream file(asm_file);
+    BOOST_REQUIRE_NO_THROW(lc3_assemble(state, file, options));
+    BOOST_REQUIRE(state.instructionPlugin != nullptr);
+    const std::vector<int16_t> assembled(state.mem + 0x3000, state.mem + 0x3004);
+
+    // The next program that loads the same plugins can reuse them, as lc3as -batch does.
+    lc3_clone(state, *base, true);
+    BOOST_REQUIRE(state.instructionPlugin != nullptr);
+    BOOST_CHECK_EQUAL(state.mem[0x3001], 0);
+    LC3AssembleOptions cached = options;
+    cached.disable_plugins = true;
+    std::stringstream again(asm_file);
+    BOOST_REQUIRE_NO_THROW(lc3_assemble(state, again, cached));
+    BOOST_CHECK(std::equal(assembled.begin(), assembled.end(), state.mem + 0x3000));
+    lc3_run(state, 3);
+    BOOST_CHECK_EQUAL(state.regs[2], 1000);
+
+    lc3_clone(state, *base);
+    BOOST_CHECK(state.instructionPlugin == nullptr);
+    std::stringstream without(asm_file);
+    BOOST_CHECK_THROW(lc3_assemble(state, without, cached), LC3AssembleException);
+}
+
 BOOST_FIXTURE_TEST_CASE(TestInstructionPluginDisassemble, LC3PluginTest)
 {
     const std::string asm_file =
@@ -301,3 +339,39 @@ BOOST_FIXTURE_TEST_CASE(TestTrapPluginAssembleFailure2, LC3PluginTest)
     std::stringstream file(asm_file);
     BOOST_CHECK_EXCEPTION(lc3_assemble(state, file, options), LC3AssembleException, is_plugin_fail);
 }
+
+class CounterPlugin : public Plugin
+{
+public:
+    CounterPlugin() : Plugin(LC3_MAJOR_VERSION, LC3_MINOR_VERSION, LC3_OTHER) {}
+    int16_t OnRead(lc3_state&, uint16_t) override { return ++reads; }
+    void OnWrite(lc3_state&, uint16_t, int16_t value) override { last_write = value; }
+    int16_t reads = 0;
+    int16_t last_write = 0;
+};
+
+BOOST_FIXTURE_TEST_CASE(TestAddressPluginTable, LC3PluginTest)
+{
+    CounterPlugin device;
+    CounterPlugin screen;
+    state.address_plugins[0xFE10] = &device;
+    state.address_plugins[0xC000] = &screen;
+    lc3_index_address_plugins(state);
+
+    BOOST_CHECK_EQUAL(lc3_address_plugin(state, 0xFE10), &device);
+    BOOST_CHECK_EQUAL(lc3_address_plugin(state, 0xC000), &screen);
+    BOOST_CHECK(lc3_address_plugin(state, 0xC001) == nullptr);
+    BOOST_CHECK(lc3_address_plugin(state, 0xFE00) == nullptr);
+    BOOST_CHECK(!lc3_can_run_fast(state));
+
+    BOOST_CHECK_EQUAL(lc3_mem_read(state, 0xFE10), 1);
+    BOOST_CHECK_EQUAL(lc3_mem_read(state, 0xC000), 1);
+    lc3_mem_write(state, 0xC000, 1234);
+    BOOST_CHECK_EQUAL(screen.last_write, 1234);
+
+    state.address_plugins.erase(0xFE10);
+    state.address_plugins.erase(0xC000);
+    lc3_index_address_plugins(state);
+    BOOST_CHECK(lc3_address_plugin(state, 0xFE10) == nullptr);
+    BOOST_CHECK(lc3_address_plugin(state, 0xC000) == nullptr);
+}
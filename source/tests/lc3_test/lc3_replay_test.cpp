@@ -1,15 +1,23 @@
 #include <lc3.hpp>
+#include <lc3_replay/BinarySpanReader.hpp>
+#include <lc3_replay/lc3_batch.hpp>
 #include <lc3_replay/lc3_replay.hpp>
 
 #include <boost/archive/iterators/base64_from_binary.hpp>
 #include <boost/archive/iterators/binary_from_base64.hpp>
 #include <boost/archive/iterators/transform_width.hpp>
+#include <boost/crc.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <istream>
 #include <iterator>
+#include <memory>
+#include <tuple>
 #include <vector>
 
 void split(const std::string& s, char delimiter, std::vector<std::string>& tokens)
@@ -77,6 +85,36 @@ std::string base64_encode(const std::string& text)
     return ss.str();
 }
 
+/** Builds an uncompressed verification string, each record is (id, label, params). */
+std::string build_verification(const std::string& filename, const std::vector<std::tuple<unsigned char, std::string, std::vector<int16_t>>>& records)
+{
+    auto put_int = [](std::string& out, uint32_t value) { out.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+    std::string payload;
+    for (const auto& record : records)
+    {
+        payload.push_back(static_cast<char>(std::get<0>(record)));
+        put_int(payload, std::get<1>(record).size());
+        payload += std::get<1>(record);
+        put_int(payload, std::get<2>(record).size());
+        payload.append(reinterpret_cast<const char*>(std::get<2>(record).data()), std::get<2>(record).size() * sizeof(int16_t));
+    }
+    payload.push_back(static_cast<char>(0xFF));
+
+    boost::crc_32_type crc;
+    crc.process_bytes(payload.data(), payload.size());
+
+    std::string data = "lc-3";
+    put_int(data, 1);
+    put_int(data, 0);
+    put_int(data, payload.size());
+    put_int(data, crc.checksum());
+    data.push_back(0);
+    put_int(data, filename.size());
+    data += filename;
+    return base64_encode(data + payload);
+}
+
 struct LC3ReplayTest
 {
     LC3ReplayTest()
@@ -308,6 +346,262 @@ BOOST_FIXTURE_TEST_CASE(ReplayTestPBRCompressed, LC3ReplayTest)
     BOOST_CHECK(state.breakpoints.find(0x8000) != state.breakpoints.end());
 }
 
+BOOST_FIXTURE_TEST_CASE(ReplayPlanTest, LC3ReplayTest)
+{
+    const std::string asm_file =
+    ".orig x3000\n"
+    "   TATA RET\n"
+    ".end\n";
+
+    auto plan = lc3_parse_replay(REPLAY_STRING_PBR_COMPRESSED);
+    BOOST_REQUIRE(plan);
+    BOOST_CHECK_EQUAL(plan.get(), lc3_parse_replay(REPLAY_STRING_PBR_COMPRESSED).get());
+    BOOST_CHECK_EQUAL(plan->filename, "this_is_a_test.asm");
+    BOOST_CHECK_EQUAL(plan->environment.break_address, 0x8000);
+    BOOST_CHECK_EQUAL(plan->preconditions.size(), 1);
+
+    // Applying the same plan to different machines sets them up the same.
+    for (int i = 0; i < 2; i++)
+    {
+        lc3_state other;
+        std::stringstream file(asm_file);
+        std::stringstream input;
+        lc3_apply_replay(other, *plan, "this_is_a_test.asm", file, input);
+        BOOST_CHECK_EQUAL(other.regs[0], 3);
+        BOOST_CHECK_EQUAL(other.regs[4], 5);
+        BOOST_CHECK_EQUAL(static_cast<unsigned short>(other.regs[5]), 0xCAFE);
+        BOOST_CHECK_EQUAL(static_cast<unsigned short>(other.pc), lc3_sym_lookup(other, "TATA"));
+        BOOST_CHECK(other.breakpoints.find(0x8000) != other.breakpoints.end());
+    }
+
+    // Machines start over from the assembled file no matter what ran on them before.
+    {
+        std::stringstream file(asm_file);
+        std::stringstream input;
+        lc3_apply_replay(state, *plan, "this_is_a_test.asm", file, input);
+        state.mem[0x3000] = 0x1234;
+        lc3_add_breakpoint(state, 0x4000);
+        std::stringstream again(asm_file);
+        lc3_apply_replay(state, *plan, "this_is_a_test.asm", again, input);
+        BOOST_CHECK_EQUAL(static_cast<unsigned short>(state.mem[0x3000]), 0xC1C0);
+        BOOST_CHECK(state.breakpoints.find(0x4000) == state.breakpoints.end());
+        BOOST_CHECK_EQUAL(state.breakpoints.size(), 1);
+    }
+
+    // A different file is assembled again.
+    {
+        std::stringstream file(".orig x4000\n   TATA RET\n.end\n");
+        std::stringstream input;
+        lc3_apply_replay(state, *plan, "this_is_a_test.asm", file, input);
+        BOOST_CHECK_EQUAL(lc3_sym_lookup(state, "TATA"), 0x4000);
+        BOOST_CHECK_EQUAL(state.pc, 0x4000);
+    }
+
+    std::stringstream file(asm_file);
+    std::stringstream input;
+    BOOST_CHECK_THROW(lc3_apply_replay(state, *plan, "other.asm", file, input), LC3ReplayStringException);
+    BOOST_CHECK_THROW(lc3_parse_replay("!!!!"), LC3ReplayStringException);
+}
+
+BOOST_AUTO_TEST_CASE(BinarySpanReaderTest)
+{
+    const char data[] = "\x02\x00\x00\x00" "hi" "\x03\x00\x00\x00" "\x01\x00\x02\x00\xff\xff" "abc" "\x05\x00\x00\x00" "xy";
+    const std::string buffer(data, sizeof(data) - 1);
+
+    BinarySpanReader reader(buffer);
+    std::string_view str;
+    int16_view values;
+    reader >> str >> values;
+    BOOST_REQUIRE(reader.Ok());
+    BOOST_CHECK_EQUAL(str, "hi");
+    BOOST_CHECK_EQUAL(str.data(), buffer.data() + 4);
+    BOOST_REQUIRE_EQUAL(values.size(), 3);
+    BOOST_CHECK_EQUAL(values[0], 1);
+    BOOST_CHECK_EQUAL(values[1], 2);
+    BOOST_CHECK_EQUAL(values[2], -1);
+
+    // Fixed width strings don't have a size.
+    std::string fixed;
+    reader >> set_width(3) >> fixed;
+    BOOST_REQUIRE(reader.Ok());
+    BOOST_CHECK_EQUAL(fixed, "abc");
+
+    // Claims 5 bytes with only 2 left.
+    reader >> str;
+    BOOST_CHECK(!reader.Ok());
+
+    BinarySpanReader limited(buffer);
+    limited.SetMaxStringSize(1);
+    limited >> str;
+    BOOST_CHECK(!limited.Ok());
+
+    BinarySpanReader array(buffer.data() + 6, 10);
+    std::vector<int16_t> vec;
+    array >> vec;
+    BOOST_REQUIRE(array.Ok());
+    BOOST_CHECK_EQUAL(vec.size(), 3);
+    BOOST_CHECK_EQUAL(vec[2], -1);
+    BOOST_CHECK_EQUAL(array.Remaining(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(VerificationTest, LC3ReplayTest)
+{
+    const std::string asm_file =
+    ".orig x3000\n"
+    "   LD R0, A\n"
+    "   ADD R1, R0, R0\n"
+    "   ST R1, B\n"
+    "   LEA R0, MSG\n"
+    "   PUTS\n"
+    "   HALT\n"
+    "   A .fill 5\n"
+    "   B .blkw 1\n"
+    "   MSG .stringz \"hi\"\n"
+    ".end\n";
+
+    const std::string verification = build_verification("test.asm", {
+        {1, "", {0}},                   // END_STATE halted
+        {2, "1", {10}},                 // REGISTER
+        {4, "B", {10}},                 // VALUE
+        {8, "", {'h', 'i'}},            // OUTPUT
+        {9, "3000", {0}},               // DIRECT_VALUE
+        {10, "3008", {'h', 'i'}},       // DIRECT_STRING
+        {11, "3006", {5, 10}},          // DIRECT_ARRAY
+        {15, "", {2, 3}},               // REGISTERS_UNCHANGED
+        {18, "x22", {0, 0x3008}},       // PASS_BY_REGS
+        {4, "NOPE", {1}},               // VALUE
+    });
+
+    std::stringstream file(asm_file);
+    lc3_assemble(state, file, options);
+    std::stringstream output;
+    state.output = &output;
+
+    lc3_verification_context context;
+    lc3_begin_verification(state, context);
+    lc3_run(state, 1000);
+
+    auto result = lc3_run_verification(state, verification, context);
+    BOOST_CHECK(!result.passed);
+    BOOST_REQUIRE_EQUAL(result.checks.size(), 10);
+    for (unsigned int i = 0; i < result.checks.size(); i++)
+    {
+        const bool should_pass = i != 4 && i != 9;
+        BOOST_CHECK_MESSAGE(result.checks[i].passed == should_pass, "check " << i << " expected " << result.checks[i].expected << " actual " << result.checks[i].actual);
+    }
+    BOOST_CHECK_EQUAL(context.output, "hi");
+    BOOST_CHECK_EQUAL(lc3_parse_verification(verification).get(), lc3_parse_verification(verification).get());
+
+    lc3_end_verification(state, context);
+
+    // Ending a verification only removes its own listeners.
+    std::string seen;
+    lc3_subscribe<lc3_event_id::OUTPUT_STRING>(state, [&seen](lc3_state&, const std::string& str) { seen.append(str); });
+    {
+        auto first = std::make_unique<lc3_verification_context>();
+        state.pc = 0x3000;
+        state.halted = false;
+        lc3_begin_verification(state, *first);
+        lc3_run(state, 1000);
+        BOOST_CHECK_EQUAL(first->output, "hi");
+        lc3_end_verification(state, *first);
+        state.pc = 0x3000;
+        state.halted = false;
+        lc3_run(state, 1000);
+        BOOST_CHECK_EQUAL(first->output, "hi");
+        BOOST_CHECK_EQUAL(first->calls.size(), 2);
+        BOOST_CHECK_EQUAL(seen, "hihi");
+    }
+    lc3_verification_context again;
+    lc3_begin_verification(state, again);
+    state.pc = 0x3000;
+    state.halted = false;
+    lc3_run(state, 1000);
+    BOOST_CHECK_EQUAL(again.output, "hi");
+    BOOST_CHECK_EQUAL(again.calls.size(), 2);
+    BOOST_CHECK(lc3_run_verification(state, verification, again).checks[0].passed);
+    lc3_end_verification(state, again);
+    BOOST_CHECK_EQUAL(seen, "hihihi");
+
+    const std::string description = lc3_describe_verification(verification);
+    BOOST_CHECK(description.find("filename: test.asm") != std::string::npos);
+    BOOST_CHECK(description.find("Console Output \"hi\"") != std::string::npos);
+}
+
+BOOST_FIXTURE_TEST_CASE(VerificationTestData, LC3ReplayTest)
+{
+    state.mem[0x3000] = 0x3004;
+    state.mem[0x3001] = 5;
+    state.mem[0x3002] = 'h';
+    state.mem[0x3003] = 0;
+
+    // Node with next pointer x3004 holding (5, "h").
+    const std::string verification = build_verification("test.asm", {
+        {12, "3000", {3, 1, 0x3004, 0xFF, 1, 5, 2, 1, 'h', 0}},     // NODE
+        {13, "3001", {1, 5, 0xFF, 2, 1, 'h', 0}},                   // DATA
+    });
+
+    lc3_verification_context context;
+    lc3_begin_verification(state, context);
+    auto result = lc3_run_verification(state, verification, context);
+    BOOST_CHECK(result.passed);
+    lc3_end_verification(state, context);
+
+    // Lengths running past the end, negative lengths, unknown items and unterminated Data are rejected before running.
+    const std::vector<std::vector<int16_t>> malformed = {
+        {1},
+        {2, 100, 'h'},
+        {3, -5, 1, 2},
+        {7, 1},
+        {0xFF, 1, 5},
+    };
+    for (const auto& params : malformed)
+    {
+        BOOST_CHECK_THROW(lc3_parse_verification(build_verification("test.asm", {{13, "3000", params}})), LC3ReplayStringException);
+        BOOST_CHECK_THROW(lc3_parse_verification(build_verification("test.asm", {{12, "3000", params}})), LC3ReplayStringException);
+    }
+    // Nodes must start with the next pointers.
+    BOOST_CHECK_THROW(lc3_parse_verification(build_verification("test.asm", {{12, "3000", {1, 5}}})), LC3ReplayStringException);
+    BOOST_CHECK_THROW(lc3_parse_verification(build_verification("test.asm", {{12, "3000", {3, 1, 0x3004}}})), LC3ReplayStringException);
+}
+
+BOOST_FIXTURE_TEST_CASE(VerificationTestStackWords, LC3ReplayTest)
+{
+    const std::string asm_file =
+    ".orig x3000\n"
+    "   LEA R6, STACK\n"
+    "   JSR SUB\n"
+    "   HALT\n"
+    "   SUB RET\n"
+    "   STACK .fill 1\n"
+    "   .fill 2\n .fill 3\n .fill 4\n .fill 5\n .fill 6\n .fill 7\n .fill 8\n .fill 9\n .fill 10\n"
+    "   .fill 11\n .fill 12\n .fill 13\n .fill 14\n .fill 15\n .fill 16\n .fill 17\n .fill 18\n .fill 19\n .fill 20\n"
+    ".end\n";
+
+    std::vector<int16_t> params;
+    for (int16_t i = 1; i <= 20; i++)
+        params.push_back(i);
+    const std::string verification = build_verification("test.asm", {{17, "SUB", params}});  // SUBROUTINE_CALL
+
+    std::stringstream file(asm_file);
+    lc3_assemble(state, file, options);
+
+    // More arguments than are recorded by default can't pass.
+    lc3_verification_context context;
+    lc3_begin_verification(state, context);
+    lc3_run(state, 1000);
+    BOOST_CHECK(!lc3_run_verification(state, verification, context).passed);
+
+    // Recording as much of the stack as the plan needs.
+    state.pc = 0x3000;
+    state.halted = false;
+    lc3_begin_verification(state, context, *lc3_parse_verification(verification));
+    lc3_run(state, 1000);
+    BOOST_CHECK_EQUAL(context.stack_words, 20);
+    BOOST_CHECK(lc3_run_verification(state, verification, context).passed);
+    lc3_end_verification(state, context);
+}
+
 BOOST_FIXTURE_TEST_CASE(DescribeReplayTest, LC3ReplayTest)
 {
     std::string output = lc3_describe_replay(REPLAY_STRING);
@@ -454,4 +748,85 @@ BOOST_FIXTURE_TEST_CASE(ReplayTestRejectBadCompression, LC3ReplayTest)
     std::stringstream file(asm_file);
     std::stringstream input;
     BOOST_CHECK_THROW(lc3_setup_replay(state, "test.asm", file, replay, input), LC3ReplayStringException);
-}
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE(BatchTest)
+{
+    // Jobs are given by filename, so the programs are written to a directory of their own.
+    std::string directory_template = (std::filesystem::temp_directory_path() / "lc3_batch_testXXXXXX").string();
+    BOOST_REQUIRE(mkdtemp(directory_template.data()) != nullptr);
+    const std::filesystem::path directory(directory_template);
+    const std::string echo_file = (directory / "echo.asm").string();
+    const std::string loop_file = (directory / "loop.asm").string();
+    {
+        std::ofstream echo(echo_file);
+        echo << ".orig x3000\n"
+                "   GETC\n"
+                "   OUT\n"
+                "   GETC\n"
+                "   OUT\n"
+                "   HALT\n"
+                ".end\n";
+        std::ofstream loop(loop_file);
+        loop << ".orig x3000\n"
+                "   BR #-1\n"
+                ".end\n";
+    }
+
+    std::vector<lc3_batch_job> jobs(6);
+    jobs[0].filename = echo_file;
+    jobs[0].input = "ab";
+    jobs[1].filename = echo_file;
+    jobs[1].input = "cd";
+    jobs[2].filename = loop_file;
+    jobs[2].budget = 1000;
+    jobs[3].filename = echo_file;
+    jobs[3].input = "ab";
+    jobs[4].filename = (directory / "missing.asm").string();
+    jobs[5].filename = loop_file;
+    jobs[5].replay = "not a replay string";
+
+    std::vector<bool> seen(jobs.size(), false);
+    auto results = lc3_run_batch(jobs, 4, [&seen](const lc3_batch_result& result) { seen[result.job] = true; });
+    BOOST_REQUIRE_EQUAL(results.size(), jobs.size());
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        BOOST_CHECK(seen[i]);
+        BOOST_CHECK_EQUAL(results[i].job, i);
+    }
+
+    BOOST_CHECK(results[0].error.empty());
+    BOOST_CHECK(results[0].halted);
+    BOOST_CHECK(!results[0].timeout);
+    BOOST_CHECK(results[1].halted);
+    BOOST_CHECK_EQUAL(results[0].output_size, 2);
+    BOOST_CHECK_EQUAL(results[0].output_size, results[1].output_size);
+    BOOST_CHECK(results[0].output_digest != results[1].output_digest);
+    BOOST_CHECK_EQUAL(results[0].output_digest, results[3].output_digest);
+    BOOST_CHECK_EQUAL(results[0].executions, results[3].executions);
+    // Jobs without plugins shouldn't be held back by undo history.
+    BOOST_CHECK(results[0].fast);
+    BOOST_CHECK(results[2].fast);
+    BOOST_CHECK(results[3].fast);
+
+    BOOST_CHECK(results[2].error.empty());
+    BOOST_CHECK(!results[2].halted);
+    BOOST_CHECK(results[2].timeout);
+    BOOST_CHECK_EQUAL(results[2].executions, 1000);
+
+    BOOST_CHECK(!results[4].error.empty());
+    BOOST_CHECK(!results[5].error.empty());
+
+    // Same results on one thread.
+    auto serial = lc3_run_batch(jobs, 1);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(serial[i].executions, results[i].executions);
+        BOOST_CHECK_EQUAL(serial[i].output_digest, results[i].output_digest);
+    }
+
+    BOOST_CHECK_EQUAL(lc3_format_batch_result(jobs[2], results[2]).find("\"status\":\"timeout\"") != std::string::npos, true);
+    BOOST_CHECK_EQUAL(lc3_format_batch_result(jobs[4], results[4]).find("\"status\":\"error\"") != std::string::npos, true);
+
+    std::filesystem::remove_all(directory);
+}